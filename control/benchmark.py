@@ -0,0 +1,50 @@
+import struct
+import sys
+
+from manager.base import STATUSCODES, get_connection
+from manager.benchmark import format_memory_results, format_scheduler_results
+
+TEST_SCHEDULER = b'\x11\x01'
+TEST_MEMORY = b'\x11\x02'
+
+
+def recv_exactly(connection, length):
+    buff = b''
+    while len(buff) < length:
+        data = connection.recv(length - len(buff))
+        if not data:
+            print('Connection closed')
+            exit(1)
+        buff += data
+    return buff
+
+
+def run(connection, command):
+    """ Sends the command and returns the response without the status byte. Exits on errors. """
+    connection.send(command)
+    package_type, package_len = struct.unpack('<BH', recv_exactly(connection, 3))
+    response = recv_exactly(connection, package_len)
+    if response[0] != 0:
+        print('Error: {}'.format(STATUSCODES.get(response[0], response[0])))
+        exit(1)
+    return response[1:]
+
+
+def main(which):
+    connection = get_connection()
+    try:
+        if which in ('all', 'memory'):
+            print(format_memory_results(run(connection, TEST_MEMORY)))
+            print()
+        if which in ('all', 'scheduler'):
+            print(format_scheduler_results(run(connection, TEST_SCHEDULER)))
+    finally:
+        connection.close()
+
+
+if __name__ == '__main__':
+    which = sys.argv[1] if len(sys.argv) > 1 else 'all'
+    if which not in ('all', 'memory', 'scheduler'):
+        print('Usage: {} [all|memory|scheduler]'.format(sys.argv[0]))
+        exit(1)
+    main(which)
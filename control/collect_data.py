@@ -6,6 +6,7 @@ import sys
 import os.path
 
 from manager.base import CONNECTION_TYPE_DATA, PACKAGE_TYPE_DATA, base
+from manager.sequence import SequenceCounter
 
 
 DEFAULT_FILENAME = 'samples.txt'
@@ -15,11 +16,12 @@ class DataThread(threading.Thread):
     """
     Recieves data and writes to the given filehandle
     """
-    meta_info_size = 8
+    meta_info_size = 12
 
     def __init__(self, connection, stop_event, N, filehandle, *args, **kwargs):
         super().__init__(*args, **kwargs)
         self.connection = connection
+        self.sequence_counter = SequenceCounter()  # Detects lost data packets.
         self.stop_event = stop_event
         self.filehandle = filehandle
         self.N = N
@@ -89,7 +91,10 @@ class DataThread(threading.Thread):
 
     def input(self, buff):
         """ Takes the content of one package and process it. """
-        ref, = struct.unpack('<Q', buff[0:self.meta_info_size])  # get the timereference
+        ref, sequence = struct.unpack('<QI', buff[0:self.meta_info_size])  # get the timereference and sequence
+        lost = self.sequence_counter.input(sequence)
+        if lost > 0:
+            print('Lost {} data packet(s) before packet {}'.format(lost, sequence))
 
         data_len = len(buff) - self.meta_info_size
         # iterate over all values given
@@ -8,6 +8,7 @@ import numpy as np
 from matplotlib.lines import Line2D
 
 from manager.base import CONNECTION_TYPE_DATA, PACKAGE_TYPE_DATA, base
+from manager.sequence import SequenceCounter
 
 
 class DataBuffer():
@@ -88,11 +89,12 @@ class DataThread(threading.Thread):
     The Thread recieveing data. Passes the data to a PlotThread instance
     """
 
-    meta_info_size = 8  # Size of the metainfo of each data packet.
+    meta_info_size = 12  # Size of the metainfo of each data packet.
 
     def __init__(self, connection, plot, fig, ax, *args, **kwargs):
         super().__init__(*args, **kwargs)
         self.connection = connection
+        self.sequence_counter = SequenceCounter()  # Detects lost data packets.
         self.data_buffer = DataBuffer()  # This is used to synchronize the data between this
         # and the plot thread
         self.plot_thread = PlotUpdateThread(self.data_buffer, plot, fig, ax, daemon=True)
@@ -130,7 +132,10 @@ class DataThread(threading.Thread):
 
     def input(self, buff):
         """ Takes the content of one package and process it. """
-        ref, = struct.unpack('<Q', buff[0:self.meta_info_size])  # get the timereference
+        ref, sequence = struct.unpack('<QI', buff[0:self.meta_info_size])  # get the timereference and sequence
+        lost = self.sequence_counter.input(sequence)
+        if lost > 0:
+            print('Lost {} data packet(s) before packet {}'.format(lost, sequence))
 
         data_len = len(buff)-self.meta_info_size
         # iterate over all values given
@@ -6,6 +6,7 @@ import threading
 from manager.base import (
     CONNECT_MAGIC,
     CONNECTION_TYPE_STATUS,
+    FramedSocket,
     PACKAGE_TYPE_RESPONSE,
     PACKAGE_TYPE_STATUS,
     connection_timeout,
@@ -15,7 +16,7 @@ from manager.base import (
 from manager.command import CommandManager
 from manager.commands import BashCommand
 from manager.ui import UI
-from manager.state import State
+from manager.state import State, StateStream
 from manager.responseholder import ResponseHolder
 
 
@@ -56,7 +57,7 @@ class RecvThread(threading.Thread):
 
             try:
                 if package_type == PACKAGE_TYPE_STATUS:
-                    self.main.update_state(State(bytes(buff)))
+                    self.main.handle_state_message(bytes(buff[0:package_len]))
                 elif package_type == PACKAGE_TYPE_RESPONSE:
                     self.response_holder.set(bytes(buff))
                     self.recv_event.set()
@@ -85,6 +86,7 @@ class Main:
         self.ui = UI(stdscr, self.command_manager)
 
         self.current_status = None
+        self.state_stream = StateStream()
 
     def run(self):
         """ The main entry point. Connects and run the main loop. """
@@ -96,7 +98,7 @@ class Main:
 
         # Try to connect to the server
         try:
-            c = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+            c = FramedSocket(socket.AF_INET, socket.SOCK_STREAM)
             c.settimeout(connection_timeout)
             c.connect((host, port))
         except (ConnectionRefusedError, OSError):
@@ -177,18 +179,28 @@ class Main:
         return
 
     def query_initial_status(self, connection):
-        """ Sends an initial status update to retrieve the current state. """
+        """
+        Sends an initial status update to retrieve the current state. State messages, that arrive
+        before the response, are handled.
+        """
         command_bytes = self.command_manager.get_command('adc update state').get_command_bytes('')
         connection.send(command_bytes)
 
-        # Metadata: type and length
-        package_descriptor = connection.recv(3)
-        package_type, package_len = struct.unpack('<BH', package_descriptor)
+        while True:
+            # Metadata: type and length
+            package_descriptor = b''
+            while len(package_descriptor) < 3:
+                package_descriptor += connection.recv(3 - len(package_descriptor))
+            package_type, package_len = struct.unpack('<BH', package_descriptor)
+
+            # Get content of the package.
+            buff = b''
+            while len(buff) < package_len:
+                buff += connection.recv(package_len - len(buff))
 
-        # Get content of the package.
-        buff = b''
-        while len(buff) < package_len:
-            buff += connection.recv(package_len - len(buff))
+            if package_type != PACKAGE_TYPE_STATUS:
+                break
+            self.handle_state_message(buff)
 
         if package_type == PACKAGE_TYPE_RESPONSE:
             status, = struct.unpack('<B', buff[0:1])
@@ -199,6 +211,14 @@ class Main:
         else:
             self.ui.print("Couldn't get a first status update")
 
+    def handle_state_message(self, message):
+        """ Applies the full or delta state message. """
+        state = self.state_stream.handle_message(message)
+        if state is None:
+            self.ui.print('A state message is missing, waiting for the next full state')
+        else:
+            self.update_state(state)
+
     def update_state(self, state):
         self.current_state = state
         self.ui.update_state(state)
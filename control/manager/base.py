@@ -1,6 +1,7 @@
 # Base file with all defined values used in the communication with
 # the ADC. Also has the connection routines to build up an initial connection.
 import socket
+import struct
 
 from settings import connection_timeout, host, port
 
@@ -16,6 +17,10 @@ PACKAGE_TYPE_STATUS = 2
 PACKAGE_TYPE_DATA = 4
 PACKAGE_TYPE_FFT = 8
 CONNECT_MAGIC = b'\x10\x00'
+SET_SEND_POLICY = b'\x10\x01'
+SEND_POLICY_BLOCK = b'\x00'
+SEND_POLICY_DROP_OLDEST = b'\x01'
+SEND_POLICY_DISCONNECT = b'\x02'
 
 STATUSCODES = {
     0x00: 'RESPONSE_OK',
@@ -43,25 +48,41 @@ STATUSCODES = {
 }
 
 
+class FramedSocket(socket.socket):
+    """
+    Sends every message as a frame with the length (u16) in front. The server detects this by the
+    first message and collects the frames, so commands can be sent without waiting for the
+    responses. The responses come in the same order.
+    """
+    def send(self, data):
+        super().sendall(struct.pack('<H', len(data)) + data)
+        return len(data)
+
+
 def base(cb, *args, connection_type=CONNECTION_TYPE_NONE, skip_connection_magic=False,
-         skip_check=False, **kwargs):
+         skip_check=False, send_policy=None, framed=False, **kwargs):
     """
     Wrapper for the main. Calles the given callback (cb) with the active connection as
     the first parameter and then every extra parameter given.
     """
-    cb(get_connection(connection_type, skip_connection_magic, skip_check), *args, **kwargs)
+    cb(get_connection(connection_type, skip_connection_magic, skip_check, send_policy, framed),
+       *args, **kwargs)
 
 
 def get_connection(connection_type=CONNECTION_TYPE_NONE, skip_connection_magic=False,
-                   skip_check=False):
+                   skip_check=False, send_policy=None, framed=False):
     """
     Establish a connection to the ADC. Uses host and port given in the settings.py.
     Exits the program with an error, if the connection could not be established.
     After the TCP connection is up, the connection magic and the connection type is
     send to the server. Checks, if the response is valid.
+    If `send_policy` is given, the server is told, what to do if this client is too slow.
+    The default for TCP clients is SEND_POLICY_BLOCK: The measurement is stopped.
+    If `framed` is given, the messages are sent as frames, see FramedSocket.
     """
     try:
-        c = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        socket_class = FramedSocket if framed else socket.socket
+        c = socket_class(socket.AF_INET, socket.SOCK_STREAM)
         c.settimeout(connection_timeout)
         c.connect((host, port))
     except (ConnectionRefusedError, OSError):
@@ -69,13 +90,22 @@ def get_connection(connection_type=CONNECTION_TYPE_NONE, skip_connection_magic=F
         exit(1)
 
     if not skip_connection_magic:
-        connect_payload = CONNECT_MAGIC + connection_type
-        c.send(connect_payload)
-        if not skip_check:
-            recv = c.recv(4)
-            if recv != b'\x00\x01\x00\x00':
-                print(repr(recv))
-                print('error during connecting')
-                exit(1)
+        # With a send policy, the type is set after the policy, so no data is received before.
+        first_connection_type = connection_type if send_policy is None else CONNECTION_TYPE_NONE
+        send_and_check(c, CONNECT_MAGIC + first_connection_type, skip_check, 'connecting')
+        if send_policy is not None:
+            send_and_check(c, SET_SEND_POLICY + send_policy, skip_check, 'setting the send policy')
+            send_and_check(c, CONNECT_MAGIC + connection_type, skip_check, 'setting the connection type')
     c.settimeout(None)
     return c
+
+
+def send_and_check(c, payload, skip_check, action):
+    """ Sends the command and exits the program, if the response is not ok. """
+    c.send(payload)
+    if not skip_check:
+        recv = c.recv(4)
+        if recv != b'\x00\x01\x00\x00':
+            print(repr(recv))
+            print('error during {}'.format(action))
+            exit(1)
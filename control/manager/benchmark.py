@@ -0,0 +1,75 @@
+# Parses and formats the results of the benchmark commands (test memory, test scheduler, test sd).
+import struct
+
+MEMORY_REGIONS = {0: 'DTCM', 1: 'SRAM1', 2: 'SDRAM'}
+MEMORY_RESULT_FORMAT = '<BBHIIIIH'
+SCHEDULER_TESTS = {
+    0: 'task switch',
+    1: 'signal round trip',
+    2: 'queue round trip',
+    3: 'isr entry',
+    4: 'isr to task wakeup',
+    5: 'pool alloc+free',
+}
+SD_OPERATIONS = {0: 'write', 1: 'read'}
+SD_RESULT_FORMAT = '<BBBIII'
+HISTOGRAM_BINS = 16
+HISTOGRAM_FORMAT = '<BHIII' + 'H' * HISTOGRAM_BINS
+
+
+def parse_results(data, fmt):
+    """ Returns the core clock and a list of tuples, one per result given in `fmt`. """
+    core_clock, count = struct.unpack('<IB', data[0:5])
+    size = struct.calcsize(fmt)
+    results = []
+    for i in range(count):
+        results.append(struct.unpack(fmt, data[5 + i*size: 5 + (i+1)*size]))
+    return core_clock, results
+
+
+def format_memory_results(data):
+    """ Formats the response (without status byte) of the memory benchmark as a table. """
+    core_clock, results = parse_results(data, MEMORY_RESULT_FORMAT)
+    mhz = core_clock / 1000000
+    lines = ['Core clock: {:.0f} MHz. Throughput in MB/s, latency in cycles per load.'.format(mhz),
+             '{:<6} {:<6} {:>6} {:>8} {:>8} {:>8} {:>8}'.format(
+                 'region', 'cache', 'size', 'memcpy', 'read', 'write', 'latency')]
+    for region, cached, size, copy, read, write, latency, loads in results:
+        def throughput(cycles):
+            return size * mhz / cycles if cycles > 0 else 0
+        lines.append('{:<6} {:<6} {:>6} {:>8.1f} {:>8.1f} {:>8.1f} {:>8.2f}'.format(
+            MEMORY_REGIONS.get(region, region), 'on' if cached else 'off', size,
+            throughput(copy), throughput(read), throughput(write), latency / loads if loads > 0 else 0))
+    return '\n'.join(lines)
+
+
+def format_sd_results(data):
+    """ Formats the response (without status byte) of the SD card benchmark as a table. """
+    core_clock, results = parse_results(data, SD_RESULT_FORMAT)
+    lines = ['Throughput in kB/s. Unaligned buffers are copied through the scratch buffer of the driver.',
+             '{:<6} {:<9} {:>6} {:>9} {:<5}'.format('op', 'buffer', 'chunk', 'kB/s', 'data')]
+    for operation, aligned, valid, chunk, size, cycles in results:
+        seconds = cycles / core_clock if core_clock > 0 else 0
+        lines.append('{:<6} {:<9} {:>6} {:>9.1f} {:<5}'.format(
+            SD_OPERATIONS.get(operation, operation), 'aligned' if aligned else 'unaligned', chunk,
+            size / 1024 / seconds if seconds > 0 else 0, 'ok' if valid else 'BAD'))
+    return '\n'.join(lines)
+
+
+def format_scheduler_results(data):
+    """ Formats the response (without status byte) of the scheduler benchmark as tables. """
+    core_clock, results = parse_results(data, HISTOGRAM_FORMAT)
+    mhz = core_clock / 1000000
+    lines = ['Core clock: {:.0f} MHz. All values in cycles.'.format(mhz),
+             '{:<20} {:>7} {:>7} {:>7} {:>7} {:>9}'.format('test', 'samples', 'min', 'mean', 'max', 'mean (us)')]
+    for test, samples, min, max, mean, *bins in results:
+        lines.append('{:<20} {:>7} {:>7} {:>7} {:>7} {:>9.2f}'.format(
+            SCHEDULER_TESTS.get(test, test), samples, min, mean, max, mean / mhz))
+
+    lines.append('')
+    lines.append('Histograms (samples with [2^i, 2^(i+1)) cycles, the last bin has all above):')
+    for test, samples, min, max, mean, *bins in results:
+        filled = [(i, count) for i, count in enumerate(bins) if count > 0]
+        lines.append('{}: {}'.format(SCHEDULER_TESTS.get(test, test), ', '.join(
+            '{}: {}'.format(2**i, count) for i, count in filled)))
+    return '\n'.join(lines)
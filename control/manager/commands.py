@@ -1,7 +1,8 @@
 import struct
 
 from .base import STATUSCODES
-from .state import State
+from .benchmark import format_memory_results, format_scheduler_results, format_sd_results
+from .state import State, StateError
 from .utils import parse_number
 from .base import connection_timeout
 
@@ -269,6 +270,40 @@ class AdcUpdateStateCommand(RemoteCommand):
             self.main.ui.print(str(state))
 
 
+class AdcApplyConfigurationCommand(RemoteCommand):
+    """
+    Applies a whole configuration at once. The argument is a file with the raw state, e.g. the state
+    file from the SD card. Measurements with the id 255 get a free id.
+    """
+    def get_command_bytes(self, args):
+        filename = args.strip()
+        if not filename:
+            raise ValueError(self.format_for_help())
+        try:
+            with open(filename, 'rb') as f:
+                configuration = f.read()
+        except OSError as e:
+            raise ValueError('Could not read {}: {}'.format(filename, e))
+        try:
+            State(configuration)  # Checks, that the configuration is complete.
+        except StateError as e:
+            raise ValueError('{} is not a valid configuration: {}'.format(filename, e))
+        return self.command_bytes + configuration
+
+    def format_for_help(self):
+        return 'Usage: {}\n  <The file with the raw state, e.g. the state file from the SD card>'.format(
+            self.command_name)
+
+    def handle_response(self, response):
+        status = response[0]
+        if status != 0:
+            self.print_error(status)
+        else:
+            count = response[1]
+            ids = ', '.join(str(id) for id in response[2:2+count])
+            self.main.ui.print('Applied the configuration. Measurement ids: {}'.format(ids or 'none'))
+
+
 class Base4BytesInReturnCommand(RemoteCommand):
     """
     This base class accepts next to the status byte 4 additional bytes.
@@ -340,6 +375,16 @@ class MeasurementOneshotCommand(Base4BytesInReturnCommand):
         return self.timeout
 
 
+class ConnectionGrantCreditCommand(Base4BytesInReturnCommand):
+    """ Prints the credit, that is available afterwards """
+    def handle_data(self, data):
+        available = struct.unpack('<I', data[0:4])[0]
+        if available == 0xFFFFFFFF:
+            self.main.ui.print('Flow control disabled')
+        else:
+            self.main.ui.print('Available credit: {} bytes'.format(available))
+
+
 class CalibrationsequenceOffsetCommand(Base4BytesInReturnCommand):
     """ Interprets the data as the new offset """
     def handle_data(self, data):
@@ -361,6 +406,40 @@ class CalibrationsequenceScaleCommand(Base4BytesInReturnCommand):
         self.main.ui.print('Scale: {} (diff: {})'.format(scale, scale_diff))
 
 
+class TestSchedulerCommand(RemoteCommand):
+    """ Runs the scheduler benchmark and prints the latencies. """
+    def handle_response(self, response):
+        status = response[0]
+        if status != 0:
+            self.print_error(status)
+        else:
+            self.main.ui.print(format_scheduler_results(response[1:]))
+
+
+class TestMemoryCommand(RemoteCommand):
+    """ Runs the memory benchmark and prints throughput and latency per memory. """
+    def handle_response(self, response):
+        status = response[0]
+        if status != 0:
+            self.print_error(status)
+        else:
+            self.main.ui.print(format_memory_results(response[1:]))
+
+
+class TestSdCommand(RemoteCommand):
+    """ Runs the SD card benchmark and prints the throughput per chunk size. """
+    def handle_response(self, response):
+        status = response[0]
+        if status != 0:
+            self.print_error(status)
+        else:
+            self.main.ui.print(format_sd_results(response[1:]))
+
+    def get_timeout(self):
+        """ Writing and reading the test file takes some seconds. """
+        return max(connection_timeout, 60)
+
+
 class PrintCommand(BaseCommand):
     """
     This base class handels all commands, that recievs ascii data
@@ -380,3 +459,19 @@ class PrintOsstatsCommand(PrintCommand):
 
 class PrintConnectionsCommand(PrintCommand):
     pass
+
+
+class PrintDropstatsCommand(PrintCommand):
+    pass
+
+
+class PrintMemstatsCommand(PrintCommand):
+    pass
+
+
+class PrintTxstatsCommand(PrintCommand):
+    pass
+
+
+class PrintRecstatsCommand(PrintCommand):
+    pass
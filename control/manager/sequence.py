@@ -0,0 +1,37 @@
+class SequenceCounter:
+    """
+    Counts received packets and lost packets by looking for gaps in the 32 bit
+    sequence numbers of data and fft packets (and the UDP stream).
+    Datagrams may be reordered, so a packet with a smaller sequence than expected
+    fills a gap, that was counted as lost before.
+    """
+    def __init__(self):
+        self.reset()
+
+    def reset(self):
+        """ Call this, if the measurement is restarted. The server starts with 0 again. """
+        self.expected = None
+        self.received = 0
+        self.lost = 0
+        self.reordered = 0
+
+    def input(self, sequence):
+        """ Counts the sequence. Returns the amount of packets lost just before this one. """
+        self.received += 1
+        if self.expected is None or sequence == 0:
+            # The first packet or the measurement was restarted (the ADC starts with 0 again).
+            self.expected = (sequence + 1) & 0xFFFFFFFF
+            return 0
+
+        # Use the difference modulo 2^32, so an overflow of the sequence is handled.
+        diff = (sequence - self.expected) & 0xFFFFFFFF
+        if diff < 0x80000000:
+            self.lost += diff
+            self.expected = (sequence + 1) & 0xFFFFFFFF
+            return diff
+
+        # An older packet
+        self.reordered += 1
+        if self.lost > 0:
+            self.lost -= 1
+        return 0
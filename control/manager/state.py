@@ -14,10 +14,18 @@ window_reverse_lookup = {
     255: 'Rectangular',
 }
 started_reverse_lookup = ['Idle', 'Running', 'Oneshot', 'Calibrating']
+overload_reverse_lookup = ['none', 'fft paused', 'decimated', 'dropping packets']
 
 adc_state_size = 21
 measurement_state_size = 9
 
+# State messages, see send_state_to_clients in state.c
+STATE_MESSAGE_FULL = 0
+STATE_MESSAGE_DELTA = 1
+state_message_header_size = 5
+# Offset and size of the fields of the ADC state in the order of the bits of the delta mask.
+adc_state_fields = [(0, 1), (1, 1), (2, 1), (3, 8), (11, 1), (12, 4), (16, 4), (20, 1)]
+
 
 class StateError(Exception):
     """ Represents an error during the creation of a state or measurement state """
@@ -98,6 +106,8 @@ class State:
         self.internal_reference = bool(flags & 0x04)
         self.slow_connection = bool(flags & 0x08)
         self.ADC_reset = bool(flags & 0x10)
+        self.overload = overload_reverse_lookup[int((flags & 0x60) >> 5)]
+        self.recording = bool(flags & 0x80)
         try:
             self.samplerate = samplerate_reverse_lookup[sr_filter & 0x0F]
         except IndexError:
@@ -155,12 +165,13 @@ class State:
         else:
             cal_scale_diff = '{0:.2f} ppm'.format(self.cal_scale_diff * 1000000)
 
-        msg = ('state: {}\ninternal_reference: {}\n{}{}' +
+        msg = ('state: {}\ninternal_reference: {}\noverload: {}\nrecording: {}\n{}{}' +
                'samplerate: {} SPS\nfilter: {}\n' +
                'pga: {}\nv_ref: {}nV\nv_ref_inputs: {} {}\n' +
                'cal offset: {}\n  (diff: {})\ncal scale: {}\n  (diff: {})\n' +
                'measurements: {}').format(
-                        self.started, self.internal_reference, slow_connection, ADC_reset,
+                        self.started, self.internal_reference, self.overload, self.recording,
+                        slow_connection, ADC_reset,
                         self.samplerate, self.filter, pga, self.v_ref, self.v_ref_pos, self.v_ref_neg,
                         self.calibration_offset, cal_offset_diff, self.calibration_scale,
                         cal_scale_diff, self.measurement_count)
@@ -174,3 +185,62 @@ class State:
                 measurement_strings.append(str(m))
             msg += '\n\n' + '\n'.join(measurement_strings)
         return msg
+
+
+class StateStream:
+    """
+    Builds the states from the state messages. A full message has the raw state, a delta
+    message only the changes since the message before. The server sends a full message, if a
+    message was lost. Until then, deltas that do not follow the last message are ignored.
+    """
+    def __init__(self):
+        self.version = None
+        self.adc = None
+        self.measurements = {}
+
+    def handle_message(self, message):
+        """ Returns the new state or None, if the message cannot be applied. """
+        if len(message) < state_message_header_size:
+            raise StateError("The server didn't send enough data")
+        kind, version = struct.unpack('<BI', message[0:state_message_header_size])
+        body = message[state_message_header_size:]
+
+        if kind == STATE_MESSAGE_FULL:
+            state = State(body)
+            self.adc = bytearray(body[0:adc_state_size])
+            self.measurements = {}
+            for i in range(state.measurement_count):
+                offset = adc_state_size + i*measurement_state_size
+                self.measurements[body[offset]] = bytes(body[offset:offset + measurement_state_size])
+            self.version = version
+            return state
+        elif kind != STATE_MESSAGE_DELTA:
+            raise StateError('Unknown state message: {}'.format(kind))
+
+        if self.version is None or version != (self.version + 1) & 0xFFFFFFFF:
+            self.version = None
+            return None
+
+        mask = body[0]
+        pos = 1
+        for i, (offset, size) in enumerate(adc_state_fields):
+            if mask & (1 << i):
+                self.adc[offset:offset + size] = body[pos:pos + size]
+                pos += size
+        changed = body[pos]
+        pos += 1
+        for i in range(changed):
+            measurement = bytes(body[pos:pos + measurement_state_size])
+            self.measurements[measurement[0]] = measurement
+            pos += measurement_state_size
+        deleted = body[pos]
+        pos += 1
+        for id in body[pos:pos + deleted]:
+            self.measurements.pop(id, None)
+
+        self.version = version
+        return State(self.get_raw_state())
+
+    def get_raw_state(self):
+        """ Returns the current state in the format of a full state. """
+        return bytes(self.adc) + b''.join(self.measurements[id] for id in sorted(self.measurements))
@@ -4,15 +4,17 @@ import sys
 import threading
 
 from manager.base import CONNECTION_TYPE_DATA, PACKAGE_TYPE_DATA, get_connection
+from manager.sequence import SequenceCounter
 
 
 class DataThread(threading.Thread):
     data_max_freq = 100  # See explaination in recieve_data.py. Use None to disable.
-    meta_info_size = 8
+    meta_info_size = 12
 
     def __init__(self, connection, client_id, *args, **kwargs):
         super().__init__(*args, **kwargs)
         self.connection = connection
+        self.sequence_counter = SequenceCounter()  # Detects lost data packets.
         self.client_id = client_id
         self.last_time_stamp = {}
         if self.data_max_freq is not None:
@@ -48,7 +50,10 @@ class DataThread(threading.Thread):
             buff = buff[package_len:]
 
     def input(self, buff):
-        ref, = struct.unpack('<Q', buff[0:self.meta_info_size])
+        ref, sequence = struct.unpack('<QI', buff[0:self.meta_info_size])
+        lost = self.sequence_counter.input(sequence)
+        if lost > 0:
+            print('Lost {} data packet(s) before packet {}'.format(lost, sequence))
 
         data_len = len(buff)-self.meta_info_size
         for i in range(data_len // 7):
@@ -7,6 +7,8 @@ from manager.base import CONNECTION_TYPE_FFT, PACKAGE_TYPE_FFT, get_connection
 
 
 class DataThread(threading.Thread):
+    metadata_size = 25
+
     def __init__(self, connection, client_id, *args, **kwargs):
         super().__init__(*args, **kwargs)
         self.connection = connection
@@ -42,10 +44,12 @@ class DataThread(threading.Thread):
 
     def input(self, buff):
         status = ''
-        if (len(buff)-21) % 8 != 0:
+        if len(buff) < self.metadata_size or (len(buff)-self.metadata_size) % 8 != 0:
             status = 'Size does not fit'
         else:
-            status = 'FFT size: {}'.format(int((len(buff)-21)/8))
+            id, frame_count, frame_number, length, timestamp, resolution, wss, sequence = struct.unpack(
+                '<BBBHQffI', buff[0:self.metadata_size])
+            status = 'FFT size: {}, sequence: {}'.format(int((len(buff)-self.metadata_size)/8), sequence)
 
         print("{} {} got package with len {}. {}".format(
             self.client_id,
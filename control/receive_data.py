@@ -7,7 +7,8 @@ import matplotlib.pyplot as plt
 import numpy as np
 from matplotlib.lines import Line2D
 
-from manager.base import CONNECTION_TYPE_DATA, PACKAGE_TYPE_DATA, base
+from manager.base import CONNECTION_TYPE_DATA, PACKAGE_TYPE_DATA, SEND_POLICY_DROP_OLDEST, base
+from manager.sequence import SequenceCounter
 
 
 class DataBuffer():
@@ -127,11 +128,12 @@ class DataThread(threading.Thread):
     Set this to None to disable this feature.
     """
 
-    meta_info_size = 8  # Size of the metainfo of each data packet.
+    meta_info_size = 12  # Size of the metainfo of each data packet.
 
     def __init__(self, connection, plot, fig, ax, *args, **kwargs):
         super().__init__(*args, **kwargs)
         self.connection = connection
+        self.sequence_counter = SequenceCounter()  # Detects lost data packets.
         self.data_buffer = DataBuffer()  # This is used to synchronize the data between this
         # and the plot thread
         self.plot_thread = PlotUpdateThread(self.data_buffer, plot, fig, ax, daemon=True)
@@ -174,7 +176,10 @@ class DataThread(threading.Thread):
 
     def input(self, buff):
         """ Takes the content of one package and process it. """
-        ref, = struct.unpack('<Q', buff[0:self.meta_info_size])  # get the timereference
+        ref, sequence = struct.unpack('<QI', buff[0:self.meta_info_size])  # get the timereference and sequence
+        lost = self.sequence_counter.input(sequence)
+        if lost > 0:
+            print('Lost {} data packet(s) before packet {}'.format(lost, sequence))
 
         data_len = len(buff)-self.meta_info_size
         # iterate over all values given
@@ -262,4 +267,5 @@ def main(connection):
 
 
 if __name__ == '__main__':
-    base(main, connection_type=CONNECTION_TYPE_DATA)   # get a data connection
+    # get a data connection. Just plotting, so drop data instead of stopping the measurement.
+    base(main, connection_type=CONNECTION_TYPE_DATA, send_policy=SEND_POLICY_DROP_OLDEST)
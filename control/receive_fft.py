@@ -8,6 +8,7 @@ import numpy as np
 from matplotlib.lines import Line2D
 
 from manager.base import CONNECTION_TYPE_FFT, PACKAGE_TYPE_FFT, base
+from manager.sequence import SequenceCounter
 
 
 class DataBuffer():
@@ -128,11 +129,12 @@ class PlotUpdateThread(threading.Thread):
 
 
 class DataThread(threading.Thread):
-    metadata_size = 21
+    metadata_size = 25
 
     def __init__(self, connection, plot, fig, ax, *args, **kwargs):
         super().__init__(*args, **kwargs)
         self.connection = connection
+        self.sequence_counters = {}  # One per measurement id. Detects skipped or lost FFTs.
         self.data_buffer = DataBuffer()
         self.plot_thread = PlotUpdateThread(self.data_buffer, plot, fig, ax, daemon=True)
         self.last_frame_number = -1
@@ -167,7 +169,13 @@ class DataThread(threading.Thread):
             buff = buff[package_len:]
 
     def input(self, buff):
-        id, frame_count, frame_number, length, timestamp, resolution, wss = struct.unpack('<BBBHQff', buff[0:self.metadata_size])
+        id, frame_count, frame_number, length, timestamp, resolution, wss, sequence = struct.unpack(
+            '<BBBHQffI', buff[0:self.metadata_size])
+
+        if frame_number == 0:
+            lost = self.sequence_counters.setdefault(id, SequenceCounter()).input(sequence)
+            if lost > 0:
+                print('Lost {} FFT(s) of id {} before FFT {}'.format(lost, id, sequence))
 
         # print("got data: frame {}/{}".format(frame_number+1, frame_count))
         if self.last_frame_number+1 != frame_number:
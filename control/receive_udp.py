@@ -0,0 +1,118 @@
+import socket
+import struct
+import sys
+import time
+
+from manager.base import (CONNECTION_TYPE_DATA, PACKAGE_TYPE_DATA, PACKAGE_TYPE_DEBUG, PACKAGE_TYPE_FFT,
+                          PACKAGE_TYPE_STATUS, get_connection)
+from manager.sequence import SequenceCounter
+
+SET_UDP_STREAM = b'\x10\x02'
+SEQUENCE_SIZE = 4  # Each datagram starts with a 32 bit sequence number.
+ADCP_HEADER_SIZE = 3
+PACKAGE_TYPE_NAMES = {
+    PACKAGE_TYPE_DEBUG: 'debug',
+    PACKAGE_TYPE_STATUS: 'status',
+    PACKAGE_TYPE_DATA: 'data',
+    PACKAGE_TYPE_FFT: 'fft',
+}
+
+
+def configure_stream(address, port, send_type):
+    """
+    Tells the ADC to stream the given send types to address:port. A send type of 0 stops the stream.
+    The ADCP connection is closed afterwards, the stream stays configured.
+    """
+    payload = SET_UDP_STREAM + socket.inet_aton(address) + struct.pack('<HB', port, send_type)
+    connection = get_connection()
+    connection.send(payload)
+    response = connection.recv(4)
+    connection.close()
+    if response != b'\x00\x01\x00\x00':
+        print(repr(response))
+        print('error during configuring the UDP stream')
+        exit(1)
+
+
+def open_socket(address, port):
+    """ Binds to the port. For a multicast address, the group is joined. """
+    s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+    s.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    s.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 4*1024*1024)
+    if socket.inet_aton(address)[0] in range(224, 240):
+        s.bind(('', port))
+        mreq = struct.pack('4sl', socket.inet_aton(address), socket.INADDR_ANY)
+        s.setsockopt(socket.IPPROTO_IP, socket.IP_ADD_MEMBERSHIP, mreq)
+    else:
+        s.bind(('', port))
+    return s
+
+
+def parse_datagram(datagram):
+    """
+    Splits a datagram of the stream into the sequence number, the package type and the payload.
+    Raises a ValueError, if the datagram is too short or the length does not fit.
+    """
+    if len(datagram) < SEQUENCE_SIZE + ADCP_HEADER_SIZE:
+        raise ValueError('Datagram too short: {} bytes'.format(len(datagram)))
+
+    sequence, package_type, package_len = struct.unpack('<IBH', datagram[0:SEQUENCE_SIZE + ADCP_HEADER_SIZE])
+    if package_len != len(datagram) - SEQUENCE_SIZE - ADCP_HEADER_SIZE:
+        raise ValueError('Wrong package length {} in datagram {}'.format(package_len, sequence))
+    return sequence, package_type, datagram[SEQUENCE_SIZE + ADCP_HEADER_SIZE:]
+
+
+def main(address, port, send_type, configure):
+    s = open_socket(address, port)
+    if configure:
+        configure_stream(address, port, send_type)
+
+    counter = SequenceCounter()
+    packets_per_type = {}
+    bytes_received = 0
+    last_print = time.time()
+    try:
+        while True:
+            datagram = s.recv(65536)
+            try:
+                sequence, package_type, payload = parse_datagram(datagram)
+            except ValueError as e:
+                print(e)
+                continue
+
+            counter.input(sequence)
+            packets_per_type[package_type] = packets_per_type.get(package_type, 0) + 1
+            bytes_received += len(datagram)
+
+            now = time.time()
+            if now - last_print >= 1:
+                types = ', '.join('{}: {}'.format(PACKAGE_TYPE_NAMES.get(t, t), c)
+                                  for t, c in sorted(packets_per_type.items()))
+                print('{:.1f} KB/s, received {}, lost {}, reordered {} ({})'.format(
+                    bytes_received/1024/(now - last_print), counter.received, counter.lost,
+                    counter.reordered, types))
+                bytes_received = 0
+                last_print = now
+    except KeyboardInterrupt:
+        pass
+    finally:
+        if configure:
+            configure_stream(address, port, 0)
+        s.close()
+
+
+if __name__ == '__main__':
+    if len(sys.argv) < 3:
+        print('Usage: {} <address> <port> [<send type>] [--no-configure]'.format(sys.argv[0]))
+        print('The address can be a multicast group (e.g. 239.0.0.1) or the address of this host.')
+        print('The send type defaults to data (0x04). With --no-configure, the stream must be')
+        print('configured by another client, e.g. to receive a multicast stream with many hosts.')
+        exit(1)
+
+    address = sys.argv[1]
+    port = int(sys.argv[2])
+    send_type = CONNECTION_TYPE_DATA[0]
+    if len(sys.argv) > 3 and sys.argv[3] != '--no-configure':
+        send_type = int(sys.argv[3], 0)
+    configure = '--no-configure' not in sys.argv
+    main(address, port, send_type, configure)
@@ -0,0 +1,83 @@
+import re
+import socket
+import struct
+import sys
+import time
+
+from manager.base import CONNECT_MAGIC, CONNECTION_TYPE_NONE, get_connection
+from settings import connection_timeout, host, port
+
+PRINT_MEMSTATS = b'\x11\x07'
+HEAP_REGEX = re.compile(r'Heap: free (\d+), min\. free (\d+)')
+REPORT_INTERVAL = 500
+
+
+def recv_exactly(connection, length):
+    buff = b''
+    while len(buff) < length:
+        data = connection.recv(length - len(buff))
+        if not data:
+            print('Connection closed')
+            exit(1)
+        buff += data
+    return buff
+
+
+def memstats():
+    """ Returns the memory statistics as text and the free heap in bytes. """
+    connection = get_connection()
+    try:
+        connection.send(PRINT_MEMSTATS)
+        package_type, package_len = struct.unpack('<BH', recv_exactly(connection, 3))
+        text = recv_exactly(connection, package_len).decode('ascii')
+    finally:
+        connection.close()
+    match = HEAP_REGEX.search(text)
+    return text.strip(), int(match.group(1)) if match else None
+
+
+def connect_once():
+    """ Connects, waits for the response of the connect command and closes. Returns the latency in seconds. """
+    start = time.perf_counter()
+    c = socket.create_connection((host, port), timeout=connection_timeout)
+    try:
+        c.send(CONNECT_MAGIC + CONNECTION_TYPE_NONE)
+        response = recv_exactly(c, 4)
+    finally:
+        c.close()
+    latency = time.perf_counter() - start
+    if response != b'\x00\x01\x00\x00':
+        print(repr(response))
+        print('error during connecting')
+        exit(1)
+    return latency
+
+
+def main(amount):
+    text, heap_before = memstats()
+    print(text)
+    print()
+
+    latencies = []
+    for i in range(1, amount + 1):
+        latencies.append(connect_once())
+        if i % REPORT_INTERVAL == 0:
+            _, heap = memstats()
+            print('{} connections, heap free {}, latency mean {:.2f} ms, max {:.2f} ms'.format(
+                i, heap, sum(latencies)/len(latencies)*1000, max(latencies)*1000))
+
+    print()
+    text, heap_after = memstats()
+    print(text)
+    print()
+    print('Latency: min {:.2f} ms, mean {:.2f} ms, max {:.2f} ms'.format(
+        min(latencies)*1000, sum(latencies)/len(latencies)*1000, max(latencies)*1000))
+    if heap_before is not None and heap_after is not None and heap_after != heap_before:
+        print('Heap drift: {:+d} bytes'.format(heap_after - heap_before))
+    else:
+        print('No heap drift')
+
+
+if __name__ == '__main__':
+    amount = int(sys.argv[1]) if len(sys.argv) > 1 else 5000
+    main(amount)
@@ -0,0 +1,83 @@
+# Loopback test for the UDP stream receiver: Sends sequenced datagrams like the ADC to a local
+# socket and checks, that receive_udp.py parses them and SequenceCounter finds gaps and reordering.
+# Run with: python3 -m unittest test_udp_loopback
+import socket
+import struct
+import unittest
+
+from manager.base import PACKAGE_TYPE_DATA, PACKAGE_TYPE_FFT
+from manager.sequence import SequenceCounter
+from receive_udp import open_socket, parse_datagram
+
+
+def make_datagram(sequence, package_type=PACKAGE_TYPE_DATA, payload=b'\x01\x02\x03\x04'):
+    """ A datagram like udp_stream_send writes it: sequence, ADCP header and payload. """
+    return struct.pack('<IBH', sequence, package_type, len(payload)) + payload
+
+
+class UdpLoopbackTest(unittest.TestCase):
+    def setUp(self):
+        self.receiver = open_socket('127.0.0.1', 0)
+        self.receiver.settimeout(1)
+        self.address = ('127.0.0.1', self.receiver.getsockname()[1])
+        self.sender = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+
+    def tearDown(self):
+        self.sender.close()
+        self.receiver.close()
+
+    def transfer(self, datagrams):
+        """ Sends all datagrams and feeds the received ones into a new counter. """
+        for datagram in datagrams:
+            self.sender.sendto(datagram, self.address)
+
+        counter = SequenceCounter()
+        received = []
+        for _ in datagrams:
+            sequence, package_type, payload = parse_datagram(self.receiver.recv(65536))
+            counter.input(sequence)
+            received.append((sequence, package_type, payload))
+        return counter, received
+
+    def test_in_order(self):
+        counter, received = self.transfer([make_datagram(i) for i in range(100)])
+        self.assertEqual(counter.received, 100)
+        self.assertEqual(counter.lost, 0)
+        self.assertEqual(counter.reordered, 0)
+        self.assertEqual(received[5], (5, PACKAGE_TYPE_DATA, b'\x01\x02\x03\x04'))
+
+    def test_gaps(self):
+        sequences = [0, 1, 2, 5, 6, 10]
+        counter, _ = self.transfer([make_datagram(i) for i in sequences])
+        self.assertEqual(counter.received, 6)
+        self.assertEqual(counter.lost, 2 + 3)
+        self.assertEqual(counter.reordered, 0)
+
+    def test_reordering(self):
+        sequences = [0, 1, 3, 2, 4, 6, 5]
+        counter, _ = self.transfer([make_datagram(i) for i in sequences])
+        self.assertEqual(counter.received, 7)
+        self.assertEqual(counter.lost, 0)
+        self.assertEqual(counter.reordered, 2)
+
+    def test_overflow(self):
+        sequences = [0xFFFFFFFE, 0xFFFFFFFF, 1, 2]
+        counter, _ = self.transfer([make_datagram(i, PACKAGE_TYPE_FFT) for i in sequences])
+        self.assertEqual(counter.lost, 1)  # 0 is missing
+        self.assertEqual(counter.reordered, 0)
+
+    def test_restart(self):
+        sequences = [0, 1, 2, 0, 1]
+        counter, _ = self.transfer([make_datagram(i) for i in sequences])
+        self.assertEqual(counter.lost, 0)
+        self.assertEqual(counter.reordered, 0)
+
+    def test_invalid_datagrams(self):
+        with self.assertRaises(ValueError):
+            parse_datagram(b'\x00\x00\x00\x00\x04')
+        with self.assertRaises(ValueError):
+            parse_datagram(make_datagram(1)[:-1])
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -11,40 +11,50 @@
 #include "stdint.h"
 #include "stddef.h"
 
+/**
+ * One entry of the queue. The sequence tells, whether the slot is free for the producer of
+ * position `sequence` or filled for the consumer of position `sequence-1`.
+ */
 typedef struct {
-	void** Q;
-	uint32_t length;
-	uint32_t head;
-	uint32_t marker_head;
-	uint32_t count;
-	uint8_t marker_updating;
+	volatile uint32_t sequence;
+	void* obj;
+} QueueSlot;
+
+/**
+ * Lock free ring, see adc_queue.c. The length must be a power of two.
+ * `head` is the next position to read, `tail` the next position to write. Both are only
+ * increased and wrap around at 2^32.
+ */
+typedef struct {
+	QueueSlot* slots;
+	uint32_t mask;
+	volatile uint32_t head;
+	volatile uint32_t tail;
 } Queue;
 
 
 #define QUEUE_OK				1
 #define QUEUE_ERR				0
 
-#define __DEFINE_QUEUE_OBJECT(name, length) void* __queue_obj_##name[(length)]
+#define __DEFINE_QUEUE_OBJECT(name, length) QueueSlot __queue_obj_##name[(length)]
 
 /**
- * Defines a queue with the given name and length.
+ * Defines a queue with the given name and length. The length must be a power of two.
+ * The queue must be reset once before it is used.
  */
 #define DEFINE_QUEUE(name, length) \
 	__DEFINE_QUEUE_OBJECT(name, length);\
-	Queue __queue_##name = {__queue_obj_##name, length, 0, 0};\
+	Queue __queue_##name = {__queue_obj_##name, (length)-1, 0, 0};\
 	Queue* name = &__queue_##name;
 
+void queue_init(Queue* queue, QueueSlot* slots, uint32_t length);
 uint8_t queue_full(Queue* queue);
 uint8_t queue_empty(Queue* queue);
 uint32_t queue_free(Queue* queue);
 uint32_t queue_allocated(Queue* queue);
 uint8_t queue_enqueue(Queue* queue, void* obj);
 void* queue_dequeue(Queue* queue);
-void* queue_front(Queue* queue);
+uint32_t queue_dequeue_batch(Queue* queue, void** objs, uint32_t max);
 void queue_reset(Queue* queue);
 
-void* queue_marker_dequeue(Queue* queue);
-void* queue_marker_front(Queue* queue);
-uint8_t queue_is_marker_updating(Queue* queue);
-
 #endif /* ADC_QUEUE_H_ */
@@ -25,6 +25,10 @@ extern "C" {
 
 // Commands per request
 #define CONNECTION_SET_TYPE			0x00
+#define CONNECTION_SET_SEND_POLICY	0x01
+#define CONNECTION_SET_UDP_STREAM	0x02
+#define CONNECTION_GRANT_CREDIT		0x03
+#define CONNECTION_REQUEST_STATE	0x04
 
 #define DEBUGGING_LWIP_STATS		0x00
 #define DEBUGGING_TEST_SCHEDULER	0x01
@@ -32,6 +36,11 @@ extern "C" {
 #define DEBUGGING_OS_STATS			0x03
 #define DEBUGGING_CONNECTION_STATS	0x04
 #define DEBUGGING_COMPARE_FFTS		0x05
+#define DEBUGGING_DROP_STATS		0x06
+#define DEBUGGING_MEMORY_STATS		0x07
+#define DEBUGGING_TX_STATS			0x08
+#define DEBUGGING_RECORDER_STATS	0x09
+#define DEBUGGING_TEST_SD			0x0A
 
 #define MEASUREMENT_START			0x01
 #define MEASUREMENT_STOP			0x02
@@ -41,6 +50,8 @@ extern "C" {
 #define MEASUREMENT_SET_ENABLED		0x06
 #define MEASUREMENT_SET_AVERAGING	0x07
 #define MEASUREMENT_ONE_SHOT		0x08
+#define MEASUREMENT_SET_OVERLOAD_POLICY	0x09
+#define MEASUREMENT_SET_RECORDING	0x0A
 
 #define ADC_RESET					0x00
 #define ADC_SET_SR					0x01
@@ -50,6 +61,7 @@ extern "C" {
 #define ADC_REF_SET_INTERNAL		0x05
 #define ADC_REF_SET_EXTERNAL		0x06
 #define ADC_GET_STATUS				0x07
+#define ADC_APPLY_CONFIGURATION		0x08
 
 #define FFT_SET_ENABLED				0x00
 #define FFT_SET_LENGTH				0x01
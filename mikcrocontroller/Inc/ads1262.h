@@ -515,9 +515,11 @@ typedef union { // page 70
  uint8_t ADS1262_get_samplerate();
  void ADS1262_set_filter(uint8_t filter);
  uint8_t ADS1262_read_filter();
+ uint8_t ADS1262_get_filter();
 
  void ADS1262_set_gain(uint8_t gain);
  uint8_t ADS1262_read_gain();
+ uint8_t ADS1262_get_gain();
  void ADS1262_bypass_PGA();
 
  void ADS1262_set_reference(uint8_t pos, uint8_t neg, uint64_t v_ref);
@@ -525,13 +527,18 @@ typedef union { // page 70
  void ADS1262_enable_internal_reference();
  void ADS1262_disable_internal_reference();
  uint8_t ADS1262_read_is_internal_reference_used();
+ uint8_t ADS1262_is_internal_reference_used();
+ uint8_t ADS1262_read_reference_pins();
+ uint8_t ADS1262_get_reference_pins();
  void ADS1262_set_reference_polarity_normal();
  void ADS1262_set_reference_polarity_reverse();
 
  int32_t ADS1262_read_calibration_offset();
+ int32_t ADS1262_get_calibration_offset();
  void ADS1262_set_calibration_offset(int32_t offset);
  void ADS1262_send_offset_calibration_command();
  uint32_t ADS1262_read_calibration_scale();
+ uint32_t ADS1262_get_calibration_scale();
  void ADS1262_set_calibration_scale(uint32_t scale);
  void ADS1262_send_scale_calibration_command();
 
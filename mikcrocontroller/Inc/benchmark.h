@@ -0,0 +1,98 @@
+/*
+ * benchmark.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: finn
+ */
+
+#ifndef BENCHMARK_H_
+#define BENCHMARK_H_
+
+#include "stdint.h"
+#include "sys/cdefs.h"
+#include "adcp.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Memory benchmark
+#define BENCHMARK_MEMORY_BUFFER_SIZE	8192 // Per region. Power of two, so it can be covered by one MPU region.
+#define BENCHMARK_MEMORY_REPETITIONS	8 // The minimum of all repetitions is reported.
+#define BENCHMARK_CACHE_LINE_SIZE		32 // The stride for the latency test.
+
+typedef enum {
+	BENCHMARK_REGION_DTCM,
+	BENCHMARK_REGION_SRAM1,
+	BENCHMARK_REGION_SDRAM,
+} BenchmarkRegion;
+
+// One result row. All values are cycles of the core clock.
+typedef struct __packed {
+	uint8_t region;		// See BenchmarkRegion
+	uint8_t cached;		// 1, if the data cache was enabled for the buffer
+	uint16_t size;		// Bytes per operation
+	uint32_t copy;		// memcpy of size bytes
+	uint32_t read;		// Reading size bytes in words
+	uint32_t write;		// Writing size bytes in words
+	uint32_t latency;	// `loads` dependent loads of pointers, one per cache line in random order
+	uint16_t loads;
+} benchmark_memory_result_t;
+
+// Scheduler benchmark
+#define BENCHMARK_SCHEDULER_SAMPLES		1000
+#define BENCHMARK_HISTOGRAM_BINS		16 // bin i counts samples with [2^i, 2^(i+1)) cycles. The last one all above.
+#define BENCHMARK_IRQn					TIM7_IRQn // Unused interrupt, pended in software.
+#define BENCHMARK_IRQ_PRIORITY			6 // The same as the DRDY interrupt.
+#define BENCHMARK_POOL_SIZE				112 // Entries of the pool test, like the data descriptor pool.
+
+typedef enum {
+	BENCHMARK_TEST_TASK_SWITCH,		// taskYIELD() between two tasks of the same priority
+	BENCHMARK_TEST_SIGNAL,			// osSignalSet/osSignalWait round trip to a higher priority task
+	BENCHMARK_TEST_QUEUE,			// osMessagePut/osMessageGet round trip to a higher priority task
+	BENCHMARK_TEST_ISR_ENTRY,		// Pending the interrupt until the handler runs
+	BENCHMARK_TEST_ISR_WAKEUP,		// osSignalSet in the handler until the signaled task runs
+	BENCHMARK_TEST_POOL,			// pool_alloc and pool_free of one entry with half of the pool allocated
+	BENCHMARK_TEST_COUNT,
+} BenchmarkTest;
+
+// Latency histogram of one test. All values are cycles of the core clock.
+typedef struct __packed {
+	uint8_t test;		// See BenchmarkTest
+	uint16_t samples;
+	uint32_t min;
+	uint32_t max;
+	uint32_t mean;
+	uint16_t bins[BENCHMARK_HISTOGRAM_BINS];
+} benchmark_histogram_t;
+
+// SD card benchmark
+#define BENCHMARK_SD_FILE				"0:/sdbench.bin" // Deleted after the benchmark.
+#define BENCHMARK_SD_FILE_SIZE			(256*1024) // Bytes written and read per result row.
+#define BENCHMARK_SD_MAX_CHUNK			32768
+
+typedef enum {
+	BENCHMARK_SD_WRITE,
+	BENCHMARK_SD_READ,
+} BenchmarkSdOperation;
+
+// One result row. The time is in cycles of the core clock.
+typedef struct __packed {
+	uint8_t operation;	// See BenchmarkSdOperation
+	uint8_t aligned;	// 1, if the buffer was cache line aligned. Otherwise it is copied through the scratch buffer of the driver.
+	uint8_t valid;		// 1, if the data read back is the data written.
+	uint32_t chunk;		// Bytes per f_read/f_write
+	uint32_t bytes;
+	uint32_t cycles;
+} benchmark_sd_result_t;
+
+protocol_error_t benchmark_memory(uint8_t* out_data, uint16_t* out_len, uint16_t max_len);
+protocol_error_t benchmark_scheduler(uint8_t* out_data, uint16_t* out_len, uint16_t max_len);
+protocol_error_t benchmark_sd(uint8_t* out_data, uint16_t* out_len, uint16_t max_len);
+void benchmark_irq_handler();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BENCHMARK_H_ */
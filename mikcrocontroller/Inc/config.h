@@ -13,7 +13,7 @@
 #include "sys/cdefs.h"
 
 // TCP reated configs
-#define MAX_CONNECTIONS 	8
+#define MAX_CONNECTIONS 	16
 #define MAX_MEASUREMENTS	8
 
 #define LISTEN_PORT		80
@@ -14,6 +14,8 @@ extern "C" {
 
 #include "pool.h"
 #include "network.h"
+#include "ff.h"
+#include "lwip/err.h"
 
 #define CONNECT_MAGIC1		0x10 /*PREFIX_CONNECTION*/
 #define CONNECT_MAGIC2		0x00 /*CONNECTION_SET_TYPE*/
@@ -24,8 +26,12 @@ extern "C" {
 #define SEND_TYPE_STATUS	0x02
 #define SEND_TYPE_DATA		0x04
 #define SEND_TYPE_FFT		0x08
+#define SEND_TYPE_COUNT		4 // The types above are bits 0..3
+
+#define CREDIT_UNLIMITED	0xFFFFFFFF // Disables the flow control for a send type, see send_data_grant_credit
 
 #define CONNECTION_BUFFER_SIZE	((1<<16)-1) // 64K
+#define CONNECTION_REQUEST_BUFFER_SIZE	2048 // For received HTTP requests and ADCP frames, that are not handled yet
 
 // All connection types, a TCP connection can have.
 typedef enum {
@@ -35,24 +41,69 @@ typedef enum {
 	CONNECTION_TYPE_TCP
 } ConnectionType;
 
+// What to do, if the transmit queue of a connection is full.
+typedef enum {
+	SEND_POLICY_BLOCK,			// The producer fails. For measurement data, the measurement is stopped.
+	SEND_POLICY_DROP_OLDEST,	// Drop the oldest queued packet of this connection.
+	SEND_POLICY_DISCONNECT,		// Close this connection.
+} SendPolicy;
+
+// A running HTTP transfer, see http_continue_transfer.
+typedef enum {
+	HTTP_TRANSFER_NONE,
+	HTTP_TRANSFER_FILE,		// Read block by block from the SD card into the output buffer until file_remaining is 0
+	HTTP_TRANSFER_CACHE,	// Written directly from the cache, see http_cache.c
+} HttpTransfer;
+
+struct connection_tx;
+
+/**
+ * The output buffer of a connection. Responses are written into the buffer and transmitted by the
+ * server task, whenever the TCP send buffer has space (see connection_write). An HTTP file transfer
+ * reads the file block by block into this buffer. Cached files are not copied.
+ */
+typedef struct {
+	char buffer[CONNECTION_BUFFER_SIZE] __aligned(32); // Cache line aligned, so the SD card reads directly into it.
+	char filename[255 + 7 + 1]; // used by http. max length is 155 plus these characters: 0:/www/<name>\0
+	FIL file;
+	uint32_t file_remaining; // Bytes of the file (or the requested range) not read yet.
+	char request[CONNECTION_REQUEST_BUFFER_SIZE]; // Received HTTP requests or ADCP frames, see handle_HTTP and handle_TCP
+	uint16_t request_len;
+	HttpTransfer transfer;
+	const uint8_t* cache_data; // The cached file and the bytes already written
+	uint32_t cache_len;
+	uint32_t cache_offset;
+} connection_data_t;
+
 typedef volatile struct connection {
 	struct netconn* conn;
-	osThreadId thread;
-	osMutexId write_mutex;
+	uint16_t id; // To keep track of all prints..
 	volatile ConnectionType type;
+	uint8_t framed; // The ADCP messages of a TCP connection have a length in front, see tcp.c
 	volatile uint8_t send_type;
+	volatile SendPolicy send_policy;
+	volatile uint8_t close_requested; // Set by the send service, if the connection should be closed.
+	struct connection_tx* tx; // The transmit queue of this connection. Managed by send_data.c
+	connection_data_t* data;
+	uint32_t out_offset; // Bytes of the output buffer already written.
+	uint32_t out_len; // Bytes in the output buffer.
+	uint8_t closing; // A handler returned EXIT. The connection is closed, when all output is written.
+	err_t error; // The error, if the connection broke.
+	uint32_t last_activity; // Tick of the last received message. Idle HTTP connections are closed.
 } connection_t;
 
-typedef struct {
-	char buffer[CONNECTION_BUFFER_SIZE];
-	char filename[255 + 7 + 1]; // used by http. max length is 155 plus these characters: 0:/www/<name>\0
-} connection_data_t;
-
 extern Pool* connection_data_pool;
 
 void connections_init();
-void connection_task_function(void const *argument);
+connection_t* connection_open(struct netconn* conn);
+uint8_t connection_process(connection_t* connection);
+uint8_t connection_is_idle_http(connection_t* connection);
+void connection_close(connection_t* connection);
+void connection_write(connection_t* connection, const void* data, uint16_t len);
+uint8_t* connection_write_begin(connection_t* connection, uint16_t* max_len);
+void connection_write_end(connection_t* connection, uint8_t* begin, uint16_t len);
 uint16_t format_connections_stats(uint8_t* data, uint16_t max_length);
+uint16_t format_memory_stats(uint8_t* data, uint16_t max_length);
 
 #ifdef __cplusplus
 }
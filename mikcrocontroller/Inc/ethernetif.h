@@ -57,7 +57,16 @@
 
 /* Within 'USER CODE' section, code will be kept by default at each generation */
 /* USER CODE BEGIN 0 */
+typedef struct {
+	uint32_t tx_zero_copy;	// Frames sent directly from the pbufs
+	uint32_t tx_copied;		// Frames copied into a bounce buffer
+	uint32_t tx_busy;		// Frames not sent, because no descriptor or bounce buffer was free
+	uint32_t rx_zero_copy;	// Frames passed to lwIP in the DMA buffers
+	uint32_t rx_copied;		// Frames copied into pool pbufs, because too few DMA buffers were left
+	uint32_t rx_dropped;	// Frames with errors or no pbuf for the copy
+} ethernetif_stats_t;
 
+extern ethernetif_stats_t ethernetif_stats;
 /* USER CODE END 0 */
 
 /* Exported functions ------------------------------------------------------- */
@@ -66,6 +75,7 @@ err_t ethernetif_init(struct netif *netif);
 void ethernetif_input( void const * argument );
 void ethernetif_update_config(struct netif *netif);
 void ethernetif_notify_conn_changed(struct netif *netif);
+void ethernetif_set_rx_buffers(uint8_t count);
 
 /* USER CODE BEGIN 1 */
 
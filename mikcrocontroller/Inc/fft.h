@@ -45,6 +45,7 @@ typedef struct __packed {
 	uint64_t timestamp;
 	float frequence_resolution;
 	float wss;
+	uint32_t sequence; // Counts the FFTs of this measurement, also the skipped ones. Same for all frames of one FFT.
 } fft_packet_metadata;
 
 typedef volatile struct {
@@ -61,7 +62,7 @@ typedef volatile struct {
 	uint64_t timestamp_first_sample;
 
 	// Both raw buffers holds space for the fft packet headers and the data:
-	// [FFT_HEADER_ALIGNMENT][fft_packet_header (3)][fft_packet_metadata (11)][fft_length * sizeof(FFT_DATATYPE)]
+	// [FFT_HEADER_ALIGNMENT][fft_packet_header (3)][fft_packet_metadata (25)][fft_length * sizeof(FFT_DATATYPE)]
 	uint8_t* raw_buffer_fill;
 	uint8_t* raw_buffer_calc_and_send;
 	float frequence_resolution;
@@ -76,6 +77,8 @@ typedef volatile struct {
 
 	uint8_t frame_count; // number of frames to send.
 	uint8_t frame_number; // the current frame number from 0 to frame_count-1
+	uint32_t sequence; // the sequence number of the FFT in the calc_and_send buffer.
+	uint32_t next_sequence;
 	osThreadId thread;
 } FFT_instance;
 
@@ -13,6 +13,10 @@
 #include "sys/cdefs.h"
 
 #define CRLF		"\r\n"
+#define HTTP_BLOCK_SIZE		32768 // Files are read and written in blocks of this size. A multiple of the sector size.
+#define HTTP_KEEP_ALIVE_TIMEOUT	5 // s. Idle HTTP connections are closed afterwards.
+#define HTTP_FILES_ROUTE	"/files" // Files below HTTP_FILES_ROOT can be downloaded here, e.g. recordings.
+#define HTTP_FILES_ROOT		"0:/data"
 
 #ifdef __cplusplus
  extern "C" {
@@ -26,12 +30,17 @@ typedef struct {
 	char* sec_websocket_key;
 	char* origin;
 	char* sec_websocket_version;
+	char* accept_encoding;
+	char* if_none_match;
+	char* range;
 } request_headers_t;
 
-extern volatile uint8_t http_permitted;
-
 void http_init();
-uint8_t handle_HTTP(connection_t* connection, uint8_t* _data, uint16_t len);
+uint8_t handle_HTTP(connection_t* connection, uint8_t* data, uint16_t len);
+uint8_t http_request_pending(connection_t* connection);
+uint8_t http_handle_pending_request(connection_t* connection);
+uint8_t http_continue_transfer(connection_t* connection);
+void http_close_transfer(connection_t* connection);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,46 @@
+/*
+ * http_cache.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: finn
+ */
+
+#ifndef HTTP_CACHE_H_
+#define HTTP_CACHE_H_
+
+#include "stdint.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HTTP_ROOT				"0:/www"
+#define HTTP_CACHE_SIZE			(2*1024*1024) // SDRAM for the files of the webpage
+#define HTTP_CACHE_MAX_FILES	64
+#define HTTP_CACHE_MAX_DEPTH	4 // Directory levels below HTTP_ROOT, that are loaded
+#define HTTP_CACHE_MAX_AGE		3600 // Seconds, a browser may use a file without asking. Not for html files.
+
+/**
+ * A file of the webpage in the cache. `name` is the path relative to HTTP_ROOT with a leading slash.
+ * If `gzip` is set, the data is the content of `<name>.gz`.
+ */
+typedef struct {
+	const char* name;
+	const uint8_t* data;
+	uint32_t len;
+	uint32_t etag; // Hash of the data
+	uint8_t gzip;
+} http_cache_entry_t;
+
+void http_cache_init();
+uint8_t http_cache_is_complete();
+const http_cache_entry_t* http_cache_find(const char* name, uint8_t accept_gzip);
+uint8_t http_cache_contains(const char* name);
+void http_cache_count_not_modified();
+uint16_t format_http_cache_stats(uint8_t* data, uint16_t max_length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HTTP_CACHE_H_ */
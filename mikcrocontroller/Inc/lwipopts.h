@@ -88,17 +88,18 @@
 #define MEMP_NUM_RAW_PCB		0
 #define PPP_SUPPORT				0
 #define MEMP_NUM_PPP_PCB		0
-#define MEMP_NUM_UDP_PCB		2 // just used by DHCP. 1 should be enough, the second one for some overhead.
+#define MEMP_NUM_UDP_PCB		3 // DHCP and the UDP stream. The third one for some overhead.
 
 #define MEM_SIZE				(2<<12) //8K
 #define MEMP_NUM_TCP_PCB		(MAX_CONNECTIONS+1)
 #define MEMP_NUM_TCP_PCB_LISTEN	1 // Just one listening thread
-#define MEMP_NUM_PBUF			0 // No ROM/REF PBUFs in use
-#define MEMP_NUM_TCP_SEG		32 //(4*MAX_CONNECTIONS)
+#define MEMP_NUM_PBUF			(TCP_SND_QUEUELEN*MAX_CONNECTIONS) // ROM pbufs for the cached HTTP files, that are written without copying (see http.c)
+#define MEMP_NUM_TCP_SEG		(4*MAX_CONNECTIONS)
 
-#define MEMP_NUM_NETBUF			(1*MAX_CONNECTIONS+1)
-#define MEMP_NUM_NETCONN		(1*MAX_CONNECTIONS+1)
+#define MEMP_NUM_NETBUF			(1*MAX_CONNECTIONS+2) // +1 for the UDP stream
+#define MEMP_NUM_NETCONN		(1*MAX_CONNECTIONS+2) // +1 for the UDP stream
 #define PBUF_POOL_SIZE			8 /*16*/ //default: 16
+#define LWIP_SUPPORT_CUSTOM_PBUF	1 // Received frames are passed in the DMA buffers (see ethernetif.c)
 
 #define TCP_MSS					1460 // typical for ethernet
 #define TCP_SND_BUF             (4*TCP_MSS)
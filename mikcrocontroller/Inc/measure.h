@@ -16,8 +16,8 @@
 extern "C" {
 #endif
 
-#define VALUE_BUFFER_SIZE		206 /* 206 for exactly (8+206*7=) 1450 bytes of payload. +3+4 for ADCP and WS
-									   results in max. 1457 bytes to send (MTU is 1460).*/
+#define VALUE_BUFFER_SIZE		205 /* 205 for exactly (8+4+205*7=) 1447 bytes of payload. +3+4 for ADCP and WS
+									   results in max. 1454 bytes to send (MTU is 1460).*/
 
 typedef enum {
 	CALIBRATION_TYPE_OFFSET,
@@ -14,10 +14,10 @@ extern "C" {
 #define NOEXIT				0x00
 
 extern Pool* connection_pool;
-extern osSemaphoreId connection_semaphore;
 
 void network_init();
 void network_start();
+void network_server_wakeup();
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,50 @@
+/*
+ * overload.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: finn
+ */
+
+#ifndef OVERLOAD_H_
+#define OVERLOAD_H_
+
+#include "stdint.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OVERLOAD_HIGH_WATERMARK		50 /* % of the descriptors or a blocking queue. Above, the next level is entered. */
+#define OVERLOAD_LOW_WATERMARK		20 /* % Below this for OVERLOAD_RECOVERY_DELAY, the previous level is entered. */
+#define OVERLOAD_STEP_INTERVAL		100 /* ms. Min. time on one level before the next one is entered. */
+#define OVERLOAD_RECOVERY_DELAY		1000 /* ms */
+#define OVERLOAD_DECIMATION			2 /* Only every n-th sample is sent from OVERLOAD_LEVEL_DECIMATE on. */
+
+typedef enum {
+	OVERLOAD_POLICY_STOP,		// Stop the measurement, if data cannot be queued (the default)
+	OVERLOAD_POLICY_DEGRADE,	// Step through the overload levels and keep measuring
+} OverloadPolicy;
+
+// Every level includes the ones below.
+typedef enum {
+	OVERLOAD_LEVEL_NONE,
+	OVERLOAD_LEVEL_PAUSE_FFT,	// No FFTs are calculated and sent
+	OVERLOAD_LEVEL_DECIMATE,	// Only every OVERLOAD_DECIMATION-th sample is sent
+	OVERLOAD_LEVEL_DROP,		// Every second data packet is dropped
+} OverloadLevel;
+
+void overload_init(uint8_t policy);
+uint8_t overload_set_policy(uint8_t policy);
+uint8_t overload_is_degrading();
+uint8_t overload_get_level();
+void overload_report_failure();
+void overload_process(uint8_t usage);
+uint8_t overload_skip_sample(uint8_t measurement_index);
+uint8_t overload_drop_packet();
+uint16_t format_overload_stats(uint8_t* data, uint16_t max_length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* OVERLOAD_H_ */
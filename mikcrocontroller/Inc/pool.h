@@ -26,30 +26,45 @@
 #define POOL_ERR				0
 
 /**
- * Pool types: Static uses our implementation. You have to provide the memory for it.
- * Dynamic uses FreeRTOS memory implementation, so the memory is provided by the heap.
+ * Pool types: Static uses memory, that you have to provide. Dynamic allocates the memory
+ * for all entries once from the heap, when the pool is initialized.
  */
 enum PoolType {
 	PoolTypeStatic,
 	PoolTypeDynamic,
 };
 
+/**
+ * `free_management` has one pointer per entry: The entry, if it is allocated, else NULL.
+ * The free entries are linked in a list through their own memory, starting with `free_list`.
+ */
 typedef struct {
 	enum PoolType type;
 	uint32_t entrycount;
 	uint32_t entrysize;
 	union {
 		uint8_t* stat;
-		osPoolId dyn;
+		uint8_t* dyn;
 	} pool;
 	void** free_management;
+	void* free_list;
+	volatile uint32_t used;
+	uint32_t allocations;
+	uint32_t failures;
 #ifdef POOL_USAGE_HIGH_WATERMARK
 	uint32_t usage_high_watermark;
 #endif
 } Pool;
 
+typedef struct {
+	uint32_t used;
+	uint32_t high_watermark; // 0, if POOL_USAGE_HIGH_WATERMARK is not defined
+	uint32_t allocations;
+	uint32_t failures; // Allocations on a full pool
+} pool_stats_t;
+
 #define __DEFINE_POOL_MEMORY(name, entrycount, entrytype)\
-	uint8_t __aligned(4) __pool_##name[(entrycount) * sizeof(entrytype)]
+	uint8_t __aligned(__alignof__(entrytype) > 4 ? __alignof__(entrytype) : 4) __pool_##name[(entrycount) * sizeof(entrytype)]
 
 #define __DEFINE_POOL_FREE_MANAGEMENT(name, entrycount)\
 	void* __aligned(4) __pool_free_management_##name[(entrycount)]
@@ -102,10 +117,12 @@ typedef struct {
 
 void pool_init(Pool* pool);
 void* pool_alloc(Pool* pool);
+void* pool_alloc_at(Pool* pool, uint32_t index);
 uint8_t pool_free(Pool* pool, void* block);
 void** pool_get_entries(Pool* pool);
 uint32_t pool_get_free_entries_count(Pool* pool);
 uint32_t pool_get_used_entries_count(Pool* pool);
+void pool_get_stats(Pool* pool, pool_stats_t* stats);
 
 #ifdef POOL_USAGE_HIGH_WATERMARK
 uint32_t pool_get_usage_high_watermark(Pool* pool);
@@ -0,0 +1,41 @@
+/*
+ * recorder.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: finn
+ */
+
+#ifndef RECORDER_H_
+#define RECORDER_H_
+
+#include "stdint.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RECORDER_DIRECTORY			"0:/data" // The recordings can be downloaded from HTTP_FILES_ROUTE.
+#define RECORDER_BLOCK_SIZE			32768 // Bytes written to the SD card at once. A multiple of the sector size.
+#define RECORDER_BLOCK_COUNT		8 // Blocks to buffer, while the SD card is busy.
+#define RECORDER_POLL_INTERVAL		1000 // ms. The recorder task checks the file time at least this often.
+#define RECORDER_DEFAULT_FILE_SIZE	64 // MB. A new file is started, if a file has this size.
+#define RECORDER_DEFAULT_FILE_TIME	0 // s. A new file is started after this time. 0 does not limit the time.
+
+typedef enum {
+	RECORDER_MODE_OFF,
+	RECORDER_MODE_DATA,			// Record the data packets
+	RECORDER_MODE_DATA_AND_FFT,	// Record the data packets and FFT frames
+	RECORDER_MODE_COUNT,
+} RecorderMode;
+
+void recorder_init(uint16_t file_size, uint32_t file_time);
+uint8_t recorder_set_mode(uint8_t mode);
+uint8_t recorder_is_recording();
+void recorder_write(uint8_t send_type, const uint8_t* payload, uint16_t len);
+uint16_t format_recorder_stats(uint8_t* data, uint16_t max_length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RECORDER_H_ */
@@ -0,0 +1,27 @@
+/*
+ * round_robin.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: finn
+ */
+
+#ifndef ROUND_ROBIN_H_
+#define ROUND_ROBIN_H_
+
+#include "stdint.h"
+
+#define ROUND_ROBIN_MAX_CLASSES	4
+
+/**
+ * Deficit round robin over up to ROUND_ROBIN_MAX_CLASSES classes, see round_robin.c.
+ */
+typedef struct {
+	uint32_t deficit[ROUND_ROBIN_MAX_CLASSES]; // Bytes, the class may still write in this round
+	uint8_t turn; // The class, whose turn it is
+} round_robin_t;
+
+void round_robin_reset(round_robin_t* rr);
+uint8_t round_robin_next(round_robin_t* rr, const uint32_t* lengths, const uint8_t* weights, uint8_t count,
+		uint32_t quantum);
+
+#endif /* ROUND_ROBIN_H_ */
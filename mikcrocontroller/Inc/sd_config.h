@@ -23,6 +23,16 @@ typedef struct {
 	ip_addr_t ip_addr;
 	ip_addr_t netmask;
 	ip_addr_t gateway;
+	uint8_t send_deadline; // in ms. 0 disables coalescing of small packets.
+	uint8_t rx_buffers; // Number of ethernet receive descriptors (ETH_RX_MIN_BUFFERS..ETH_RX_MAX_BUFFERS). Spare buffers are added, see ethernetif.c
+	uint8_t overload_policy; // See OverloadPolicy
+	uint8_t weight_data; // Share of the connections for data, FFT and debug messages, see send_data_set_weights
+	uint8_t weight_fft;
+	uint8_t weight_debug;
+	uint32_t rate_http; // kB/s for bulk traffic, 0 is unlimited. See shaper.c
+	uint32_t rate_fft;
+	uint16_t record_file_size; // MB. The recorder starts a new file at this size or time, see recorder.c
+	uint32_t record_file_time; // s, 0 does not limit the time.
 } sd_config_t;
 
 sd_config_t* read_sd_config();
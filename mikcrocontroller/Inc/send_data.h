@@ -11,41 +11,132 @@
 #include "stdint.h"
 #include "network.h"
 #include "connection.h"
+#include "adc_queue.h"
+#include "round_robin.h"
+#include "pool.h"
+#include "lwip/opt.h"
 #include "sys/cdefs.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-#define DEBUG_QUEUE_SIZE				16
-#define STATUS_QUEUE_SIZE				16
-#define DATA_QUEUE_SIZE					64
-#define FFT_QUEUE_SIZE					16
+/* Queued packets per connection and send type. Must be powers of two. */
+#define CONNECTION_TX_QUEUE_SIZE_DEBUG	16
+#define CONNECTION_TX_QUEUE_SIZE_STATUS	16
+#define CONNECTION_TX_QUEUE_SIZE_DATA	64
+#define CONNECTION_TX_QUEUE_SIZE_FFT	8
+#define CONNECTION_TX_QUEUE_SLOTS		(CONNECTION_TX_QUEUE_SIZE_DEBUG + CONNECTION_TX_QUEUE_SIZE_STATUS + \
+											CONNECTION_TX_QUEUE_SIZE_DATA + CONNECTION_TX_QUEUE_SIZE_FFT)
+#define UDP_TX_QUEUE_SIZE				64 /* Queued packets of the UDP stream. Must be a power of two. */
 
-#define DATA_DESCRIPTOR_POOL_SIZE		(DEBUG_QUEUE_SIZE + STATUS_QUEUE_SIZE + DATA_QUEUE_SIZE + FFT_QUEUE_SIZE)
-#define DATA_DESCRIPTOR_BUFFER_SIZE		(3*1460) /* =4380. This is three times the MTU and about 4.2K. This allows
+/* Status messages are always written first. Data, FFT and debug messages share the connection by
+ * weight: Per round a send type may write weight*TX_WEIGHT_QUANTUM bytes (see send_data_set_weights). */
+#define TX_WEIGHT_QUANTUM				TCP_MSS
+#define TX_WEIGHT_MAX					16
+#define TX_DEFAULT_WEIGHT_DATA			4
+#define TX_DEFAULT_WEIGHT_FFT			1
+#define TX_DEFAULT_WEIGHT_DEBUG			1
+
+#define DATA_DESCRIPTOR_POOL_SIZE		128 /* Descriptor headers, shared by all connections */
+#define RELEASE_QUEUE_SIZE				128 /* Power of two, that holds all data descriptors */
+#define SEND_DATA_BATCH_SIZE			8 /* Descriptors taken at once from the UDP and release queues */
+#define COALESCE_BUFFER_SIZE			TCP_SND_BUF /* Small messages are packed into one write up to this size */
+#define COALESCE_DEFAULT_DEADLINE		2 /* ms. Max. time a message may wait in the coalesce buffer */
+
+/* Copied data is put into a buffer of the smallest size class, that fits. If the class is exhausted,
+ * the next bigger one is used. All sizes include DATA_DESCRIPTOR_BUFFER_RESERVED. */
+#define DATA_BUFFER_SMALL_SIZE			256 /* Status and debug messages */
+#define DATA_BUFFER_SMALL_COUNT			32
+#define DATA_BUFFER_MTU_SIZE			1460 /* One measurement data packet, see VALUE_BUFFER_SIZE */
+#define DATA_BUFFER_MTU_COUNT			112
+#define DATA_BUFFER_LARGE_SIZE			(3*1460) /* =4380. This is three times the MTU and about 4.2K. This allows
 													to send 4K of raw data incl. some header information. */
+#define DATA_BUFFER_LARGE_COUNT			16
 #define DATA_DESCRIPTOR_BUFFER_RESERVED	7 /* 3 for ADCP, 4 for WS */
-#define DATA_DESCRIPTOR_USER_SPACE		(DATA_DESCRIPTOR_BUFFER_SIZE - DATA_DESCRIPTOR_BUFFER_RESERVED)
+#define DATA_DESCRIPTOR_USER_SPACE		(DATA_BUFFER_LARGE_SIZE - DATA_DESCRIPTOR_BUFFER_RESERVED)
 
-typedef struct __packed {
+/**
+ * The header of a queued packet. The payload is either copied into `buffer`, which belongs to
+ * `buffer_pool`, or it is external data with a callback (see send_data_non_copy). The headers
+ * are kept apart from the payload in the DTCM, so scanning them does not touch the SDRAM.
+ */
+typedef struct {
 	uint8_t type;
-	uint8_t data[DATA_DESCRIPTOR_BUFFER_SIZE];
+	volatile uint8_t references; // Amount of connection queues holding this descriptor.
 	uint16_t adcp_len;
 	uint16_t ws_len;
 	uint8_t* adcp_dataptr;
 	uint8_t* ws_dataptr;
-	uint8_t connections[MAX_CONNECTIONS];
+	uint8_t* buffer;
+	Pool* buffer_pool;
+	uint32_t udp_sequence; // Sequence number in the UDP stream, if it is streamed.
+	uint32_t queued_at; // Tick, when the descriptor was queued. For the queueing latency.
 	void (*callback)(void*);
 	void* cb_argument;
 } DataDescriptor;
 
-void send_data_init();
+/**
+ * The transmit state of one connection. There is one queue per send type, that holds references to data
+ * descriptors. The server task takes the head of every queue into `pending`, where it waits for its turn
+ * (see `round_robin` and send_data_set_weights) or the credit.
+ * `current` is the descriptor, which is currently written. If `offset` is not zero, the message is
+ * partially written and the connection must not write anything else.
+ * Small messages are copied into the coalesce buffer and written together. `coalesced` bytes are in
+ * the buffer, `coalesce_offset` of them are already written. `coalesce_start` is the tick of the first
+ * message in the buffer.
+ * For send types in `credit_types` a message is only written, if the client granted enough credit
+ * (see send_data_grant_credit).
+ */
+typedef struct connection_tx {
+	Queue queues[SEND_TYPE_COUNT]; // Indexed by the bit of the send type
+	QueueSlot queue_slots[CONNECTION_TX_QUEUE_SLOTS];
+	DataDescriptor* pending[SEND_TYPE_COUNT];
+	round_robin_t round_robin; // The turns of the weighted send types
+	volatile uint8_t drop_pending; // The pending descriptors have to be dropped, see connection_tx_drop
+	uint8_t drop_pending_cause;
+	DataDescriptor* current;
+	uint32_t offset;
+	uint32_t dropped;
+	uint8_t* coalesce_buffer;
+	uint32_t coalesced;
+	uint32_t coalesce_offset;
+	uint32_t coalesce_start;
+	uint8_t credit_types; // Send types with flow control. Other types are not limited.
+	uint32_t credit[SEND_TYPE_COUNT]; // Bytes, that may be sent per send type
+} connection_tx_t;
+
+// Causes for lost packets. Packets dropped from connection queues are counted per connection.
+typedef enum {
+	DROP_CAUSE_POOL_EXHAUSTED,	// No free data descriptor
+	DROP_CAUSE_QUEUE_FULL,		// The queue of a blocking connection was full
+	DROP_CAUSE_DROP_OLDEST,		// Dropped from the queue of a connection with SEND_POLICY_DROP_OLDEST or the UDP stream
+	DROP_CAUSE_CLOSED,			// Queued for a connection, that was closed (broken or too slow)
+	DROP_CAUSE_FLUSH,			// Dropped, when the queues were flushed
+	DROP_CAUSE_FFT_BUSY,		// An FFT was skipped, because the last one was not transmitted yet
+	DROP_CAUSE_OVERLOAD,		// An FFT or data packet was skipped by the overload handling, see overload.c
+	DROP_CAUSE_COUNT,
+} DropCause;
+
+extern Pool* data_descriptor_pool;
+
+void send_data_init(uint8_t coalesce_deadline);
+void send_data_connection_open(connection_t* connection);
+void send_data_connection_close(connection_t* connection);
+uint8_t send_data_is_writing(connection_t* connection);
+uint8_t send_data_transmit(connection_t* connection);
+uint8_t send_data_grant_credit(connection_t* connection, uint8_t send_type, uint32_t credit, uint32_t* available);
+uint8_t send_data_set_weights(uint8_t data, uint8_t fft, uint8_t debug);
+uint32_t send_data_get_queued(connection_t* connection);
+uint8_t send_data_process();
 
 void send_debug_data(char* buffer, uint16_t len);
 uint8_t send_data(uint8_t send_type, uint8_t* data, uint16_t len);
 uint8_t send_data_non_copy(uint8_t send_type, uint8_t* data, uint32_t len, void (*callback)(void*), void* cb_argument);
 void send_queue_flush_and_update_status();
+void send_data_count_drop(DropCause cause);
+uint16_t format_drop_stats(uint8_t* data, uint16_t max_length);
+uint16_t format_tx_stats(uint8_t* data, uint16_t max_length);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,39 @@
+/*
+ * shaper.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: finn
+ */
+
+#ifndef SHAPER_H_
+#define SHAPER_H_
+
+#include "stdint.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SHAPER_INTERVAL				10 /* ms. The buckets are refilled by a timer with this period. */
+#define SHAPER_BURST				50 /* ms. A bucket holds at most the tokens of this time. */
+#define SHAPER_DEFAULT_RATE_HTTP	2048 /* kB/s */
+#define SHAPER_DEFAULT_RATE_FFT		0 /* kB/s. 0 does not limit the class. */
+
+// Bulk traffic, that is limited to a rate.
+typedef enum {
+	SHAPER_CLASS_HTTP,	// Files of the webpage, see http.c
+	SHAPER_CLASS_FFT,	// FFT messages to the connections, see send_data.c
+	SHAPER_CLASS_COUNT,
+} ShaperClass;
+
+void shaper_init();
+uint8_t shaper_set_rate(uint8_t shaper_class, uint32_t rate);
+uint8_t shaper_permits(uint8_t shaper_class);
+void shaper_consume(uint8_t shaper_class, uint32_t bytes);
+uint16_t format_shaper_stats(uint8_t* data, uint16_t max_length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SHAPER_H_ */
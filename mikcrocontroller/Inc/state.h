@@ -10,12 +10,21 @@
 
 #include "sys/cdefs.h"
 #include "config.h"
+#include "adcp.h"
 
 #ifdef __cplusplus
  extern "C" {
 #endif
 
-#define STATE_FILENAME	"0:/state"
+#define STATE_FILENAME			"0:/state"
+#define STATE_TMP_FILENAME		"0:/state.tmp" // The new state is written here and renamed afterwards.
+#define STATE_BROADCAST_DELAY	20 // ms. Changes within this time are sent in one state message.
+#define STATE_SAVE_DELAY		1000 // ms. The state is saved, when it did not change for this time,
+#define STATE_SAVE_MAX_DELAY	5000 // ms. but at most this time after the first unsaved change.
+#define STATE_SIGNAL_CHANGED	0x01
+#define STATE_MESSAGE_HEADER_SIZE	5 // kind (u8), version (u32)
+#define STATE_MESSAGE_MAX_SIZE	(STATE_MESSAGE_HEADER_SIZE + sizeof(complete_state_t) + 3 + MAX_MEASUREMENTS)
+#define STATE_ASSIGN_ID			0xFF // A measurement with this id in an applied configuration gets a free id.
 
 typedef struct __packed {
 	uint8_t id;
@@ -33,6 +42,8 @@ typedef struct __packed {
 		uint8_t internal_reference:1;
 		uint8_t slow_connection:1;
 		uint8_t ADC_reset:1;
+		uint8_t overload:2; // See OverloadLevel
+		uint8_t recording:1; // See recorder.c
 	} flags;
 	uint8_t sr_filter;
 	uint8_t pga;
@@ -43,6 +54,12 @@ typedef struct __packed {
 	uint8_t measurement_count;
 } adc_state_t;
 
+// The kinds of state messages, see send_state_to_clients in state.c
+typedef enum {
+	STATE_MESSAGE_FULL,
+	STATE_MESSAGE_DELTA,
+} StateMessageKind;
+
 typedef struct __packed {
 	adc_state_t adc;
 	measurement_state_t mesurements[MAX_MEASUREMENTS];
@@ -56,9 +73,14 @@ void update_measurement_state(uint8_t send_and_save_state);
 uint16_t state_copy_to_buffer(uint8_t* data, uint16_t max_len);
 void init_system_from_last_state();
 void state_reset_adc();
+protocol_error_t state_apply_configuration(uint8_t* data, uint16_t length, uint8_t* ids, uint8_t* count);
 
 void set_slow_connection_flag();
 void clear_slow_connection_flag();
+void set_overload_level_flag(uint8_t level);
+void set_recording_flag(uint8_t recording);
+void send_state();
+void send_full_state();
 void set_ADC_reset_flag();
 void clear_ADC_reset_flag();
 uint8_t is_ADC_reset_flag_set();
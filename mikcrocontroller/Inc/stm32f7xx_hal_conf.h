@@ -179,8 +179,11 @@
 /* Definition of the Ethernet driver buffers size and count */   
 #define ETH_RX_BUF_SIZE                ETH_MAX_PACKET_SIZE /* buffer size for receive               */
 #define ETH_TX_BUF_SIZE                ETH_MAX_PACKET_SIZE /* buffer size for transmit              */
-#define ETH_RXBUFNB                    ((uint32_t)4U)       /* 4 Rx buffers of size ETH_RX_BUF_SIZE  */
-#define ETH_TXBUFNB                    ((uint32_t)4U)       /* 4 Tx buffers of size ETH_TX_BUF_SIZE  */
+#define ETH_RXBUFNB                    ((uint32_t)12U)      /* Default for 12 Rx buffers of size ETH_RX_BUF_SIZE. Can be changed in the config. */
+#define ETH_RX_MIN_BUFFERS             ((uint32_t)4U)
+#define ETH_RX_MAX_BUFFERS             ((uint32_t)32U)
+#define ETH_TXBUFNB                    ((uint32_t)12U)      /* 12 Tx descriptors. They point to the pbufs (zero-copy) */
+#define ETH_TX_BOUNCE_BUFFERS          ((uint32_t)4U)       /* 4 Tx buffers of size ETH_TX_BUF_SIZE for frames, that cannot be sent zero-copy */
 
 /* Section 2: PHY configuration section */
 
@@ -11,6 +11,13 @@
 #include "stdint.h"
 #include "connection.h"
 
+#define TCP_FRAME_HEADER_SIZE		2 // The length of the ADCP message (u16) in front of every frame.
+// Longer messages are rejected. So a partial frame and a received segment fit into the request buffer.
+#define TCP_MAX_FRAME_LENGTH		512
+#define TCP_MIN_RESPONSE_SPACE		4096 // Frames are handled, if the output buffer has this space left.
+
 uint8_t handle_TCP(connection_t* connection, uint8_t* data, uint16_t len);
+uint8_t tcp_frame_pending(connection_t* connection);
+uint8_t tcp_handle_pending_frames(connection_t* connection);
 
 #endif /* TCP_H_ */
@@ -0,0 +1,32 @@
+/*
+ * udp_stream.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: finn
+ */
+
+#ifndef UDP_STREAM_H_
+#define UDP_STREAM_H_
+
+#include "stdint.h"
+#include "lwip/ip_addr.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define UDP_STREAM_SEQUENCE_SIZE	4
+#define UDP_STREAM_MAX_PACKET_SIZE	(3*1460) // Bigger ADCP packets (large FFT frames) are not streamed.
+
+uint8_t udp_stream_configure(ip_addr_t* destination, uint16_t port, uint8_t send_type);
+uint8_t udp_stream_get_send_type();
+uint32_t udp_stream_next_sequence();
+uint8_t udp_stream_send(uint8_t* packet, uint16_t len, uint32_t sequence);
+void udp_stream_count_drop();
+uint16_t format_udp_stream_stats(uint8_t* data, uint16_t max_length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UDP_STREAM_H_ */
@@ -40,18 +40,45 @@
 #if !NO_SYS
 
 #include "cmsis_os.h"
+#include "queue.h"
 
 #if defined(LWIP_SOCKET_SET_ERRNO) && defined(LWIP_PROVIDE_ERRNO)
 int errno;
 #endif
 
+/*
+  Every netconn needs a mailbox and a semaphore. Instead of deleting them, when a
+  connection is closed, they are kept in a cache and reused for the next connection.
+  The cache is filled in sys_init, so accepting and closing connections does not
+  allocate from the FreeRTOS heap anymore.
+*/
+#define SYS_ARCH_CACHE_SIZE   MEMP_NUM_NETCONN
+
+static struct {
+  sys_mbox_t mbox;
+  int size;
+} mbox_cache[SYS_ARCH_CACHE_SIZE];
+static int mbox_cache_count = 0;
+static sys_sem_t sem_cache[SYS_ARCH_CACHE_SIZE];
+static int sem_cache_count = 0;
+static sys_arch_cache_stats_t cache_stats;
+
+static sys_mbox_t mbox_cache_take(int size);
+static u8_t mbox_cache_put(sys_mbox_t mbox, int size);
+static sys_sem_t sem_cache_take(void);
+static u8_t sem_cache_put(sys_sem_t sem);
+
 /*-----------------------------------------------------------------------------------*/
 //  Creates an empty mailbox.
 err_t sys_mbox_new(sys_mbox_t *mbox, int size)
 {
   osMessageQDef(QUEUE, size, void *);
   
-  *mbox = osMessageCreate(osMessageQ(QUEUE), NULL);
+  *mbox = mbox_cache_take(size);
+  if (*mbox == NULL) {
+    *mbox = osMessageCreate(osMessageQ(QUEUE), NULL);
+    cache_stats.created++;
+  }
 
 #if SYS_STATS
       ++lwip_stats.sys.mbox.used;
@@ -84,7 +111,10 @@ void sys_mbox_free(sys_mbox_t *mbox)
 		// TODO notify the user of failure.
 	}
 
-	osMessageDelete(*mbox);
+	if (!mbox_cache_put(*mbox, (int)uxQueueMessagesWaiting(*mbox) + (int)uxQueueSpacesAvailable(*mbox))) {
+		osMessageDelete(*mbox);
+		cache_stats.deleted++;
+	}
 
 #if SYS_STATS
      --lwip_stats.sys.mbox.used;
@@ -207,7 +237,23 @@ err_t sys_sem_new(sys_sem_t *sem, u8_t count)
 {
   osSemaphoreDef(SEM);
 
+  // Cached semaphores are taken. Give it, if it should be available.
+  *sem = sem_cache_take();
+  if (*sem != NULL) {
+    if (count != 0) {
+      osSemaphoreRelease(*sem);
+    }
+#if SYS_STATS
+    ++lwip_stats.sys.sem.used;
+    if (lwip_stats.sys.sem.max < lwip_stats.sys.sem.used) {
+      lwip_stats.sys.sem.max = lwip_stats.sys.sem.used;
+    }
+#endif /* SYS_STATS */
+    return ERR_OK;
+  }
+
   *sem = osSemaphoreCreate (osSemaphore(SEM), 1);
+  cache_stats.created++;
 	
   if(*sem == NULL)
   {
@@ -285,7 +331,10 @@ void sys_sem_free(sys_sem_t *sem)
   --lwip_stats.sys.sem.used;
 #endif /* SYS_STATS */
   
-  osSemaphoreDelete(*sem);
+  if (!sem_cache_put(*sem)) {
+    osSemaphoreDelete(*sem);
+    cache_stats.deleted++;
+  }
 }
 /*-----------------------------------------------------------------------------------*/
 int sys_sem_valid(sys_sem_t *sem)                                               
@@ -309,6 +358,93 @@ osMutexDef(lwip_sys_mutex);
 void sys_init(void)
 {
   lwip_sys_mutex = osMutexCreate(osMutex(lwip_sys_mutex));
+
+  // Pre-create the mailboxes and semaphores for all netconns.
+  for (int i = 0; i < SYS_ARCH_CACHE_SIZE; i++) {
+    osMessageQDef(QUEUE, DEFAULT_TCP_RECVMBOX_SIZE, void *);
+    osSemaphoreDef(SEM);
+    sys_mbox_t mbox = osMessageCreate(osMessageQ(QUEUE), NULL);
+    sys_sem_t sem = osSemaphoreCreate(osSemaphore(SEM), 1);
+    if (mbox == NULL || sem == NULL) {
+      break; // Will be created on demand.
+    }
+    osSemaphoreWait(sem, 0);
+    mbox_cache_put(mbox, DEFAULT_TCP_RECVMBOX_SIZE);
+    sem_cache_put(sem);
+    cache_stats.created += 2;
+  }
+}
+
+/*-----------------------------------------------------------------------------------*/
+// Takes a cached mailbox of the given size. Returns NULL, if there is none.
+static sys_mbox_t mbox_cache_take(int size)
+{
+  sys_mbox_t mbox = NULL;
+  SYS_ARCH_DECL_PROTECT(old_level);
+  SYS_ARCH_PROTECT(old_level);
+  for (int i = 0; i < mbox_cache_count; i++) {
+    if (mbox_cache[i].size == size) {
+      mbox = mbox_cache[i].mbox;
+      mbox_cache[i] = mbox_cache[--mbox_cache_count];
+      cache_stats.reused++;
+      break;
+    }
+  }
+  SYS_ARCH_UNPROTECT(old_level);
+  return mbox;
+}
+
+// Empties the mailbox and puts it into the cache. Returns 0, if the cache is full.
+static u8_t mbox_cache_put(sys_mbox_t mbox, int size)
+{
+  u8_t ret = 0;
+  SYS_ARCH_DECL_PROTECT(old_level);
+  SYS_ARCH_PROTECT(old_level);
+  if (mbox_cache_count < SYS_ARCH_CACHE_SIZE) {
+    xQueueReset(mbox);
+    mbox_cache[mbox_cache_count].mbox = mbox;
+    mbox_cache[mbox_cache_count].size = size;
+    mbox_cache_count++;
+    ret = 1;
+  }
+  SYS_ARCH_UNPROTECT(old_level);
+  return ret;
+}
+
+// Takes a cached semaphore. It is taken. Returns NULL, if there is none.
+static sys_sem_t sem_cache_take(void)
+{
+  sys_sem_t sem = NULL;
+  SYS_ARCH_DECL_PROTECT(old_level);
+  SYS_ARCH_PROTECT(old_level);
+  if (sem_cache_count > 0) {
+    sem = sem_cache[--sem_cache_count];
+    cache_stats.reused++;
+  }
+  SYS_ARCH_UNPROTECT(old_level);
+  return sem;
+}
+
+// Takes the semaphore and puts it into the cache. Returns 0, if the cache is full.
+static u8_t sem_cache_put(sys_sem_t sem)
+{
+  u8_t ret = 0;
+  SYS_ARCH_DECL_PROTECT(old_level);
+  SYS_ARCH_PROTECT(old_level);
+  if (sem_cache_count < SYS_ARCH_CACHE_SIZE) {
+    xQueueReset(sem); // A binary semaphore is a queue of length one. Empty means taken.
+    sem_cache[sem_cache_count++] = sem;
+    ret = 1;
+  }
+  SYS_ARCH_UNPROTECT(old_level);
+  return ret;
+}
+
+// Returns the statistics of the mailbox and semaphore cache.
+void sys_arch_get_cache_stats(sys_arch_cache_stats_t* stats)
+{
+  *stats = cache_stats;
+  stats->cached = mbox_cache_count + sem_cache_count;
 }
 /*-----------------------------------------------------------------------------------*/
                                       /* Mutexes*/
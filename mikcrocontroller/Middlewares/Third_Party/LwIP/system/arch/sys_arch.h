@@ -43,6 +43,16 @@ typedef osSemaphoreId sys_mutex_t;
 typedef osMessageQId  sys_mbox_t;
 typedef osThreadId    sys_thread_t;
 
+// Mailboxes and semaphores are cached for reuse, see sys_arch.c
+typedef struct {
+	unsigned long created;	// Allocated from the heap
+	unsigned long reused;	// Taken from the cache
+	unsigned long deleted;	// Freed, because the cache was full
+	unsigned long cached;	// Currently in the cache
+} sys_arch_cache_stats_t;
+
+void sys_arch_get_cache_stats(sys_arch_cache_stats_t* stats);
+
 typedef struct _sys_arch_state_t
 {
 	// Task creation data.
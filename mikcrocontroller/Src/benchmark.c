@@ -0,0 +1,556 @@
+/*
+ * benchmark.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: finn
+ */
+
+#include "benchmark.h"
+#include "stm32f7xx_hal.h"
+#include "cmsis_os.h"
+#include "measure.h"
+#include "pool.h"
+#include "fatfs.h"
+#include "string.h"
+
+#define CYCLES()	(DWT->CYCCNT)
+
+static uint8_t __aligned(BENCHMARK_CACHE_LINE_SIZE) dtcm_buffer[BENCHMARK_MEMORY_BUFFER_SIZE];
+static uint8_t __aligned(BENCHMARK_MEMORY_BUFFER_SIZE) sram1_buffer[BENCHMARK_MEMORY_BUFFER_SIZE] __section(".sram1");
+static uint8_t __aligned(BENCHMARK_MEMORY_BUFFER_SIZE) sdram_buffer[BENCHMARK_MEMORY_BUFFER_SIZE] __section(".extsram");
+
+static uint8_t __aligned(BENCHMARK_CACHE_LINE_SIZE) sd_buffer[BENCHMARK_SD_MAX_CHUNK + BENCHMARK_CACHE_LINE_SIZE] __section(".extsram");
+static FIL sd_file;
+
+// The working set sizes. The smaller one fits into the data cache (4K), copying the bigger one does not.
+static const uint16_t memory_sizes[] = {1024, 4096};
+#define MEMORY_SIZES_COUNT	(sizeof(memory_sizes)/sizeof(memory_sizes[0]))
+
+// The chunk sizes of the SD benchmark: One sector, a cluster of many cards and the recorder block.
+static const uint32_t sd_chunk_sizes[] = {512, 4096, BENCHMARK_SD_MAX_CHUNK};
+#define SD_CHUNK_SIZES_COUNT	(sizeof(sd_chunk_sizes)/sizeof(sd_chunk_sizes[0]))
+
+// The pool test allocates from a pool of its own, so the data path is not disturbed.
+typedef struct {
+	uint32_t data[16];
+} benchmark_pool_entry_t;
+DEFINE_POOL(benchmark_pool, BENCHMARK_POOL_SIZE, benchmark_pool_entry_t);
+
+// Keeps the compiler from optimizing the read loops away.
+static volatile uint32_t sink;
+
+// Shared between the benchmarking task, the helper task and the interrupt.
+static osThreadId benchmark_thread;
+static osThreadId isr_helper;
+static osMessageQId ping_queue;
+static osMessageQId pong_queue;
+static volatile uint32_t helper_timestamp;
+static volatile uint32_t isr_timestamp;
+
+static void enable_cycle_counter();
+static void set_cacheable(uint8_t* buffer, uint8_t cacheable);
+static void restore_cacheability(uint8_t* buffer);
+static void benchmark_memory_region(uint8_t* buffer, uint16_t size, benchmark_memory_result_t* result);
+static void init_pointer_chase(uint8_t* buffer, uint16_t size);
+static uint8_t benchmark_sd_file(uint8_t* buffer, uint32_t chunk, benchmark_sd_result_t* result);
+static void fill_sd_pattern(uint8_t* buffer, uint32_t chunk);
+static void histogram_init(benchmark_histogram_t* histogram, BenchmarkTest test);
+static void histogram_add(benchmark_histogram_t* histogram, uint32_t cycles, uint64_t* sum);
+static void yield_helper_function(void const* argument);
+static void signal_helper_function(void const* argument);
+static void queue_helper_function(void const* argument);
+static void isr_helper_function(void const* argument);
+
+osThreadDef(benchmark_yield_helper, yield_helper_function, osPriorityAboveNormal, 1, 256);
+osThreadDef(benchmark_signal_helper, signal_helper_function, osPriorityHigh, 1, 256);
+osThreadDef(benchmark_queue_helper, queue_helper_function, osPriorityHigh, 1, 256);
+osThreadDef(benchmark_isr_helper, isr_helper_function, osPriorityHigh, 1, 256);
+osMessageQDef(benchmark_ping, 1, uint32_t);
+osMessageQDef(benchmark_pong, 1, uint32_t);
+
+/**
+ * Measures copy, read and write throughput and the load latency of DTCM, SRAM1 and SDRAM
+ * with and without the data cache. DTCM is never cached. SRAM2 is not tested, because it
+ * holds the interrupt stack. Each operation runs in a critical section, so the measurements
+ * must be stopped.
+ * Response: [core clock (u32)][count (u8)][count benchmark_memory_result_t]
+ */
+protocol_error_t benchmark_memory(uint8_t* out_data, uint16_t* out_len, uint16_t max_len) {
+	uint8_t count = MEMORY_SIZES_COUNT * 5;
+	if (is_measure_active()) {
+		return RESPONSE_MEASUREMENT_ACTIVE;
+	}
+	if (max_len < 5 + count * sizeof(benchmark_memory_result_t)) {
+		return RESPONSE_NO_MEMORY;
+	}
+	enable_cycle_counter();
+
+	*(uint32_t*)out_data = SystemCoreClock;
+	out_data[4] = count;
+	benchmark_memory_result_t* result = (benchmark_memory_result_t*)(out_data + 5);
+
+	for (uint8_t i = 0; i < MEMORY_SIZES_COUNT; i++) {
+		result->region = BENCHMARK_REGION_DTCM;
+		result->cached = 0;
+		benchmark_memory_region(dtcm_buffer, memory_sizes[i], result++);
+
+		for (uint8_t cached = 0; cached <= 1; cached++) {
+			result->region = BENCHMARK_REGION_SRAM1;
+			result->cached = cached;
+			set_cacheable(sram1_buffer, cached);
+			benchmark_memory_region(sram1_buffer, memory_sizes[i], result++);
+			restore_cacheability(sram1_buffer);
+
+			result->region = BENCHMARK_REGION_SDRAM;
+			result->cached = cached;
+			set_cacheable(sdram_buffer, cached);
+			benchmark_memory_region(sdram_buffer, memory_sizes[i], result++);
+			restore_cacheability(sdram_buffer);
+		}
+	}
+
+	*out_len = 5 + count * sizeof(benchmark_memory_result_t);
+	return RESPONSE_OK;
+}
+
+/**
+ * Measures the throughput of the SD card with f_write and f_read in chunks of all sizes of
+ * sd_chunk_sizes. Every size runs with a cache line aligned buffer, which the driver transfers
+ * directly with multi block DMA, and with an unaligned one, which is copied through the scratch
+ * buffer. The data read back is compared to the data written, to check the cache maintenance.
+ * The file is preallocated, so the FAT is not updated during the test.
+ * Response: [core clock (u32)][count (u8)][count benchmark_sd_result_t]
+ */
+protocol_error_t benchmark_sd(uint8_t* out_data, uint16_t* out_len, uint16_t max_len) {
+	uint8_t count = SD_CHUNK_SIZES_COUNT * 4;
+	if (is_measure_active()) {
+		return RESPONSE_MEASUREMENT_ACTIVE;
+	}
+	if (max_len < 5 + count * sizeof(benchmark_sd_result_t)) {
+		return RESPONSE_NO_MEMORY;
+	}
+	enable_cycle_counter();
+
+	if (f_open(&sd_file, BENCHMARK_SD_FILE, FA_CREATE_ALWAYS | FA_READ | FA_WRITE) != FR_OK) {
+		return RESPONSE_SOMETHING_IS_NOT_GOOD;
+	}
+	if (f_expand(&sd_file, BENCHMARK_SD_FILE_SIZE, 1) != FR_OK) {
+		f_close(&sd_file);
+		f_unlink(BENCHMARK_SD_FILE);
+		return RESPONSE_SOMETHING_IS_NOT_GOOD;
+	}
+
+	*(uint32_t*)out_data = SystemCoreClock;
+	out_data[4] = count;
+	benchmark_sd_result_t* result = (benchmark_sd_result_t*)(out_data + 5);
+	uint8_t ok = 1;
+
+	for (uint8_t i = 0; ok && i < SD_CHUNK_SIZES_COUNT; i++) {
+		for (uint8_t j = 0; ok && j < 2; j++) {
+			uint8_t aligned = j == 0;
+			// 4 bytes off keeps the word alignment, that the DMA needs, but not the cache line alignment.
+			uint8_t* buffer = aligned ? sd_buffer : sd_buffer + 4;
+			result[0].aligned = result[1].aligned = aligned;
+			ok = benchmark_sd_file(buffer, sd_chunk_sizes[i], result);
+			result += 2;
+		}
+	}
+
+	f_close(&sd_file);
+	f_unlink(BENCHMARK_SD_FILE);
+	if (!ok) {
+		return RESPONSE_SOMETHING_IS_NOT_GOOD;
+	}
+	*out_len = 5 + count * sizeof(benchmark_sd_result_t);
+	return RESPONSE_OK;
+}
+
+/**
+ * Measures task switches, signal and message queue round trips, the interrupt entry and
+ * wakeup latency and the pool allocator. The calling task runs with a raised priority for the time of the benchmark.
+ * Response: [core clock (u32)][count (u8)][count benchmark_histogram_t]
+ */
+protocol_error_t benchmark_scheduler(uint8_t* out_data, uint16_t* out_len, uint16_t max_len) {
+	if (is_measure_active()) {
+		return RESPONSE_MEASUREMENT_ACTIVE;
+	}
+	if (max_len < 5 + BENCHMARK_TEST_COUNT * sizeof(benchmark_histogram_t)) {
+		return RESPONSE_NO_MEMORY;
+	}
+	enable_cycle_counter();
+
+	*(uint32_t*)out_data = SystemCoreClock;
+	out_data[4] = BENCHMARK_TEST_COUNT;
+	benchmark_histogram_t* histograms = (benchmark_histogram_t*)(out_data + 5);
+	for (uint8_t i = 0; i < BENCHMARK_TEST_COUNT; i++) {
+		histogram_init(histograms + i, i);
+	}
+	uint64_t sums[BENCHMARK_TEST_COUNT] = {0};
+
+	benchmark_thread = osThreadGetId();
+	osPriority old_priority = osThreadGetPriority(benchmark_thread);
+	osThreadSetPriority(benchmark_thread, osPriorityAboveNormal);
+	protocol_error_t err = RESPONSE_NO_MEMORY;
+
+	// Task switch: The helper has the same priority, takes a timestamp and yields back.
+	osThreadId helper = osThreadCreate(osThread(benchmark_yield_helper), NULL);
+	if (NULL == helper) {
+		goto exit;
+	}
+	for (uint16_t i = 0; i < BENCHMARK_SCHEDULER_SAMPLES; i++) {
+		taskYIELD();
+		histogram_add(histograms + BENCHMARK_TEST_TASK_SWITCH, CYCLES() - helper_timestamp, sums + BENCHMARK_TEST_TASK_SWITCH);
+	}
+	osThreadTerminate(helper);
+
+	// Signal round trip
+	helper = osThreadCreate(osThread(benchmark_signal_helper), NULL);
+	if (NULL == helper) {
+		goto exit;
+	}
+	for (uint16_t i = 0; i < BENCHMARK_SCHEDULER_SAMPLES; i++) {
+		uint32_t start = CYCLES();
+		osSignalSet(helper, 0x01);
+		osSignalWait(0x01, osWaitForever);
+		histogram_add(histograms + BENCHMARK_TEST_SIGNAL, CYCLES() - start, sums + BENCHMARK_TEST_SIGNAL);
+	}
+	osThreadTerminate(helper);
+
+	// Message queue round trip
+	ping_queue = osMessageCreate(osMessageQ(benchmark_ping), NULL);
+	pong_queue = osMessageCreate(osMessageQ(benchmark_pong), NULL);
+	helper = NULL;
+	if (NULL != ping_queue && NULL != pong_queue) {
+		helper = osThreadCreate(osThread(benchmark_queue_helper), NULL);
+	}
+	if (NULL != helper) {
+		for (uint16_t i = 0; i < BENCHMARK_SCHEDULER_SAMPLES; i++) {
+			uint32_t start = CYCLES();
+			osMessagePut(ping_queue, i, osWaitForever);
+			osMessageGet(pong_queue, osWaitForever);
+			histogram_add(histograms + BENCHMARK_TEST_QUEUE, CYCLES() - start, sums + BENCHMARK_TEST_QUEUE);
+		}
+		osThreadTerminate(helper);
+	}
+	if (NULL != ping_queue) {
+		osMessageDelete(ping_queue);
+	}
+	if (NULL != pong_queue) {
+		osMessageDelete(pong_queue);
+	}
+	if (NULL == helper) {
+		goto exit;
+	}
+
+	// Interrupt: The handler signals the helper, which preempts this task before NVIC_SetPendingIRQ returns.
+	isr_helper = osThreadCreate(osThread(benchmark_isr_helper), NULL);
+	if (NULL == isr_helper) {
+		goto exit;
+	}
+	HAL_NVIC_SetPriority(BENCHMARK_IRQn, BENCHMARK_IRQ_PRIORITY, 0);
+	HAL_NVIC_EnableIRQ(BENCHMARK_IRQn);
+	for (uint16_t i = 0; i < BENCHMARK_SCHEDULER_SAMPLES; i++) {
+		uint32_t start = CYCLES();
+		NVIC_SetPendingIRQ(BENCHMARK_IRQn);
+		__DSB();
+		__ISB();
+		histogram_add(histograms + BENCHMARK_TEST_ISR_ENTRY, isr_timestamp - start, sums + BENCHMARK_TEST_ISR_ENTRY);
+		histogram_add(histograms + BENCHMARK_TEST_ISR_WAKEUP, helper_timestamp - isr_timestamp, sums + BENCHMARK_TEST_ISR_WAKEUP);
+	}
+	HAL_NVIC_DisableIRQ(BENCHMARK_IRQn);
+	osThreadTerminate(isr_helper);
+
+	// Pool: Every second entry is allocated, so the free list is not in memory order.
+	pool_init(benchmark_pool);
+	for (uint32_t i = 0; i < BENCHMARK_POOL_SIZE; i++) {
+		pool_alloc(benchmark_pool);
+	}
+	void** entries = pool_get_entries(benchmark_pool);
+	for (uint32_t i = 0; i < BENCHMARK_POOL_SIZE; i += 2) {
+		pool_free(benchmark_pool, entries[i]);
+	}
+	for (uint16_t i = 0; i < BENCHMARK_SCHEDULER_SAMPLES; i++) {
+		uint32_t start = CYCLES();
+		void* entry = pool_alloc(benchmark_pool);
+		pool_free(benchmark_pool, entry);
+		histogram_add(histograms + BENCHMARK_TEST_POOL, CYCLES() - start, sums + BENCHMARK_TEST_POOL);
+	}
+	err = RESPONSE_OK;
+
+exit:
+	osThreadSetPriority(benchmark_thread, old_priority);
+	for (uint8_t i = 0; i < BENCHMARK_TEST_COUNT; i++) {
+		if (histograms[i].samples > 0) {
+			histograms[i].mean = (uint32_t)(sums[i] / histograms[i].samples);
+		} else {
+			histograms[i].min = 0;
+		}
+	}
+	*out_len = 5 + BENCHMARK_TEST_COUNT * sizeof(benchmark_histogram_t);
+	return err;
+}
+
+/**
+ * Handler of the benchmark interrupt. Is not enabled outside of the scheduler benchmark.
+ */
+void benchmark_irq_handler() {
+	isr_timestamp = CYCLES();
+	osSignalSet(isr_helper, 0x01);
+}
+
+/**
+ * Enables the DWT cycle counter. It counts core clock cycles and is not used elsewhere.
+ */
+static void enable_cycle_counter() {
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->LAR = 0xC5ACCE55; // Unlock the DWT (Cortex-M7)
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+/**
+ * Overrides the cacheability of the buffer with the MPU region 1. Cached is write-back/write-allocate,
+ * what the SRAM and the SDRAM have by default.
+ * The buffer must be aligned to its size.
+ */
+static void set_cacheable(uint8_t* buffer, uint8_t cacheable) {
+	MPU_Region_InitTypeDef MPU_InitStruct;
+	SCB_CleanInvalidateDCache_by_Addr((uint32_t*)buffer, BENCHMARK_MEMORY_BUFFER_SIZE);
+	MPU_InitStruct.Enable = MPU_REGION_ENABLE;
+	MPU_InitStruct.BaseAddress = (uint32_t)buffer;
+	MPU_InitStruct.Size = MPU_REGION_SIZE_8KB;
+	MPU_InitStruct.AccessPermission = MPU_REGION_FULL_ACCESS;
+	MPU_InitStruct.IsBufferable = cacheable ? MPU_ACCESS_BUFFERABLE : MPU_ACCESS_NOT_BUFFERABLE;
+	MPU_InitStruct.IsCacheable = cacheable ? MPU_ACCESS_CACHEABLE : MPU_ACCESS_NOT_CACHEABLE;
+	MPU_InitStruct.IsShareable = MPU_ACCESS_NOT_SHAREABLE;
+	MPU_InitStruct.Number = MPU_REGION_NUMBER1;
+	MPU_InitStruct.TypeExtField = MPU_TEX_LEVEL1;
+	MPU_InitStruct.SubRegionDisable = 0x00;
+	MPU_InitStruct.DisableExec = MPU_INSTRUCTION_ACCESS_DISABLE;
+	HAL_MPU_ConfigRegion(&MPU_InitStruct);
+	__DSB();
+	__ISB();
+}
+
+/**
+ * Disables the MPU region 1 again. No cache lines of the buffer are left behind.
+ */
+static void restore_cacheability(uint8_t* buffer) {
+	MPU_Region_InitTypeDef MPU_InitStruct;
+	SCB_CleanInvalidateDCache_by_Addr((uint32_t*)buffer, BENCHMARK_MEMORY_BUFFER_SIZE);
+	MPU_InitStruct.Enable = MPU_REGION_DISABLE;
+	MPU_InitStruct.Number = MPU_REGION_NUMBER1;
+	HAL_MPU_ConfigRegion(&MPU_InitStruct);
+	__DSB();
+	__ISB();
+}
+
+/**
+ * Runs all operations on the buffer and saves the minimum of all repetitions.
+ * The copy goes from the first half of the buffer to the second one.
+ */
+static void benchmark_memory_region(uint8_t* buffer, uint16_t size, benchmark_memory_result_t* result) {
+	uint32_t start, cycles;
+	uint32_t words = size / 4;
+	result->size = size;
+	result->copy = result->read = result->write = result->latency = UINT32_MAX;
+	result->loads = size / BENCHMARK_CACHE_LINE_SIZE;
+
+	for (uint8_t r = 0; r < BENCHMARK_MEMORY_REPETITIONS; r++) {
+		taskENTER_CRITICAL();
+		start = CYCLES();
+		memcpy(buffer + BENCHMARK_MEMORY_BUFFER_SIZE/2, buffer, size);
+		cycles = CYCLES() - start;
+		taskEXIT_CRITICAL();
+		if (cycles < result->copy) {
+			result->copy = cycles;
+		}
+
+		volatile uint32_t* word = (volatile uint32_t*)buffer;
+		uint32_t sum = 0;
+		taskENTER_CRITICAL();
+		start = CYCLES();
+		for (uint32_t i = 0; i < words; i += 4) {
+			sum += word[i] + word[i+1] + word[i+2] + word[i+3];
+		}
+		cycles = CYCLES() - start;
+		taskEXIT_CRITICAL();
+		sink = sum;
+		if (cycles < result->read) {
+			result->read = cycles;
+		}
+
+		taskENTER_CRITICAL();
+		start = CYCLES();
+		for (uint32_t i = 0; i < words; i += 4) {
+			word[i] = i;
+			word[i+1] = i;
+			word[i+2] = i;
+			word[i+3] = i;
+		}
+		cycles = CYCLES() - start;
+		taskEXIT_CRITICAL();
+		if (cycles < result->write) {
+			result->write = cycles;
+		}
+
+		init_pointer_chase(buffer, size);
+		void* volatile* p = (void* volatile*)buffer;
+		taskENTER_CRITICAL();
+		start = CYCLES();
+		for (uint16_t i = 0; i < result->loads; i++) {
+			p = (void* volatile*)*p;
+		}
+		cycles = CYCLES() - start;
+		taskEXIT_CRITICAL();
+		sink = (uint32_t)p;
+		if (cycles < result->latency) {
+			result->latency = cycles;
+		}
+	}
+}
+
+/**
+ * Writes the whole file and reads it back in chunks of the given size. Fills the write result
+ * and the read result after it. Only the calls to FatFs are measured. Returns 0 on an error of the SD card.
+ */
+static uint8_t benchmark_sd_file(uint8_t* buffer, uint32_t chunk, benchmark_sd_result_t* result) {
+	unsigned int bytes;
+	uint32_t start;
+
+	result[0].operation = BENCHMARK_SD_WRITE;
+	result[0].chunk = chunk;
+	result[0].bytes = BENCHMARK_SD_FILE_SIZE;
+	result[0].cycles = 0;
+	result[0].valid = 1;
+	fill_sd_pattern(buffer, chunk);
+	if (f_lseek(&sd_file, 0) != FR_OK) {
+		return 0;
+	}
+	for (uint32_t offset = 0; offset < BENCHMARK_SD_FILE_SIZE; offset += chunk) {
+		start = CYCLES();
+		FRESULT fres = f_write(&sd_file, buffer, chunk, &bytes);
+		result[0].cycles += CYCLES() - start;
+		if (fres != FR_OK || bytes != chunk) {
+			return 0;
+		}
+	}
+	start = CYCLES();
+	FRESULT fres = f_sync(&sd_file);
+	result[0].cycles += CYCLES() - start;
+	if (fres != FR_OK) {
+		return 0;
+	}
+
+	result[1].operation = BENCHMARK_SD_READ;
+	result[1].chunk = chunk;
+	result[1].bytes = BENCHMARK_SD_FILE_SIZE;
+	result[1].cycles = 0;
+	result[1].valid = 1;
+	if (f_lseek(&sd_file, 0) != FR_OK) {
+		return 0;
+	}
+	for (uint32_t offset = 0; offset < BENCHMARK_SD_FILE_SIZE; offset += chunk) {
+		// Dirty lines of the buffer, that survive the DMA transfer, would break the pattern.
+		memset(buffer, 0, chunk);
+		start = CYCLES();
+		fres = f_read(&sd_file, buffer, chunk, &bytes);
+		result[1].cycles += CYCLES() - start;
+		if (fres != FR_OK || bytes != chunk) {
+			return 0;
+		}
+		uint32_t* word = (uint32_t*)buffer;
+		for (uint32_t i = 0; i < chunk / 4; i++) {
+			if (word[i] != i * 0x9E3779B1) {
+				result[1].valid = 0;
+				break;
+			}
+		}
+	}
+	return 1;
+}
+
+/**
+ * Every word gets a value, that depends on its position in the chunk.
+ */
+static void fill_sd_pattern(uint8_t* buffer, uint32_t chunk) {
+	uint32_t* word = (uint32_t*)buffer;
+	for (uint32_t i = 0; i < chunk / 4; i++) {
+		word[i] = i * 0x9E3779B1;
+	}
+}
+
+/**
+ * Links the cache lines of the buffer to a cycle in a pseudo random order. The first word of
+ * every line points to the next line.
+ */
+static void init_pointer_chase(uint8_t* buffer, uint16_t size) {
+	uint16_t lines = size / BENCHMARK_CACHE_LINE_SIZE;
+	uint16_t order[BENCHMARK_MEMORY_BUFFER_SIZE / BENCHMARK_CACHE_LINE_SIZE];
+	uint32_t random = 0x12345678;
+
+	for (uint16_t i = 0; i < lines; i++) {
+		order[i] = i;
+	}
+	// Fisher-Yates shuffle with a LCG. Line 0 stays the start.
+	for (uint16_t i = lines - 1; i > 1; i--) {
+		random = random * 1664525 + 1013904223;
+		uint16_t j = 1 + (random >> 16) % i;
+		uint16_t tmp = order[i];
+		order[i] = order[j];
+		order[j] = tmp;
+	}
+	for (uint16_t i = 0; i < lines; i++) {
+		uint8_t* next = buffer + order[(i + 1) % lines] * BENCHMARK_CACHE_LINE_SIZE;
+		*(uint8_t**)(buffer + order[i] * BENCHMARK_CACHE_LINE_SIZE) = next;
+	}
+}
+
+static void histogram_init(benchmark_histogram_t* histogram, BenchmarkTest test) {
+	memset(histogram, 0, sizeof(benchmark_histogram_t));
+	histogram->test = test;
+	histogram->min = UINT32_MAX;
+}
+
+static void histogram_add(benchmark_histogram_t* histogram, uint32_t cycles, uint64_t* sum) {
+	uint8_t bin = cycles == 0 ? 0 : 31 - __CLZ(cycles);
+	if (bin >= BENCHMARK_HISTOGRAM_BINS) {
+		bin = BENCHMARK_HISTOGRAM_BINS - 1;
+	}
+	histogram->bins[bin]++;
+	histogram->samples++;
+	*sum += cycles;
+	if (cycles < histogram->min) {
+		histogram->min = cycles;
+	}
+	if (cycles > histogram->max) {
+		histogram->max = cycles;
+	}
+}
+
+static void yield_helper_function(void const* argument) {
+	for (;;) {
+		helper_timestamp = CYCLES();
+		taskYIELD();
+	}
+}
+
+static void signal_helper_function(void const* argument) {
+	for (;;) {
+		osSignalWait(0x01, osWaitForever);
+		osSignalSet(benchmark_thread, 0x01);
+	}
+}
+
+static void queue_helper_function(void const* argument) {
+	for (;;) {
+		osEvent event = osMessageGet(ping_queue, osWaitForever);
+		osMessagePut(pong_queue, event.value.v, osWaitForever);
+	}
+}
+
+static void isr_helper_function(void const* argument) {
+	for (;;) {
+		osSignalWait(0x01, osWaitForever);
+		helper_timestamp = CYCLES();
+	}
+}
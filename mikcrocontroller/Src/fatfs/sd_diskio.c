@@ -52,6 +52,7 @@
 /* Includes ------------------------------------------------------------------*/
 #include "ff_gen_drv.h"
 #include "sd_diskio.h"
+#include "string.h"
 
 /* Private typedef -----------------------------------------------------------*/
 /* Private define ------------------------------------------------------------*/
@@ -85,14 +86,20 @@
  * Notice: This is applicable only for cortex M7 based platform.
  */
 /* USER CODE BEGIN enableSDDmaCacheMaintenance */
-#define ENABLE_SD_DMA_CACHE_MAINTENANCE  0
-/* USER CODE BEGIN enableSDDmaCacheMaintenance */
+#define ENABLE_SD_DMA_CACHE_MAINTENANCE  1
+#define SD_CACHE_LINE_SIZE  32
+#define SD_SCRATCH_SECTORS  8 /* Unaligned buffers are transferred in chunks of this size */
+/* USER CODE END enableSDDmaCacheMaintenance */
 
 /* Private variables ---------------------------------------------------------*/
 /* Disk status */
 static volatile DSTATUS Stat = STA_NOINIT;
 
 static osMessageQId SDQueueID;
+
+/* Bounce buffer for transfers from/to buffers, that are not cache line aligned. FatFs serializes all
+ * accesses to the volume, so one is enough. */
+static BYTE __aligned(SD_CACHE_LINE_SIZE) scratch[SD_SCRATCH_SECTORS*BLOCKSIZE] __section(".sram1");
 /* Private function prototypes -----------------------------------------------*/
 static DSTATUS SD_CheckStatus(BYTE lun);
 DSTATUS SD_initialize (BYTE);
@@ -186,82 +193,114 @@ DSTATUS SD_status(BYTE lun)
 
 /* USER CODE BEGIN beforeReadSection */
 /* can be used to modify previous code / undefine following code / add new code */
-/* USER CODE END beforeReadSection */
+
 /**
- * @brief  Reads Sector(s)
- * @param  lun : not used
- * @param  *buff: Data buffer to store read data
- * @param  sector: Sector address (LBA)
- * @param  count: Number of sectors to read (1..128)
- * @retval DRESULT: Operation result
+ * Returns 1, if the DMA can transfer directly from/to the buffer: The SRAM and SDRAM are cached,
+ * so the buffer must start at a cache line. Sectors are a multiple of the cache line, so it ends
+ * at one, too. No other data shares the lines with the buffer and the cache maintenance is safe.
+ * Other buffers are copied through the scratch buffer.
  */
-DRESULT SD_read(BYTE lun, BYTE *buff, DWORD sector, UINT count)
+static inline uint8_t SD_is_dma_aligned(const BYTE *buff)
+{
+	return ((uint32_t)buff & (SD_CACHE_LINE_SIZE - 1)) == 0;
+}
+
+/**
+ * Waits for the completion message of the transfer and for the card to get ready again.
+ */
+static DRESULT SD_wait_for_transfer(uint32_t message)
 {
-	DRESULT res = RES_ERROR;
 	osEvent event;
 	uint32_t timer;
-#if (ENABLE_SD_DMA_CACHE_MAINTENANCE == 1)
-	uint32_t alignedAddr;
-#endif
 
-	//printf("SD read; sec: %lu, count: %u\n", sector, count);
-	uint8_t status = BSP_SD_ReadBlocks_DMA((uint32_t*)buff, (uint32_t) (sector), count);
-	if (status == MSD_OK)
+	// wait for a message from the queue or a timeout
+	event = osMessageGet(SDQueueID, SD_TIMEOUT);
+	if (event.status != osEventMessage || event.value.v != message)
 	{
-		// wait for a message from the queue or a timeout
-		event = osMessageGet(SDQueueID, SD_TIMEOUT);
-		if (event.status == osEventMessage)
+		return RES_ERROR;
+	}
+
+	timer = osKernelSysTick() + SD_TIMEOUT;
+	// block until SDIO IP is ready or a timeout occur
+	while(timer > osKernelSysTick())
+	{
+		if (BSP_SD_GetCardState() == SD_TRANSFER_OK)
 		{
-			if (event.value.v == READ_CPLT_MSG)
-			{
-				timer = osKernelSysTick() + SD_TIMEOUT;
-				// block until SDIO IP is ready or a timeout occur
-				while(timer > osKernelSysTick())
-				{
-					if (BSP_SD_GetCardState() == SD_TRANSFER_OK)
-					{
-						char* b = buff;
-						printf("SD first 8 bytes: %c %c %c %c %c %c %c %c\n", b[0], b[1], b[2], b[3], b[4], b[5], b[6], b[7]);
-
-						res = RES_OK;
-#if (ENABLE_SD_DMA_CACHE_MAINTENANCE == 1)
-               //the SCB_InvalidateDCache_by_Addr() requires a 32-Byte aligned address,
-               //adjust the address and the D-Cache size to invalidate accordingly.
+			return RES_OK;
+		}
+	}
+	return RES_ERROR;
+}
 
-						alignedAddr = (uint32_t)buff & ~0x1F;
-						//printf("buff: 0x%x, aligned: 0x%x\n", (uintptr_t)buff, (uintptr_t)alignedAddr);
-						SCB_InvalidateDCache_by_Addr((uint32_t*)alignedAddr, count*BLOCKSIZE + ((uint32_t)buff - alignedAddr));
+/**
+ * Reads all sectors with one multi block DMA transfer into the cache line aligned buffer.
+ */
+static DRESULT SD_read_dma(BYTE *buff, DWORD sector, UINT count)
+{
+	DRESULT res = RES_ERROR;
+#if (ENABLE_SD_DMA_CACHE_MAINTENANCE == 1)
+	// Dirty lines must not be evicted into the buffer, while the DMA writes it.
+	SCB_InvalidateDCache_by_Addr((uint32_t*)buff, count*BLOCKSIZE);
 #endif
-						break;
-					}
-				}
-			}
-		}
+	if (BSP_SD_ReadBlocks_DMA((uint32_t*)buff, (uint32_t) (sector), count) == MSD_OK)
+	{
+		res = SD_wait_for_transfer(READ_CPLT_MSG);
 	}
+#if (ENABLE_SD_DMA_CACHE_MAINTENANCE == 1)
+	// The core may have loaded lines speculatively during the transfer.
+	SCB_InvalidateDCache_by_Addr((uint32_t*)buff, count*BLOCKSIZE);
+#endif
 	return res;
 }
 
-/*DRESULT SD_read(BYTE lun, BYTE *buff, DWORD sector, UINT count)
+/**
+ * Writes all sectors with one multi block DMA transfer from the cache line aligned buffer.
+ */
+static DRESULT SD_write_dma(const BYTE *buff, DWORD sector, UINT count)
 {
-	DRESULT res = RES_ERROR;
-	uint32_t timer;
+#if (ENABLE_SD_DMA_CACHE_MAINTENANCE == 1)
+	SCB_CleanDCache_by_Addr((uint32_t*)buff, count*BLOCKSIZE);
+#endif
+	if (BSP_SD_WriteBlocks_DMA((uint32_t*)buff, (uint32_t) (sector), count) != MSD_OK)
+	{
+		return RES_ERROR;
+	}
+	return SD_wait_for_transfer(WRITE_CPLT_MSG);
+}
+/* USER CODE END beforeReadSection */
+/**
+ * @brief  Reads Sector(s)
+ * @param  lun : not used
+ * @param  *buff: Data buffer to store read data
+ * @param  sector: Sector address (LBA)
+ * @param  count: Number of sectors to read (1..128)
+ * @retval DRESULT: Operation result
+ */
+DRESULT SD_read(BYTE lun, BYTE *buff, DWORD sector, UINT count)
+{
+	DRESULT res;
+	UINT chunk;
+
+	if (SD_is_dma_aligned(buff))
+	{
+		return SD_read_dma(buff, sector, count);
+	}
 
-	uint8_t status = BSP_SD_ReadBlocks((uint32_t*)buff, (uint32_t) (sector), count, SD_TIMEOUT);
-	if (status == MSD_OK)
+	while (count > 0)
 	{
-		timer = osKernelSysTick() + SD_TIMEOUT;
-		// block until SDIO IP is ready or a timeout occur
-		while(timer > osKernelSysTick())
+		chunk = count < SD_SCRATCH_SECTORS ? count : SD_SCRATCH_SECTORS;
+		res = SD_read_dma(scratch, sector, chunk);
+		if (res != RES_OK)
 		{
-			if (BSP_SD_GetCardState() == SD_TRANSFER_OK)
-			{
-				res = RES_OK;
-				break;
-			}
+			return res;
 		}
+		memcpy(buff, scratch, chunk*BLOCKSIZE);
+		buff += chunk*BLOCKSIZE;
+		sector += chunk;
+		count -= chunk;
 	}
-	return res;
-}*/
+	return RES_OK;
+}
 
 /* USER CODE BEGIN beforeWriteSection */
 /* can be used to modify previous code / undefine following code / add new code */
@@ -277,65 +316,29 @@ DRESULT SD_read(BYTE lun, BYTE *buff, DWORD sector, UINT count)
 #if _USE_WRITE == 1
 DRESULT SD_write(BYTE lun, const BYTE *buff, DWORD sector, UINT count)
 {
-	DRESULT res = RES_ERROR;
-	osEvent event;
-	uint32_t timer;
-#if (ENABLE_SD_DMA_CACHE_MAINTENANCE == 1)
-	uint32_t alignedAddr;
-   //the SCB_CleanDCache_by_Addr() requires a 32-Byte aligned address
-   //adjust the address and the D-Cache size to clean accordingly.
-	alignedAddr = (uint32_t)buff &  ~0x1F;
-	SCB_CleanDCache_by_Addr((uint32_t*)alignedAddr, count*BLOCKSIZE + ((uint32_t)buff - alignedAddr));
-#endif
+	DRESULT res;
+	UINT chunk;
 
-	if(BSP_SD_WriteBlocks_DMA((uint32_t*)buff,
-			(uint32_t) (sector),
-			count) == MSD_OK)
+	if (SD_is_dma_aligned(buff))
 	{
-		// Get the message from the queue
-		event = osMessageGet(SDQueueID, SD_TIMEOUT);
-
-		if (event.status == osEventMessage)
-		{
-			if (event.value.v == WRITE_CPLT_MSG)
-			{
-				timer = osKernelSysTick() + SD_TIMEOUT;
-				// block until SDIO IP is ready or a timeout occur
-				while(timer > osKernelSysTick())
-				{
-					if (BSP_SD_GetCardState() == SD_TRANSFER_OK)
-					{
-						res = RES_OK;
-						break;
-					}
-				}
-			}
-		}
+		return SD_write_dma(buff, sector, count);
 	}
 
-	return res;
-}
-/*DRESULT SD_write(BYTE lun, const BYTE *buff, DWORD sector, UINT count)
-{
-	DRESULT res = RES_ERROR;
-	uint32_t timer;
-
-	if(BSP_SD_WriteBlocks((uint32_t*)buff, (uint32_t) (sector), count, SD_TIMEOUT) == MSD_OK)
+	while (count > 0)
 	{
-		timer = osKernelSysTick() + SD_TIMEOUT;
-		// block until SDIO IP is ready or a timeout occur
-		while(timer > osKernelSysTick())
+		chunk = count < SD_SCRATCH_SECTORS ? count : SD_SCRATCH_SECTORS;
+		memcpy(scratch, buff, chunk*BLOCKSIZE);
+		res = SD_write_dma(scratch, sector, chunk);
+		if (res != RES_OK)
 		{
-			if (BSP_SD_GetCardState() == SD_TRANSFER_OK)
-			{
-				res = RES_OK;
-				break;
-			}
+			return res;
 		}
+		buff += chunk*BLOCKSIZE;
+		sector += chunk;
+		count -= chunk;
 	}
-
-	return res;
-}*/
+	return RES_OK;
+}
 #endif /* _USE_WRITE == 1 */
 
 /* USER CODE BEGIN beforeIoctlSection */
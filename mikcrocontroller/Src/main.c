@@ -10,6 +10,7 @@
 #include "utils.h"
 #include "measure.h"
 #include "sd_config.h"
+#include "recorder.h"
 
 void defaultTaskFunction(void const *argument);
 
@@ -39,6 +40,7 @@ void defaultTaskFunction(void const *argument) {
 
 	// init the measure system.
 	measure_init();
+	recorder_init(config->record_file_size, config->record_file_time);
 
 	// init the current state and try to get it from the SD card.
 	init_state();
@@ -324,6 +324,10 @@ inline void ADS1262_set_filter(uint8_t filter) {
 
 inline uint8_t ADS1262_read_filter() {
 	ADS1262_read_register(ADS1262_MODE1);
+	return ADS1262_get_filter();
+}
+
+inline uint8_t ADS1262_get_filter() {
 	return registerMap.MODE1.bit.FILTER;
 }
 
@@ -337,6 +341,10 @@ inline void ADS1262_set_gain(uint8_t gain) {
 
 inline uint8_t ADS1262_read_gain() {
 	ADS1262_read_register(ADS1262_MODE2);
+	return ADS1262_get_gain();
+}
+
+inline uint8_t ADS1262_get_gain() {
 	if (registerMap.MODE2.bit.BYPASS) {
 		return 0xFF;
 	} else {
@@ -376,11 +384,19 @@ inline void ADS1262_disable_internal_reference() {
 inline uint8_t ADS1262_read_is_internal_reference_used() {
 	ADS1262_read_register(ADS1262_POWER);
 	ADS1262_read_register(ADS1262_REFMUX);
+	return ADS1262_is_internal_reference_used();
+}
+
+inline uint8_t ADS1262_is_internal_reference_used() {
 	return registerMap.POWER.bit.INTREF && registerMap.REFMUX.bit.RMUXN == 0 && registerMap.REFMUX.bit.RMUXP == 0;
 }
 
 inline uint8_t ADS1262_read_reference_pins() {
 	ADS1262_read_register(ADS1262_REFMUX);
+	return ADS1262_get_reference_pins();
+}
+
+inline uint8_t ADS1262_get_reference_pins() {
 	return (registerMap.REFMUX.bit.RMUXN & 0x0F) | ((registerMap.REFMUX.bit.RMUXP & 0x0F) << 4);
 }
 
@@ -397,7 +413,14 @@ inline void ADS1262_set_reference_polarity_reverse() {
 // Calibration
 int32_t ADS1262_read_calibration_offset() {
 	ADS1262_read_registers(ADS1262_OFCAL0, 3);
+	return ADS1262_get_calibration_offset();
+}
 
+/**
+ * Returns the offset of the last write or read. The ADC changes it only with a calibration,
+ * which reads it afterwards.
+ */
+int32_t ADS1262_get_calibration_offset() {
 	int32_t offset = (registerMap.OFCAL2.reg << 16) | (registerMap.OFCAL1.reg << 8) | registerMap.OFCAL0.reg;
 
 	// number is neg do sign extension:
@@ -429,6 +452,10 @@ inline void ADS1262_send_offset_calibration_command() {
 
 inline uint32_t ADS1262_read_calibration_scale() {
 	ADS1262_read_registers(ADS1262_FSCAL0, 3);
+	return ADS1262_get_calibration_scale();
+}
+
+inline uint32_t ADS1262_get_calibration_scale() {
 	return (registerMap.FSCAL2.reg << 16) | (registerMap.FSCAL1.reg << 8) | registerMap.FSCAL0.reg;
 }
 
@@ -6,6 +6,8 @@
  */
 #include "fft.h"
 #include "send_data.h"
+#include "recorder.h"
+#include "overload.h"
 #include "stdio.h"
 #include "config.h"
 #include "measure.h"
@@ -37,6 +39,8 @@ void fft_instance_init(FFT_instance* fft, uint8_t id) {
 	fft->dirty = 0;
 	fft->bytes_send = 0;
 	fft->window_index = RECTANGULAR_WINDOW_INDEX;
+	fft->sequence = 0;
+	fft->next_sequence = 0;
 
 	fft->thread = osThreadCreate(osThread(fft_task), (void*)(fft));
 }
@@ -148,6 +152,7 @@ void fft_prepare_instances(FFT_instance** fft_instances, uint8_t N) {
 		} else {
 			fft->fill_step = fft->length >> 1;
 		}
+		fft->next_sequence = 0;
 
 		uint16_t N_half = N >> 1;
 		for (uint16_t j = 0; j < N_half; j++) {
@@ -235,7 +240,10 @@ void fft_instance_new_value(FFT_instance *fft, uint32_t nanovolt, uint64_t times
 			reset_fill_step = fft->length >> 1;
 		}
 
-		if (fft->dirty) {
+		if (fft->dirty || overload_get_level() >= OVERLOAD_LEVEL_PAUSE_FFT) {
+			// Skip this FFT. The sequence number shows the gap to the clients.
+			fft->next_sequence++;
+			send_data_count_drop(fft->dirty ? DROP_CAUSE_FFT_BUSY : DROP_CAUSE_OVERLOAD);
 			fft->fill_step = reset_fill_step;
 			return;
 		}
@@ -246,6 +254,7 @@ void fft_instance_new_value(FFT_instance *fft, uint32_t nanovolt, uint64_t times
 		fft->raw_buffer_calc_and_send = tmp;
 		fft->buffer_fill = (FFT_DATATYPE*)(fft->raw_buffer_fill + FFT_HEADER_ALIGNMENT + FFT_HEADER_SIZE);
 		fft->fill_step = reset_fill_step;
+		fft->sequence = fft->next_sequence++;
 
 		// Notify the thread to calculate the FFT.
 		osSignalSet(fft->thread, 1);
@@ -287,6 +296,7 @@ static void fft_task_function(void const *argument) {
 				fft_set_package_metadata(fft, m);
 
 				// Send it (there, the data is copied) and finished.
+				recorder_write(SEND_TYPE_FFT, data, packet_len);
 				send_data(SEND_TYPE_FFT, data, packet_len);
 				fft->dirty = 0;
 			} else {
@@ -336,6 +346,7 @@ static void fft_transmit_frame(FFT_instance* fft) {
 	fft->frame_number++;
 
 	fft->bytes_send += bytes_to_send;
+	recorder_write(SEND_TYPE_FFT, data, bytes_to_send + sizeof(fft_packet_metadata));
 	send_data_non_copy(SEND_TYPE_FFT, data, bytes_to_send + sizeof(fft_packet_metadata), &fft_transmitted, (void*) fft);
 }
 
@@ -347,6 +358,7 @@ static void fft_set_package_metadata(FFT_instance* fft, fft_packet_metadata* m)
 	m->timestamp = measure_reference_timer_ticks;
 	m->frame_count = fft->frame_count;
 	m->frame_number = fft->frame_number;
+	m->sequence = fft->sequence;
 	m->length = fft->length;
 	m->frequence_resolution = fft->frequence_resolution;
 	if (fft->window_index == RECTANGULAR_WINDOW_INDEX) {
@@ -17,6 +17,8 @@
 #include "watchdog.h"
 #include "state.h"
 #include "measurement.h"
+#include "overload.h"
+#include "recorder.h"
 
 static measure_state_t measure_state = MEASURE_STATE_IDLE;
 static osThreadId thread_to_notify = NULL;
@@ -26,12 +28,14 @@ static uint8_t current_measurement_index;
 
 typedef struct __packed {
 	uint64_t time_reference;
+	uint32_t sequence; // Counts the send buffers. Clients can detect lost packets with this.
 	value_t buffer[VALUE_BUFFER_SIZE];
 } ValueBuffer;
 
 ValueBuffer _vb;
 ValueBuffer* value_buffer = &_vb;
 uint16_t value_buffer_index;
+uint32_t value_buffer_sequence;
 
 static inline uint8_t send_buffer();
 static inline void setup_valuebuffer();
@@ -133,7 +137,8 @@ void DRDY_Interrupt() {
 
 	// Continuous measurement
 
-	if (save_value) {
+	// Under overload, only some of the samples are sent (see overload.c).
+	if (save_value && !overload_skip_sample(current_measurement_index)) {
 		// set the reference, if it's the first value in the buffer.
 		if (value_buffer->time_reference == 0) {
 			value_buffer->time_reference = measure_reference;
@@ -165,7 +170,9 @@ void DRDY_Interrupt() {
 				return;
 			}
 		}
+	}
 
+	if (save_value) {
 		// Put the value into the fft...
 		if (fft_instance_enabled(&(current_measurement->fft))) {
 			fft_instance_new_value(&(current_measurement->fft), tennanovolt, measure_reference);
@@ -198,14 +205,25 @@ void DRDY_Interrupt() {
 }
 
 /**
- * Transmits a full buffer. This might fail, if the send_data task cannot take more data.
+ * Records and transmits a full buffer. This might fail, if the send_data task cannot take more data.
+ * Returns 0, if the measurement was stopped because of this. Under overload, the buffer
+ * may be dropped (see overload.c). The sequence shows the gap to the clients. While recording, the
+ * measurement goes on, even if the network cannot take the data.
  */
 static inline uint8_t send_buffer() {
 	// Buffer is full. Switch to the other one and send this one away
 	// The size is the amount of data in the buffer * the buffer size plus
-	// the space for the timestamp.
-	uint16_t size = sizeof(uint64_t) + value_buffer_index*sizeof(value_t);
-	uint8_t ret = send_data(SEND_TYPE_DATA, (uint8_t*)value_buffer, size);
+	// the space for the timestamp and sequence.
+	uint16_t size = offsetof(ValueBuffer, buffer) + value_buffer_index*sizeof(value_t);
+	value_buffer->sequence = value_buffer_sequence++;
+	// The buffer is taken now. If sending fails, measure_stop must not record or send it again.
+	value_buffer_index = 0;
+	uint8_t ret = 1;
+	recorder_write(SEND_TYPE_DATA, (uint8_t*)value_buffer, size);
+	if (!overload_drop_packet()) {
+		ret = send_data(SEND_TYPE_DATA, (uint8_t*)value_buffer, size) || overload_is_degrading() ||
+				recorder_is_recording();
+	}
 	setup_valuebuffer();
 
 	return ret;
@@ -277,6 +295,7 @@ protocol_error_t measure_start() {
 	measurement_watchdog_start();
 	ADS1262_set_input_mux(measurements[current_measurement_index]->adc_input_multiplexer);
 	setup_valuebuffer();
+	value_buffer_sequence = 0;
 	measure_state = MEASURE_STATE_RUNNING;
 	ADS1262_set_continuous_mode();
 	ADS1262_start_ADC();
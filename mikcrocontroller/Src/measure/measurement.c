@@ -170,6 +170,7 @@ protocol_error_t measurement_set_averaging(uint8_t id, uint16_t averaging) {
 
 /**
  * Given a state representation, e.g. from the SD card, setup all measurements as given.
+ * Existing measurements are deleted. The measurement must not be active.
  */
 void measurements_set_to_state(complete_state_t* state) {
 	if (measurementPool->type != PoolTypeStatic) {
@@ -177,6 +178,14 @@ void measurements_set_to_state(complete_state_t* state) {
 	}
 
 	measurement_t** measurements = measurement_get_all();
+	for (uint32_t i = 0; i < measurementPool->entrycount; i++) {
+		measurement_t* m = measurements[i];
+		if (NULL != m) {
+			fft_instance_deinit(&(m->fft));
+			pool_free(measurementPool, (void*) m);
+		}
+	}
+
 	for (uint32_t i = 0; i < measurementPool->entrycount; i++) { // Go through all available spots for measurements
 		// find measurement in state.
 		measurement_state_t* m = NULL;
@@ -187,18 +196,25 @@ void measurements_set_to_state(complete_state_t* state) {
 			}
 		}
 
-		if (NULL == m) { // This measurement does not exist. Set to NULL
-			measurements[i] = NULL;
-		} else {
-			// Read all information from the state.
-			((void**)measurements)[i] = measurementPool->pool.stat + i*measurementPool->entrysize;
-			measurements[i]->adc_input_multiplexer = m->input_multiplexer;
-			measurements[i]->enabled = m->enabled;
-			measurements[i]->averaging_count = m->averaging;
-			FFT_instance* fft = &(measurements[i]->fft);
-			fft_instance_init(fft, i);
-			fft_set_enabled(fft, m->fft_enabled);
-			fft_set_length(fft, m->fft_length);
+		if (NULL == m) { // This measurement does not exist.
+			continue;
 		}
+
+		// The id is the index in the pool, so the measurement gets exactly this entry.
+		measurement_t* measurement = (measurement_t*) pool_alloc_at(measurementPool, i);
+		if (NULL == measurement) {
+			Error_Handler();
+		}
+
+		// Read all information from the state.
+		measurement->adc_input_multiplexer = m->input_multiplexer;
+		measurement->enabled = m->enabled;
+		measurement->averaging_count = m->averaging;
+		measurement_reset_averaging(measurement);
+		FFT_instance* fft = &(measurement->fft);
+		fft_instance_init(fft, i);
+		fft_set_enabled(fft, m->fft_enabled);
+		fft_set_length(fft, m->fft_length);
+		fft_set_window(fft, m->fft_window_index);
 	}
 }
@@ -0,0 +1,445 @@
+/*
+ * recorder.c
+ *
+ * Records the data packets (and optionally the FFT frames) to files on the SD card, independent of
+ * the network. The packets are stored like they are sent to the connections: [send type][length (u16)]
+ * [payload]. The producers (the DRDY interrupt and the FFT tasks) copy the packets into a ring of
+ * RECORDER_BLOCK_COUNT blocks. The recorder task writes every full block with one f_write. The file
+ * position is always a multiple of RECORDER_BLOCK_SIZE, so FatFs passes the block directly to the
+ * disk driver, which writes all sectors with one DMA transfer. The files are preallocated with
+ * f_expand, so the clusters are contiguous and the FAT is not touched while recording.
+ *
+ * A producer reserves the space for its packet in a critical section and copies the packet
+ * afterwards, so large FFT frames do not block the sampling interrupt. A block is written, when all
+ * packets reserved in it are copied. If the ring is full, the packet is dropped and counted.
+ *
+ * A new file is started, if a file reaches the configured size or time. The files are cut at block
+ * boundaries, so a packet may continue in the next file: The files of one recording must be read in
+ * order. They are named rec<recording>_<file>.bin.
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: finn
+ */
+
+#include "recorder.h"
+#include "fatfs.h"
+#include "cmsis_os.h"
+#include "connection.h"
+#include "measure.h"
+#include "state.h"
+#include "string.h"
+#include "stdlib.h"
+#include "stdio.h"
+
+#define SIGNAL_BLOCK	0x01 // Blocks are ready to be written.
+#define SIGNAL_MODE		0x02 // The mode was changed by recorder_set_mode.
+
+// ADCP header, time reference and sequence of a value buffer. Used to estimate the max. samplerate.
+#define VALUE_PACKET_OVERHEAD	(3 + 8 + 4)
+
+static uint8_t __aligned(32) ring[RECORDER_BLOCK_COUNT][RECORDER_BLOCK_SIZE] __section(".extsram");
+
+// The position of the next packet. Blocks are counted, so block % RECORDER_BLOCK_COUNT is the
+// index in the ring. Changed by the producers in a critical section.
+static volatile uint32_t fill_block;
+static volatile uint32_t fill_offset;
+static volatile uint32_t writers; // Producers, that are copying their packet.
+static volatile uint32_t committed_block; // All blocks before are completely copied.
+static volatile uint32_t write_block; // The next block to write. Only changed by the recorder task.
+
+static volatile uint8_t mode; // What the producers record, see RecorderMode.
+static volatile uint8_t requested_mode;
+
+static osThreadId recorder_thread;
+static FIL file;
+static uint8_t file_open;
+static char filename[32];
+static uint32_t file_size_limit; // Bytes
+static uint32_t file_time_limit; // ms
+static uint32_t file_bytes;
+static uint32_t file_opened_at;
+static uint32_t recording_number;
+static uint32_t file_number;
+
+// Statistics
+static uint32_t files;
+static uint64_t bytes_written;
+static uint32_t writes;
+static uint32_t write_time_sum; // ms in f_write
+static uint32_t write_time_max;
+static uint32_t blocks_used_max;
+static uint32_t dropped_packets;
+static uint32_t dropped_bytes;
+static uint32_t not_preallocated;
+static FRESULT last_error;
+static uint32_t recording_started_at;
+static uint32_t recording_bytes; // Recorded by the producers
+
+static void recorder_task_function(void const* argument);
+static void find_recording_number();
+static void change_mode(uint8_t new_mode);
+static void start_recording(uint8_t new_mode);
+static void stop_recording();
+static void fail(FRESULT fres);
+static void disable_producers();
+static uint8_t write_full_blocks();
+static uint8_t write_to_file(uint8_t* block, uint32_t len);
+static uint8_t open_file();
+static void close_file();
+static inline void copy_to_ring(uint32_t* block, uint32_t* offset, const uint8_t* data, uint32_t len);
+
+/**
+ * Initializes the recorder and starts the recorder task. The file size is given in MB, the time in
+ * seconds (0 does not limit the time).
+ */
+void recorder_init(uint16_t file_size, uint32_t file_time) {
+	file_size_limit = (uint32_t)file_size * 1024 * 1024;
+	file_time_limit = file_time * 1000;
+	mode = RECORDER_MODE_OFF;
+	requested_mode = RECORDER_MODE_OFF;
+	file_open = 0;
+	find_recording_number();
+
+	osThreadDef(recorder_task, recorder_task_function, osPriorityAboveNormal, 1, 1024);
+	recorder_thread = osThreadCreate(osThread(recorder_task), NULL);
+}
+
+/**
+ * The next recording gets the number after the highest one found in RECORDER_DIRECTORY.
+ */
+static void find_recording_number() {
+	static DIR dir; // Only used while initializing.
+	static FILINFO info;
+	recording_number = 0;
+	if (f_opendir(&dir, RECORDER_DIRECTORY) != FR_OK) {
+		return;
+	}
+	while (f_readdir(&dir, &info) == FR_OK && info.fname[0] != 0) {
+		if (strncmp(info.fname, "rec", 3) == 0) {
+			uint32_t number = strtoul(info.fname + 3, NULL, 10);
+			if (number >= recording_number) {
+				recording_number = number + 1;
+			}
+		}
+	}
+	f_closedir(&dir);
+}
+
+/**
+ * Starts or stops recording (see RecorderMode). The files are opened and closed by the recorder
+ * task, so this returns immediately. Returns 0, if the mode does not exist.
+ */
+uint8_t recorder_set_mode(uint8_t new_mode) {
+	if (new_mode >= RECORDER_MODE_COUNT) {
+		return 0;
+	}
+	requested_mode = new_mode;
+	osSignalSet(recorder_thread, SIGNAL_MODE);
+	return 1;
+}
+
+/**
+ * Returns 1, if the packets are recorded. Then a measurement goes on, even if the network cannot
+ * take the data.
+ */
+inline uint8_t recorder_is_recording() {
+	return mode != RECORDER_MODE_OFF;
+}
+
+/**
+ * Records a packet, if the recorder is on. FFT frames are just recorded in RECORDER_MODE_DATA_AND_FFT.
+ * Can be called from tasks and interrupts.
+ */
+void recorder_write(uint8_t send_type, const uint8_t* payload, uint16_t len) {
+	if (mode == RECORDER_MODE_OFF || (send_type == SEND_TYPE_FFT && mode != RECORDER_MODE_DATA_AND_FFT)) {
+		return;
+	}
+	uint8_t header[3] = {send_type, len & 0xFF, len >> 8};
+	uint32_t total = sizeof(header) + len;
+
+	// Reserve the space.
+	UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+	if (mode == RECORDER_MODE_OFF) {
+		taskEXIT_CRITICAL_FROM_ISR(mask);
+		return;
+	}
+	uint32_t space = (write_block + RECORDER_BLOCK_COUNT - fill_block) * RECORDER_BLOCK_SIZE - fill_offset;
+	if (total > space) {
+		dropped_packets++;
+		dropped_bytes += total;
+		taskEXIT_CRITICAL_FROM_ISR(mask);
+		return;
+	}
+	uint32_t block = fill_block;
+	uint32_t offset = fill_offset;
+	fill_block += (fill_offset + total) / RECORDER_BLOCK_SIZE;
+	fill_offset = (fill_offset + total) % RECORDER_BLOCK_SIZE;
+	writers++;
+	recording_bytes += total;
+	uint32_t blocks_used = fill_block - write_block + (fill_offset > 0);
+	if (blocks_used > blocks_used_max) {
+		blocks_used_max = blocks_used;
+	}
+	taskEXIT_CRITICAL_FROM_ISR(mask);
+
+	copy_to_ring(&block, &offset, header, sizeof(header));
+	copy_to_ring(&block, &offset, payload, len);
+
+	// Commit. The last producer releases all blocks filled meanwhile.
+	uint8_t notify = 0;
+	mask = taskENTER_CRITICAL_FROM_ISR();
+	writers--;
+	if (writers == 0 && committed_block != fill_block) {
+		committed_block = fill_block;
+		notify = 1;
+	}
+	taskEXIT_CRITICAL_FROM_ISR(mask);
+
+	if (notify) {
+		osSignalSet(recorder_thread, SIGNAL_BLOCK);
+	}
+}
+
+/**
+ * Copies the data to the reserved position in the ring and advances the position.
+ */
+static inline void copy_to_ring(uint32_t* block, uint32_t* offset, const uint8_t* data, uint32_t len) {
+	while (len > 0) {
+		uint32_t part = RECORDER_BLOCK_SIZE - *offset;
+		if (part > len) {
+			part = len;
+		}
+		memcpy(ring[*block % RECORDER_BLOCK_COUNT] + *offset, data, part);
+		data += part;
+		len -= part;
+		*offset += part;
+		if (*offset == RECORDER_BLOCK_SIZE) {
+			(*block)++;
+			*offset = 0;
+		}
+	}
+}
+
+/**
+ * Writes the full blocks to the SD card and handles mode changes. Starts new files, if the size or
+ * the time of a file is reached.
+ */
+static void recorder_task_function(void const* argument) {
+	while (1) {
+		osSignalWait(0, RECORDER_POLL_INTERVAL);
+
+		if (requested_mode != mode) {
+			change_mode(requested_mode);
+		}
+		if (!file_open) {
+			continue;
+		}
+		if (!write_full_blocks()) {
+			continue;
+		}
+		if (file_time_limit > 0 && osKernelSysTick() - file_opened_at >= file_time_limit) {
+			close_file();
+			file_number++;
+			if (!open_file()) {
+				fail(last_error);
+			}
+		}
+	}
+}
+
+/**
+ * Starts, stops or changes the running recording.
+ */
+static void change_mode(uint8_t new_mode) {
+	if (new_mode == RECORDER_MODE_OFF) {
+		stop_recording();
+	} else if (mode == RECORDER_MODE_OFF) {
+		start_recording(new_mode);
+	} else {
+		mode = new_mode;
+	}
+}
+
+/**
+ * Opens the first file of a new recording and enables the producers.
+ */
+static void start_recording(uint8_t new_mode) {
+	f_mkdir(RECORDER_DIRECTORY); // Fails, if it exists.
+	file_number = 0;
+	if (!open_file()) {
+		fail(last_error);
+		return;
+	}
+
+	// The producers are disabled, so nobody uses the ring.
+	fill_block = 0;
+	fill_offset = 0;
+	committed_block = 0;
+	write_block = 0;
+	writers = 0;
+	recording_started_at = osKernelSysTick();
+	recording_bytes = 0;
+	mode = new_mode;
+
+	set_recording_flag(1);
+	send_state();
+}
+
+/**
+ * Disables the producers and writes the remaining packets. The recording is closed.
+ */
+static void stop_recording() {
+	disable_producers();
+	committed_block = fill_block;
+
+	if (!file_open || !write_full_blocks()) {
+		return; // Failed before. The recording is closed.
+	}
+	if (fill_offset > 0 && !write_to_file(ring[fill_block % RECORDER_BLOCK_COUNT], fill_offset)) {
+		fail(last_error);
+		return;
+	}
+	close_file();
+	recording_number++;
+	set_recording_flag(0);
+	send_state();
+}
+
+/**
+ * Stops the recording after an error of the SD card. The packets, that are not written, are lost.
+ */
+static void fail(FRESULT fres) {
+	printf("recorder error: %d\n", fres);
+	requested_mode = RECORDER_MODE_OFF;
+	disable_producers();
+	if (file_open) {
+		close_file();
+	}
+	recording_number++;
+	set_recording_flag(0);
+	send_state();
+}
+
+/**
+ * No more packets are recorded. Waits for the producers, that are still copying their packet.
+ */
+static void disable_producers() {
+	UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+	mode = RECORDER_MODE_OFF;
+	taskEXIT_CRITICAL_FROM_ISR(mask);
+	while (writers > 0) {
+		osDelay(1);
+	}
+}
+
+/**
+ * Writes all committed blocks. Starts a new file, if the current one is full.
+ * Returns 0, if the recording failed.
+ */
+static uint8_t write_full_blocks() {
+	while (write_block != committed_block) {
+		if (!write_to_file(ring[write_block % RECORDER_BLOCK_COUNT], RECORDER_BLOCK_SIZE)) {
+			fail(last_error);
+			return 0;
+		}
+		write_block++;
+
+		if (file_bytes + RECORDER_BLOCK_SIZE > file_size_limit) {
+			close_file();
+			file_number++;
+			if (!open_file()) {
+				fail(last_error);
+				return 0;
+			}
+		}
+	}
+	return 1;
+}
+
+/**
+ * Writes the data of a block to the file. Returns 0 on failure.
+ */
+static uint8_t write_to_file(uint8_t* block, uint32_t len) {
+	uint32_t start = osKernelSysTick();
+	unsigned int written = 0;
+	FRESULT fres = f_write(&file, block, len, &written);
+	uint32_t time = osKernelSysTick() - start;
+	if (fres != FR_OK || written != len) {
+		last_error = fres == FR_OK ? FR_DENIED : fres; // FR_OK and too few bytes: The card is full.
+		return 0;
+	}
+
+	file_bytes += len;
+	bytes_written += len;
+	writes++;
+	write_time_sum += time;
+	if (time > write_time_max) {
+		write_time_max = time;
+	}
+	return 1;
+}
+
+/**
+ * Opens the next file of the recording and preallocates it. If there is no contiguous space, the
+ * file grows while writing.
+ * Returns 0 on failure.
+ */
+static uint8_t open_file() {
+	snprintf(filename, sizeof(filename), RECORDER_DIRECTORY"/rec%04lu_%03lu.bin", recording_number, file_number);
+	FRESULT fres = f_open(&file, filename, FA_CREATE_ALWAYS | FA_WRITE);
+	if (fres != FR_OK) {
+		last_error = fres;
+		return 0;
+	}
+	if (f_expand(&file, file_size_limit, 1) != FR_OK) {
+		not_preallocated++;
+	}
+	file_open = 1;
+	file_bytes = 0;
+	file_opened_at = osKernelSysTick();
+	files++;
+	return 1;
+}
+
+/**
+ * Cuts the preallocated space after the written data and closes the file.
+ */
+static void close_file() {
+	FRESULT fres = f_truncate(&file);
+	if (fres == FR_OK) {
+		fres = f_close(&file);
+	}
+	if (fres != FR_OK) {
+		last_error = fres;
+		printf("recorder: error closing file: %d\n", fres);
+	}
+	file_open = 0;
+}
+
+/**
+ * Formats the statistics of the recorder into the given buffer as a string with respect to max_length.
+ * The card rate is the throughput of the SD card while writing. The max. samplerate, that can be
+ * recorded, is estimated from it.
+ * Returns the length of the written string (excl. null terminator)
+ */
+uint16_t format_recorder_stats(uint8_t* data, uint16_t max_length) {
+	static const char* mode_names[RECORDER_MODE_COUNT] = {"off", "data", "data and fft"};
+
+	uint32_t card_rate = write_time_sum > 0 ? (uint32_t)(bytes_written * 1000 / write_time_sum) : 0; // B/s
+	uint32_t max_samplerate = (uint64_t)card_rate * VALUE_BUFFER_SIZE /
+			(VALUE_BUFFER_SIZE * sizeof(value_t) + VALUE_PACKET_OVERHEAD);
+	uint32_t elapsed = osKernelSysTick() - recording_started_at;
+	uint32_t data_rate = mode != RECORDER_MODE_OFF && elapsed > 0 ? (uint32_t)((uint64_t)recording_bytes * 1000 / elapsed) : 0;
+
+	return snprintf((char*)data, max_length, "Recorder: mode %s, file %s, files %lu\n"
+			"Written: %lu kB, write time avg %lu ms, max %lu ms per %u bytes\n"
+			"Card rate %lu kB/s (max. samplerate ~%lu SPS), data rate %lu kB/s\n"
+			"Ring: max %lu of %u blocks, dropped %lu packets (%lu bytes)\n"
+			"Not preallocated %lu, last error %d\n",
+			mode_names[mode], file_open ? filename : "-", files,
+			(uint32_t)(bytes_written / 1024), writes > 0 ? write_time_sum / writes : 0, write_time_max,
+			RECORDER_BLOCK_SIZE,
+			card_rate / 1024, max_samplerate, data_rate / 1024,
+			blocks_used_max, RECORDER_BLOCK_COUNT, dropped_packets, dropped_bytes,
+			not_preallocated, last_error);
+}
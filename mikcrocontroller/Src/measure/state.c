@@ -13,27 +13,93 @@
 #include "fatfs.h"
 #include "cmsis_os.h"
 #include "stdio.h"
+#include "stddef.h"
 
 // THE state of the microcontroller. There are two sub-types of state:
 // - general ADC related values
 // - per measurement. Includes FFT.
 static complete_state_t state;
 
-// Lock access to the state-file on the SD-card.
-static osMutexId state_file_mutex;
+// Changes are not sent and saved by the caller, but marked here. The state task sends and saves them
+// after the delays, so a burst of commands results in one state message and one file write.
+// Changed with state_lock, because the DRDY interrupt changes the state, too (ADC reset).
+static osThreadId state_thread;
+static volatile uint8_t broadcast_pending;
+static volatile uint8_t save_pending;
+static volatile uint32_t broadcast_requested_at;
+static volatile uint32_t first_unsaved_change_at;
+static volatile uint32_t last_change_at;
+
+// The content of the state file. Only used by the state task.
+static uint8_t saved_state[sizeof(complete_state_t)];
+static uint16_t saved_state_len;
+
+// The state of the last state message. Deltas are built against it. Only used by the state task.
+// If sent_state_len is 0, the next message is a full one.
+static uint8_t sent_state[sizeof(complete_state_t)];
+static uint16_t sent_state_len;
+static uint32_t state_version;
+static volatile uint8_t full_state_requested;
+
+// The fields of adc_state_t in the order of the bits of the delta mask.
+#define ADC_FIELD(name)	{offsetof(adc_state_t, name), sizeof(((adc_state_t*)0)->name)}
+static const struct {
+	uint8_t offset;
+	uint8_t size;
+} adc_fields[] = {
+	ADC_FIELD(flags),
+	ADC_FIELD(sr_filter),
+	ADC_FIELD(pga),
+	ADC_FIELD(v_ref_tennanovolt),
+	ADC_FIELD(v_ref_inputs),
+	ADC_FIELD(calibration_offset),
+	ADC_FIELD(calibration_scale),
+	ADC_FIELD(measurement_count),
+};
+#define ADC_FIELD_COUNT	(sizeof(adc_fields)/sizeof(adc_fields[0]))
 
 static uint16_t get_state_size();
+static void state_changed(uint8_t save);
+static void state_task_function(void const* argument);
+static uint32_t time_until(uint32_t since, uint32_t delay, uint32_t now);
 static void send_state_to_clients();
+static uint16_t format_state_delta(uint8_t* message, const uint8_t* current);
+static const measurement_state_t* find_measurement_state(const uint8_t* state_bytes, uint8_t id);
 static void save_state();
+static uint8_t write_state_file(uint8_t* buffer, uint16_t len);
 static uint8_t init_last_state_from_file();
+static uint8_t read_state_file(const char* filename);
 static uint8_t set_state(uint8_t* data, uint16_t length);
+static uint8_t validate_state(uint8_t* data, uint16_t length, uint8_t assign_ids);
+static void assign_measurement_ids(uint8_t* data);
 
 /**
- * Initialize this module.
+ * Masks all interrupts, that may change the state. This can be used from tasks and interrupts.
+ */
+static inline UBaseType_t state_lock() {
+	return taskENTER_CRITICAL_FROM_ISR();
+}
+
+/**
+ * Restores the interrupt mask.
+ */
+static inline void state_unlock(UBaseType_t mask) {
+	taskEXIT_CRITICAL_FROM_ISR(mask);
+}
+
+/**
+ * Initialize this module and starts the state task.
  */
 void init_state() {
-	osMutexDef(stateFileMutex);
-	state_file_mutex = osMutexCreate(osMutex(stateFileMutex));
+	broadcast_pending = 0;
+	save_pending = 0;
+	saved_state_len = 0;
+	sent_state_len = 0;
+	state_version = 0;
+	full_state_requested = 0;
+
+	osThreadDef(state_task, state_task_function, osPriorityNormal, 1, 1024);
+	state_thread = osThreadCreate(osThread(state_task), NULL);
 }
 
 inline complete_state_t* get_current_state() {
@@ -53,23 +119,23 @@ void update_complete_state(uint8_t send_and_save_state) {
  * Updates the ADC state. If send_and_save_state is given,
  * The change is written to the sd card, and send via network.
  *
- * The ADC values are directly read from the ADC.
+ * The ADC values are taken from the register copy of the driver, which is updated by every
+ * write and read. So the ADC is not accessed here.
  */
 void update_adc_state(uint8_t send_and_save_state) {
 	state.adc.flags.started = measure_get_state();
 	if (!is_ADC_reset_flag_set()) {
-		state.adc.flags.internal_reference = ADS1262_read_is_internal_reference_used();
-		state.adc.sr_filter = ADS1262_read_samplerate() | (ADS1262_read_filter() << 4);
-		state.adc.pga = ADS1262_read_gain();
+		state.adc.flags.internal_reference = ADS1262_is_internal_reference_used();
+		state.adc.sr_filter = ADS1262_get_samplerate() | (ADS1262_get_filter() << 4);
+		state.adc.pga = ADS1262_get_gain();
 		state.adc.v_ref_tennanovolt = ADS1262_get_reference_voltage();
-		state.adc.v_ref_inputs = ADS1262_read_reference_pins();
-		state.adc.calibration_offset = ADS1262_read_calibration_offset();
-		state.adc.calibration_scale = ADS1262_read_calibration_scale();
+		state.adc.v_ref_inputs = ADS1262_get_reference_pins();
+		state.adc.calibration_offset = ADS1262_get_calibration_offset();
+		state.adc.calibration_scale = ADS1262_get_calibration_scale();
 	}
 
 	if (send_and_save_state) {
-		send_state_to_clients();
-		save_state();
+		state_changed(1);
 	}
 }
 
@@ -101,8 +167,7 @@ void update_measurement_state(uint8_t send_and_save_state) {
 	state.adc.measurement_count = state_measurement_index;
 
 	if (send_and_save_state) {
-		send_state_to_clients();
-		save_state();
+		state_changed(1);
 	}
 }
 
@@ -115,48 +180,239 @@ static uint16_t get_state_size() {
 }
 
 /**
- * Sends the raw state bytes to all clients.
+ * Marks the state as changed and wakes up the state task. It is sent after STATE_BROADCAST_DELAY and,
+ * if save is given, saved after STATE_SAVE_DELAY.
+ */
+static void state_changed(uint8_t save) {
+	uint32_t now = osKernelSysTick();
+	UBaseType_t mask = state_lock();
+	if (!broadcast_pending) {
+		broadcast_pending = 1;
+		broadcast_requested_at = now;
+	}
+	if (save) {
+		if (!save_pending) {
+			save_pending = 1;
+			first_unsaved_change_at = now;
+		}
+		last_change_at = now;
+	}
+	state_unlock(mask);
+
+	if (NULL != state_thread) {
+		osSignalSet(state_thread, STATE_SIGNAL_CHANGED);
+	}
+}
+
+/**
+ * Sends and saves the state, when the delays are over. The save is postponed by every change,
+ * but at most STATE_SAVE_MAX_DELAY after the first unsaved change.
+ */
+static void state_task_function(void const* argument) {
+	for (;;) {
+		uint32_t now = osKernelSysTick();
+		uint32_t timeout = osWaitForever;
+		uint8_t broadcast = 0, save = 0;
+
+		UBaseType_t mask = state_lock();
+		if (broadcast_pending) {
+			timeout = time_until(broadcast_requested_at, STATE_BROADCAST_DELAY, now);
+			if (timeout == 0) {
+				broadcast_pending = 0;
+				broadcast = 1;
+			}
+		}
+		if (save_pending) {
+			uint32_t save_timeout = time_until(last_change_at, STATE_SAVE_DELAY, now);
+			uint32_t max_timeout = time_until(first_unsaved_change_at, STATE_SAVE_MAX_DELAY, now);
+			if (max_timeout < save_timeout) {
+				save_timeout = max_timeout;
+			}
+			if (save_timeout == 0) {
+				save_pending = 0;
+				save = 1;
+			} else if (save_timeout < timeout) {
+				timeout = save_timeout;
+			}
+		}
+		state_unlock(mask);
+
+		if (broadcast) {
+			send_state_to_clients();
+		}
+		if (save) {
+			save_state();
+		}
+		if (!broadcast && !save) {
+			osSignalWait(STATE_SIGNAL_CHANGED, timeout);
+		}
+	}
+}
+
+/**
+ * Returns the ms until `delay` has passed since `since` or 0, if it has passed already.
+ */
+static uint32_t time_until(uint32_t since, uint32_t delay, uint32_t now) {
+	uint32_t elapsed = now - since;
+	return elapsed >= delay ? 0 : delay - elapsed;
+}
+
+/**
+ * Sends a state message to all clients. Called by the state task.
+ * A message is [kind (u8)][version (u32)][body], see StateMessageKind. A full message has the raw
+ * state as body. A delta message has only the changes since the last message (with version - 1):
+ * [adc field mask (u8)][changed adc fields][count (u8)][count changed or new measurement_state_t]
+ * [count (u8)][count ids of deleted measurements]. Bit i of the mask is the i-th field of adc_state_t.
+ * Nothing is sent, if nothing changed. The next message is a full one, if this one could not be queued.
  */
 static void send_state_to_clients() {
-	send_data(SEND_TYPE_STATUS, (uint8_t*)(&state), get_state_size());
+	uint8_t current[sizeof(complete_state_t)];
+	uint8_t message[STATE_MESSAGE_MAX_SIZE];
+	uint8_t full;
+
+	UBaseType_t mask = state_lock();
+	uint16_t len = state_copy_to_buffer(current, sizeof(complete_state_t));
+	full = full_state_requested || sent_state_len == 0;
+	full_state_requested = 0;
+	state_unlock(mask);
+
+	uint16_t message_len = 0;
+	if (!full) {
+		message_len = format_state_delta(message, current);
+		if (message_len == 0) {
+			return; // Nothing changed since the last message.
+		}
+	}
+	// A full message is sent, if the delta is not smaller.
+	if (full || message_len >= STATE_MESSAGE_HEADER_SIZE + len) {
+		message[0] = STATE_MESSAGE_FULL;
+		memcpy(message + STATE_MESSAGE_HEADER_SIZE, current, len);
+		message_len = STATE_MESSAGE_HEADER_SIZE + len;
+	}
+	state_version++;
+	memcpy(message + 1, &state_version, sizeof(uint32_t));
+
+	if (send_data(SEND_TYPE_STATUS, message, message_len)) {
+		memcpy(sent_state, current, len);
+		sent_state_len = len;
+	} else {
+		full_state_requested = 1;
+	}
 }
 
 /**
- * Saves the state to the sd card.
+ * Formats the delta from sent_state to the current state into the message. Returns the length of
+ * the message or 0, if nothing changed.
  */
-static void save_state() {
-	if (osMutexWait(state_file_mutex, 0) != osOK) {
-		return; // someone else is writing the state, so it's fine..
+static uint16_t format_state_delta(uint8_t* message, const uint8_t* current) {
+	uint8_t* pos = message + STATE_MESSAGE_HEADER_SIZE;
+
+	uint8_t* mask = pos++;
+	*mask = 0;
+	for (uint8_t i = 0; i < ADC_FIELD_COUNT; i++) {
+		const uint8_t* field = current + adc_fields[i].offset;
+		if (memcmp(field, sent_state + adc_fields[i].offset, adc_fields[i].size) != 0) {
+			*mask |= 1 << i;
+			memcpy(pos, field, adc_fields[i].size);
+			pos += adc_fields[i].size;
+		}
 	}
 
-	FIL file;
-	FRESULT fres;
+	const adc_state_t* current_adc = (const adc_state_t*)current;
+	const measurement_state_t* current_measurements = (const measurement_state_t*)(current + sizeof(adc_state_t));
+	uint8_t* changed = pos++;
+	*changed = 0;
+	for (uint8_t i = 0; i < current_adc->measurement_count; i++) {
+		const measurement_state_t* m = current_measurements + i;
+		const measurement_state_t* sent = find_measurement_state(sent_state, m->id);
+		if (NULL == sent || memcmp(m, sent, sizeof(measurement_state_t)) != 0) {
+			memcpy(pos, m, sizeof(measurement_state_t));
+			pos += sizeof(measurement_state_t);
+			(*changed)++;
+		}
+	}
+
+	const adc_state_t* sent_adc = (const adc_state_t*)sent_state;
+	const measurement_state_t* sent_measurements = (const measurement_state_t*)(sent_state + sizeof(adc_state_t));
+	uint8_t* deleted = pos++;
+	*deleted = 0;
+	for (uint8_t i = 0; i < sent_adc->measurement_count; i++) {
+		if (NULL == find_measurement_state(current, sent_measurements[i].id)) {
+			*pos++ = sent_measurements[i].id;
+			(*deleted)++;
+		}
+	}
 
-	// override an existing file.
-	if ((fres = f_open(&file, STATE_FILENAME, FA_CREATE_ALWAYS | FA_WRITE)) != FR_OK) {
-		osMutexRelease(state_file_mutex);
-		return;
+	if (*mask == 0 && *changed == 0 && *deleted == 0) {
+		return 0;
+	}
+	message[0] = STATE_MESSAGE_DELTA;
+	return pos - message;
+}
+
+/**
+ * Returns the state of the measurement with the id in the given raw state or NULL.
+ */
+static const measurement_state_t* find_measurement_state(const uint8_t* state_bytes, uint8_t id) {
+	const adc_state_t* adc = (const adc_state_t*)state_bytes;
+	const measurement_state_t* measurements = (const measurement_state_t*)(state_bytes + sizeof(adc_state_t));
+	for (uint8_t i = 0; i < adc->measurement_count; i++) {
+		if (measurements[i].id == id) {
+			return measurements + i;
+		}
 	}
+	return NULL;
+}
 
+/**
+ * Saves the state to the sd card, if it differs from the saved one. Called by the state task.
+ */
+static void save_state() {
 	uint8_t buffer[sizeof(complete_state_t)];
+	UBaseType_t mask = state_lock();
 	uint16_t len = state_copy_to_buffer(buffer, sizeof(complete_state_t));
+	state_unlock(mask);
+
+	if (len == saved_state_len && memcmp(buffer, saved_state, len) == 0) {
+		return; // Nothing changed, so the card is not written.
+	}
+	if (write_state_file(buffer, len)) {
+		memcpy(saved_state, buffer, len);
+		saved_state_len = len;
+	}
+}
+
+/**
+ * Writes the state to STATE_TMP_FILENAME and renames it to STATE_FILENAME afterwards. So there is a
+ * complete state file at every time. If the power is lost between removing the old file and renaming,
+ * the temporary file is loaded on the next start. Returns 1 on success.
+ */
+static uint8_t write_state_file(uint8_t* buffer, uint16_t len) {
+	FIL file;
+	FRESULT fres;
 	unsigned int bytes_written;
 
-	// Write file
+	if ((fres = f_open(&file, STATE_TMP_FILENAME, FA_CREATE_ALWAYS | FA_WRITE)) != FR_OK) {
+		printf("error opening the state file: %d\n", fres);
+		return 0;
+	}
 	fres = f_write(&file, buffer, len, &bytes_written);
-	if (fres != FR_OK || bytes_written < len) {
-		osMutexRelease(state_file_mutex);
-		return;
+	FRESULT close_fres = f_close(&file);
+	if (fres != FR_OK || bytes_written < len || close_fres != FR_OK) {
+		printf("error writing the state file: %d\n", fres != FR_OK ? fres : close_fres);
+		return 0;
 	}
 
-	// Close it.
-	if ((fres = f_close(&file)) != FR_OK) {
-		printf("error closing file: %d\n", fres);
-		osMutexRelease(state_file_mutex);
-		return;
+	fres = f_unlink(STATE_FILENAME);
+	if (fres != FR_OK && fres != FR_NO_FILE) {
+		printf("error removing the state file: %d\n", fres);
+		return 0;
 	}
-
-	osMutexRelease(state_file_mutex);
+	if ((fres = f_rename(STATE_TMP_FILENAME, STATE_FILENAME)) != FR_OK) {
+		printf("error renaming the state file: %d\n", fres);
+		return 0;
+	}
+	return 1;
 }
 
 /**
@@ -186,6 +442,37 @@ inline void clear_slow_connection_flag() {
 	state.adc.flags.slow_connection = 0;
 }
 
+/**
+ * Sets the overload level (see OverloadLevel). Does not send any updates.
+ */
+inline void set_overload_level_flag(uint8_t level) {
+	state.adc.flags.overload = level;
+}
+
+/**
+ * Sets the recording flag. Does not send any updates.
+ */
+inline void set_recording_flag(uint8_t recording) {
+	state.adc.flags.recording = !!recording;
+}
+
+/**
+ * Sends the current state to all clients without updating or saving it. The message is sent by the
+ * state task after STATE_BROADCAST_DELAY.
+ */
+void send_state() {
+	state_changed(0);
+}
+
+/**
+ * Like send_state, but the whole state is sent instead of a delta. Needed, if a client subscribed
+ * to the state or a state message was lost.
+ */
+void send_full_state() {
+	full_state_requested = 1;
+	state_changed(0);
+}
+
 /**
  * Sets the slow_connection-flag. Does not send any updates.
  */
@@ -216,8 +503,7 @@ void init_system_from_last_state() {
 		measurements_set_to_state(&state);
 	} else {
 		printf("could not load state from SD-card!\n");
-		update_complete_state(0);
-		save_state();
+		update_complete_state(1);
 	}
 }
 
@@ -225,11 +511,22 @@ void init_system_from_last_state() {
  * to this state. 1 on successfull initialization.
  */
 static uint8_t init_last_state_from_file() {
+	if (read_state_file(STATE_FILENAME)) {
+		return 1;
+	}
+	// The power may have been lost, while the state was replaced.
+	return read_state_file(STATE_TMP_FILENAME);
+}
+
+/**
+ * Reads the state from the given file. 1 on success.
+ */
+static uint8_t read_state_file(const char* filename) {
 	FIL file;
 	FRESULT fres;
 
 	// Try to open the file
-	if ((fres = f_open(&file, STATE_FILENAME, FA_READ)) != FR_OK) {
+	if ((fres = f_open(&file, filename, FA_READ)) != FR_OK) {
 		return 0;
 	}
 
@@ -250,7 +547,13 @@ static uint8_t init_last_state_from_file() {
 	f_close(&file);
 
 	// OK. Try to set the state.
-	return set_state(buffer, bytes_read_sum);
+	if (!set_state(buffer, bytes_read_sum)) {
+		return 0;
+	}
+	// This is the content of the file, so it is not written again without a change.
+	memcpy(saved_state, buffer, bytes_read_sum);
+	saved_state_len = bytes_read_sum;
+	return 1;
 }
 
 /**
@@ -260,6 +563,25 @@ static uint8_t init_last_state_from_file() {
  * Returns 1 on success
  */
 static uint8_t set_state(uint8_t* data, uint16_t length) {
+	if (!validate_state(data, length, 0)) {
+		return 0;
+	}
+
+	// OK! Copy data into status:
+	memcpy((uint8_t*)(&state), data, length);
+	state.adc.flags.started = 0;
+	state.adc.flags.slow_connection = 0;
+	state.adc.flags.overload = 0;
+	state.adc.flags.recording = 0;
+	return 1;
+}
+
+/**
+ * Verifies the given state representation, see set_state. The runtime flags are cleared in the data.
+ * If assign_ids is given, measurements may have the id STATE_ASSIGN_ID.
+ * Returns 1, if the state is valid.
+ */
+static uint8_t validate_state(uint8_t* data, uint16_t length, uint8_t assign_ids) {
 	if (length < sizeof(adc_state_t)) {
 		return 0;
 	}
@@ -269,6 +591,8 @@ static uint8_t set_state(uint8_t* data, uint16_t length) {
 	s->flags.slow_connection = 0;
 	// s->flags.internal_reference;
 	s->flags.ADC_reset = 0;
+	s->flags.overload = 0;
+	s->flags.recording = 0;
 
 	uint8_t filter = (s->sr_filter >> 4) & 0x0F;
 	if (filter > 4) { // This filter does not exist.
@@ -298,10 +622,15 @@ static uint8_t set_state(uint8_t* data, uint16_t length) {
 		return 0;
 	}
 
+	uint8_t used_ids[MAX_MEASUREMENTS] = {0};
 	for (uint8_t i = 0; i < s->measurement_count; i++) {
 		measurement_state_t* m = (measurement_state_t*)(data + sizeof(adc_state_t) + i*sizeof(measurement_state_t));
-		if (m->id >= MAX_MEASUREMENTS) {
+		if (assign_ids && m->id == STATE_ASSIGN_ID) {
+			// The id is assigned later.
+		} else if (m->id >= MAX_MEASUREMENTS || used_ids[m->id]) {
 			return 0;
+		} else {
+			used_ids[m->id] = 1;
 		}
 		if (m->enabled > 1) {
 			return 0;
@@ -317,10 +646,85 @@ static uint8_t set_state(uint8_t* data, uint16_t length) {
 		}
 	}
 
-	// OK! Copy data into status:
+	return 1;
+}
+
+/**
+ * Gives all measurements of the valid state representation with the id STATE_ASSIGN_ID the lowest
+ * free ids.
+ */
+static void assign_measurement_ids(uint8_t* data) {
+	adc_state_t* s = (adc_state_t*) data;
+	measurement_state_t* measurements = (measurement_state_t*)(data + sizeof(adc_state_t));
+
+	uint8_t used_ids[MAX_MEASUREMENTS] = {0};
+	for (uint8_t i = 0; i < s->measurement_count; i++) {
+		if (measurements[i].id != STATE_ASSIGN_ID) {
+			used_ids[measurements[i].id] = 1;
+		}
+	}
+
+	uint8_t next_id = 0;
+	for (uint8_t i = 0; i < s->measurement_count; i++) {
+		if (measurements[i].id == STATE_ASSIGN_ID) {
+			while (used_ids[next_id]) { // There is a free id, because there are at most MAX_MEASUREMENTS.
+				next_id++;
+			}
+			measurements[i].id = next_id;
+			used_ids[next_id] = 1;
+		}
+	}
+}
+
+/**
+ * Applies a whole configuration at once. The data is a state representation like in set_state.
+ * Measurements with the id STATE_ASSIGN_ID get the lowest free ids. Everything is validated,
+ * before the ADC and the measurements are set up. Existing measurements are replaced. The state is
+ * sent and saved once. The ids of the given measurements are written in the given order to ids,
+ * which must have space for MAX_MEASUREMENTS.
+ */
+protocol_error_t state_apply_configuration(uint8_t* data, uint16_t length, uint8_t* ids, uint8_t* count) {
+	if (is_measure_active()) {
+		return RESPONSE_MEASUREMENT_ACTIVE;
+	}
+	if (is_ADC_reset_flag_set()) {
+		return RESPONSE_ADC_RESET;
+	}
+	if (!validate_state(data, length, 1)) {
+		return RESPONSE_WRONG_ARGUMENT;
+	}
+
+	adc_state_t* s = (adc_state_t*) data;
+	if (!s->flags.internal_reference) { // Same pins as for ADC_REF_SET_EXTERNAL
+		uint8_t pos = s->v_ref_inputs & 0x0F;
+		uint8_t neg = (s->v_ref_inputs >> 4) & 0x0F;
+		if (pos < 1 || pos > 5 || neg < 1 || neg > 5) {
+			return RESPONSE_WRONG_REFERENCE_PINS;
+		}
+	}
+
+	assign_measurement_ids(data);
+	measurement_state_t* measurements = (measurement_state_t*)(data + sizeof(adc_state_t));
+	*count = s->measurement_count;
+	for (uint8_t i = 0; i < s->measurement_count; i++) {
+		ids[i] = measurements[i].id;
+	}
+
+	// The runtime flags are kept. The state task must not read a half written state.
+	UBaseType_t mask = state_lock();
+	uint8_t slow_connection = state.adc.flags.slow_connection;
+	uint8_t overload = state.adc.flags.overload;
+	uint8_t recording = state.adc.flags.recording;
 	memcpy((uint8_t*)(&state), data, length);
 	state.adc.flags.started = 0;
-	state.adc.flags.slow_connection = 0;
-	return 1;
+	state.adc.flags.slow_connection = slow_connection;
+	state.adc.flags.overload = overload;
+	state.adc.flags.recording = recording;
+	state_unlock(mask);
+
+	ADS1262_set_to_state(&state);
+	measurements_set_to_state(&state);
+	update_complete_state(1);
+	return RESPONSE_OK;
 }
 
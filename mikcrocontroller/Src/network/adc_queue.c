@@ -1,9 +1,9 @@
 /*
  * queue.c
  *
- * Used to synchronize datadescriptors for all send_data tasks.
+ * Used to synchronize datadescriptors between the producers and the server task.
  *
- * Mostly from interrupts (the DRDy one) data must be inserted into the "threaded-world"
+ * Mostly from interrupts (the DRDY one) data must be inserted into the "threaded-world"
  * where we can interact with the network. This queue implementation is the connection
  * between those.
  *
@@ -11,12 +11,18 @@
  * we cannot lock it, so this queue must be safe to always put data in, even if some thread is currently
  * accessing it.
  *
- * This is done by having a "marker-head" in the queue. This is just a pointer to the current read-position
- * of the thread. If a thread reads an entry, the head advances, but the queue is not changed.
- * If an interrupt adds new data, it cleans up: It removes all entries, the marker has passed, so the thread
- * already read the data. One gotcha: This action is not allowed, if a thread is modifying the marker head.
+ * This is a bounded lock free ring (like the one of D. Vyukov): Every slot has a sequence number. A
+ * producer claims the position at the tail with a compare-and-swap, writes the object and then publishes
+ * the slot by setting its sequence to position+1 (release). The consumer reads a slot only, if it sees
+ * this sequence (acquire), claims it by moving the head and frees the slot for the producer one round
+ * later by setting the sequence to position+length. So an interrupt, that interrupts a producer between
+ * claiming and publishing, just gets the next slot, and the consumer stops at the unpublished slot.
  *
- * All marker-operations have the prefix `marker_`
+ * There is one consumer (the server task), but producers may drop the oldest entry of a full queue. So
+ * the head is claimed with a compare-and-swap, too. The atomics are LDREX/STREX on the Cortex-M7. An
+ * exception clears the exclusive monitor, so an interrupted operation just retries.
+ *
+ * The length is a power of two, so positions are masked instead of using the modulo.
  *
  *  Created on: Oct 30, 2018
  *      Author: finn
@@ -24,125 +30,134 @@
 
 
 #include "adc_queue.h"
+#include "error.h"
 
 /**
- * Returns 1, if the queue is full.
+ * Initializes the queue with the given slots. The length must be a power of two.
  */
-inline uint8_t queue_full(Queue* queue) {
-	return queue->count == queue->length;
+void queue_init(Queue* queue, QueueSlot* slots, uint32_t length) {
+	if (length == 0 || (length & (length - 1)) != 0) {
+		Error_Handler();
+	}
+	queue->slots = slots;
+	queue->mask = length - 1;
+	queue_reset(queue);
 }
 
 /**
- * Returns 1, if the queue is empty.
+ * Returns the amount of items in the queue. Claimed, but not yet published slots are counted.
+ * This is a snapshot, concurrent operations may change it immediately.
  */
-inline uint8_t queue_empty(Queue* queue) {
-	return queue->count == 0;
+inline uint32_t queue_allocated(Queue* queue) {
+	uint32_t head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+	uint32_t tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+	uint32_t count = tail - head;
+	// The head may be read before a consumer moved it and the tail after.
+	return count > queue->mask + 1 ? queue->mask + 1 : count;
 }
 
 /**
- * Returns 1, if the marker head is at the front. This means, that a thread has emptied the queue.
+ * Returns 1, if the queue is full.
  */
-inline uint8_t queue_marker_empty(Queue* queue) {
-	return (queue->head + queue->count) % queue->length == queue->marker_head;
+inline uint8_t queue_full(Queue* queue) {
+	return queue_allocated(queue) == queue->mask + 1;
 }
 
 /**
- * Returns the amount of free space in a queue
+ * Returns 1, if the queue is empty.
  */
-inline uint32_t queue_free(Queue* queue) {
-	return queue->length - queue->count;
+inline uint8_t queue_empty(Queue* queue) {
+	return queue_allocated(queue) == 0;
 }
 
 /**
- * Returns the amount of items in the queue.
+ * Returns the amount of free space in a queue
  */
-inline uint32_t queue_allocated(Queue* queue) {
-	return queue->count;
+inline uint32_t queue_free(Queue* queue) {
+	return queue->mask + 1 - queue_allocated(queue);
 }
 
 /**
  * Enqueues a new object. Returns QUEUE_ERR, if the queue is full.
- * On success QUEUE_OK is returned.
+ * On success QUEUE_OK is returned. Can be called from interrupts.
  */
 uint8_t queue_enqueue(Queue* queue, void* obj) {
-	if (queue_full(queue)) {
-		return QUEUE_ERR;
+	uint32_t pos = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+	while (1) {
+		QueueSlot* slot = queue->slots + (pos & queue->mask);
+		int32_t diff = (int32_t)(__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) - pos);
+		if (diff == 0) {
+			// The slot is free. On failure pos is updated to the current tail.
+			if (__atomic_compare_exchange_n(&queue->tail, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				slot->obj = obj;
+				__atomic_store_n(&slot->sequence, pos + 1, __ATOMIC_RELEASE);
+				return QUEUE_OK;
+			}
+		} else if (diff < 0) {
+			// The slot still holds the entry of the last round.
+			return QUEUE_ERR;
+		} else {
+			// Another producer was faster.
+			pos = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+		}
 	}
-
-	queue->Q[(queue->head + queue->count) % queue->length] = obj;
-	queue->count++;
-	return QUEUE_OK;
 }
 
 /**
- * Returns the pointer to the object at the front. Returns NULL, if the
- * queue is empty.
+ * Dequeues up to max objects at once into objs. Returns the amount of dequeued objects. Stops at the
+ * first slot, that is not published yet. Can be called from interrupts.
  */
-void* queue_dequeue(Queue* queue) {
-	if (queue_empty(queue)) {
-		return NULL;
-	}
-	void* obj = queue->Q[queue->head];
-	// If the maker head is at the normal heads position,
-	// We need to also update it.
-	if (queue->head == queue->marker_head) {
-		queue->head = (queue->head+1) % queue->length;
-		queue->marker_head = queue->head;
-	} else {
-		queue->head = (queue->head+1) % queue->length;
-	}
-	// One element less.
-	queue->count--;
-	return obj;
-}
+uint32_t queue_dequeue_batch(Queue* queue, void** objs, uint32_t max) {
+	uint32_t pos = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+	while (1) {
+		uint32_t n = 0;
+		while (n < max && __atomic_load_n(&queue->slots[(pos + n) & queue->mask].sequence, __ATOMIC_ACQUIRE) == pos + n + 1) {
+			n++;
+		}
 
-/**
- * Returns the position at the marker position. Moves the marker one position back.
- * Returns NULL, if the queue is empty. This operation modifies the queue, so
- * set `marker_updating` to 1.
- */
-void* queue_marker_dequeue(Queue* queue) {
-	queue->marker_updating = 1;
-	if (queue_marker_empty(queue)) {
-		queue->marker_updating = 0;
-		return NULL;
-	}
-	void* obj = queue->Q[queue->marker_head];
-	queue->marker_head = (queue->marker_head+1) % queue->length;
-	queue->marker_updating = 0;
-	return obj;
-}
+		if (n == 0) {
+			int32_t diff = (int32_t)(__atomic_load_n(&queue->slots[pos & queue->mask].sequence, __ATOMIC_ACQUIRE) - (pos + 1));
+			if (diff < 0) {
+				return 0; // Empty or the next slot is not published yet.
+			}
+			// Another consumer was faster.
+			pos = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+			continue;
+		}
 
-/**
- * Returns the element at the front. NULL if empty.
- */
-inline void* queue_front(Queue* queue) {
-	if (queue_empty(queue)) {
-		return NULL;
+		// The slots cannot be reused by producers until they are freed below, so they stay valid.
+		// On failure pos is updated to the current head.
+		if (__atomic_compare_exchange_n(&queue->head, &pos, pos + n, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+			for (uint32_t i = 0; i < n; i++) {
+				QueueSlot* slot = queue->slots + ((pos + i) & queue->mask);
+				objs[i] = slot->obj;
+				__atomic_store_n(&slot->sequence, pos + i + queue->mask + 1, __ATOMIC_RELEASE);
+			}
+			return n;
+		}
 	}
-	return queue->Q[queue->head];
 }
 
 /**
- * Returns the ement at the markers front. Null if empty.
+ * Returns the pointer to the object at the front. Returns NULL, if the
+ * queue is empty.
  */
-inline void* queue_marker_front(Queue* queue) {
-	if (queue_marker_empty(queue)) {
+void* queue_dequeue(Queue* queue) {
+	void* obj;
+	if (queue_dequeue_batch(queue, &obj, 1) == 0) {
 		return NULL;
 	}
-	return queue->Q[queue->marker_head];
-}
-
-/**
- * Resets the queue.
- */
-inline void queue_reset(Queue* queue) {
-	queue->head = queue->count = 0;
+	return obj;
 }
 
 /**
- * Returns 1, if the merker is currently updating.
+ * Resets the queue. Nobody else may access the queue meanwhile.
  */
-inline uint8_t queue_is_marker_updating(Queue* queue) {
-	return queue->marker_updating;
+void queue_reset(Queue* queue) {
+	for (uint32_t i = 0; i <= queue->mask; i++) {
+		queue->slots[i].sequence = i;
+		queue->slots[i].obj = NULL;
+	}
+	queue->head = queue->tail = 0;
+	__atomic_thread_fence(__ATOMIC_RELEASE);
 }
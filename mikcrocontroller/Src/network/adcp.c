@@ -14,6 +14,11 @@
 #include "string.h"
 #include "task.h"
 #include "fft.h"
+#include "udp_stream.h"
+#include "send_data.h"
+#include "benchmark.h"
+#include "overload.h"
+#include "recorder.h"
 
 #define SET_OK				out_data[0] = RESPONSE_OK; *out_len = 1;
 #define SET_RESPONSE(x)		out_data[0] = (x); *out_len = 1;
@@ -123,6 +128,59 @@ static uint8_t adcp_handle_connection_command(connection_t* connection, uint8_t*
 			return EXIT;
 		}
 		connection->send_type = data[2];
+		if (data[2] & SEND_TYPE_STATUS) {
+			send_full_state(); // The deltas need a base.
+		}
+		SET_OK;
+		break;
+	case CONNECTION_SET_SEND_POLICY:
+		if (!adcp_check_arg_len(len, 1, out_data, out_len)) {
+			return EXIT;
+		}
+		if (data[2] > SEND_POLICY_DISCONNECT) {
+			SET_RESPONSE(RESPONSE_WRONG_ARGUMENT);
+			return EXIT;
+		}
+		connection->send_policy = (SendPolicy)data[2];
+		SET_OK;
+		break;
+	case CONNECTION_SET_UDP_STREAM:
+		// 4 bytes IPv4 address, 2 bytes port, 1 byte send type.
+		if (!adcp_check_arg_len(len, 7, out_data, out_len)) {
+			return EXIT;
+		}
+		ip_addr_t destination;
+		IP4_ADDR(&destination, data[2], data[3], data[4], data[5]);
+		uint16_t port = *(uint16_t*)(data + 6);
+		if (data[8] != SEND_TYPE_NONE && (port == 0 || ip_addr_isany_val(destination))) {
+			SET_RESPONSE(RESPONSE_WRONG_ARGUMENT);
+			return EXIT;
+		}
+		if (!udp_stream_configure(&destination, port, data[8])) {
+			SET_RESPONSE(RESPONSE_NO_MEMORY);
+			return EXIT;
+		}
+		if (data[8] & SEND_TYPE_STATUS) {
+			send_full_state();
+		}
+		SET_OK;
+		break;
+	case CONNECTION_GRANT_CREDIT:
+		// 1 byte send type, 4 bytes credit. Returns the available credit.
+		if (!adcp_check_arg_len(len, 5, out_data, out_len)) {
+			return EXIT;
+		}
+		uint32_t available;
+		if (!send_data_grant_credit(connection, data[2], *(uint32_t*)(data + 3), &available)) {
+			SET_RESPONSE(RESPONSE_WRONG_ARGUMENT);
+			return EXIT;
+		}
+		SET_OK;
+		*((uint32_t*)(out_data + 1)) = available;
+		*out_len = 5;
+		break;
+	case CONNECTION_REQUEST_STATE:
+		send_full_state();
 		SET_OK;
 		break;
 	default:
@@ -138,6 +196,7 @@ static uint8_t adcp_handle_connection_command(connection_t* connection, uint8_t*
 static uint8_t adcp_handle_debugging_command(uint8_t* data, uint16_t len, uint8_t* out_data, uint16_t* out_len, uint16_t max_len) {
 	uint8_t command = data[1];
 	uint8_t exit = NOEXIT;
+	protocol_error_t err;
 
 #ifdef COMPARE_FFTS
 	uint32_t own, dsp_lib;
@@ -147,10 +206,31 @@ static uint8_t adcp_handle_debugging_command(uint8_t* data, uint16_t len, uint8_
 		*out_len = format_network_stats(out_data, max_len);
 		break;
 	case DEBUGGING_TEST_SCHEDULER:
-		SET_RESPONSE(RESPONSE_NOT_ENABLED);
+		err = benchmark_scheduler(out_data + 1, out_len, max_len - 1);
+		if (err == RESPONSE_OK) {
+			out_data[0] = RESPONSE_OK;
+			*out_len += 1;
+		} else {
+			SET_RESPONSE(err);
+		}
 		break;
 	case DEBUGGING_TEST_MEMORY_BW:
-		SET_RESPONSE(RESPONSE_NOT_ENABLED);
+		err = benchmark_memory(out_data + 1, out_len, max_len - 1);
+		if (err == RESPONSE_OK) {
+			out_data[0] = RESPONSE_OK;
+			*out_len += 1;
+		} else {
+			SET_RESPONSE(err);
+		}
+		break;
+	case DEBUGGING_TEST_SD:
+		err = benchmark_sd(out_data + 1, out_len, max_len - 1);
+		if (err == RESPONSE_OK) {
+			out_data[0] = RESPONSE_OK;
+			*out_len += 1;
+		} else {
+			SET_RESPONSE(err);
+		}
 		break;
 	case DEBUGGING_OS_STATS:
 		vTaskGetRunTimeStats((char*)out_data, max_len);
@@ -162,6 +242,18 @@ static uint8_t adcp_handle_debugging_command(uint8_t* data, uint16_t len, uint8_
 	case DEBUGGING_CONNECTION_STATS:
 		*out_len = format_connections_stats(out_data, max_len);
 		break;
+	case DEBUGGING_DROP_STATS:
+		*out_len = format_drop_stats(out_data, max_len);
+		break;
+	case DEBUGGING_MEMORY_STATS:
+		*out_len = format_memory_stats(out_data, max_len);
+		break;
+	case DEBUGGING_TX_STATS:
+		*out_len = format_tx_stats(out_data, max_len);
+		break;
+	case DEBUGGING_RECORDER_STATS:
+		*out_len = format_recorder_stats(out_data, max_len);
+		break;
 	case DEBUGGING_COMPARE_FFTS:
 #ifdef COMPARE_FFTS
 		compare_fft_algorithms(&own, &dsp_lib);
@@ -261,6 +353,26 @@ static uint8_t adcp_handle_measurement_command(uint8_t* data, uint16_t len, uint
 		*((int32_t*)(out_data + 1)) = value;
 		*out_len = 5;
 		break;
+	case MEASUREMENT_SET_OVERLOAD_POLICY: // Args: policy
+		if (!adcp_check_arg_len(len, 1, out_data, out_len)) {
+			return EXIT;
+		}
+		if (!overload_set_policy(args[0])) {
+			SET_RESPONSE(RESPONSE_WRONG_ARGUMENT);
+			return EXIT;
+		}
+		SET_OK;
+		break;
+	case MEASUREMENT_SET_RECORDING: // Args: mode, see RecorderMode. The state shows, when the recorder runs.
+		if (!adcp_check_arg_len(len, 1, out_data, out_len)) {
+			return EXIT;
+		}
+		if (!recorder_set_mode(args[0])) {
+			SET_RESPONSE(RESPONSE_WRONG_ARGUMENT);
+			return EXIT;
+		}
+		SET_OK;
+		break;
 	default:
 		adcp_send_wrong_command_response(command, out_data, out_len);
 		return EXIT;
@@ -277,6 +389,10 @@ static uint8_t adcp_handle_ADC_command(uint8_t* data, uint16_t len, uint8_t* out
 	uint8_t command = data[1];
 	uint8_t* args = data+2;
 
+	// used in the switch-case:
+	protocol_error_t err;
+	uint8_t count;
+
 	if (is_measure_active() && command != ADC_GET_STATUS) {
 		SET_RESPONSE(RESPONSE_MEASUREMENT_ACTIVE);
 		return NOEXIT;
@@ -364,6 +480,14 @@ static uint8_t adcp_handle_ADC_command(uint8_t* data, uint16_t len, uint8_t* out
 			(*out_len)++;
 		}
 		break;
+	case ADC_APPLY_CONFIGURATION: // The configuration as adc_state_t and measurement_state_t's, see state.c
+		err = state_apply_configuration(args, len - 2, out_data + 2, &count);
+		SET_RESPONSE(err);
+		if (err == RESPONSE_OK) { // Add the ids of the measurements on success.
+			out_data[1] = count;
+			*out_len = 2 + count;
+		}
+		return NOEXIT; // The state is already updated.
 	default:
 		adcp_send_wrong_command_response(command, out_data, out_len);
 		return EXIT;
@@ -7,15 +7,26 @@
 #include "connection.h"
 #include "lwip/api.h"
 #include "lwip/tcp.h"
+#include "lwip/sys.h"
 #include "network.h"
+#include "error.h"
 #include "http.h"
 #include "websocket.h"
 #include "string.h"
 #include "tcp.h"
+#include "send_data.h"
+#include "udp_stream.h"
+#include "http_cache.h"
+#include "state.h"
 
 DEFINE_POOL_IN_SECTION(connection_data_pool, MAX_CONNECTIONS, connection_data_t, ".extsram");
 
+static const char* send_policy_names[] = {"block", "drop oldest", "disconnect"};
+
 static uint8_t get_connection_type(connection_t* connection, uint8_t* data, uint16_t len);
+static uint8_t connection_receive(connection_t* connection);
+static uint8_t connection_flush(connection_t* connection);
+static uint8_t is_readable(struct netconn* conn);
 
 /**
  * Inits the connection module
@@ -27,68 +38,255 @@ void connections_init() {
 uint16_t connection_id_counter = 0;
 
 /**
- * The task for every open connection. Recieves data and processes it through ADCP.
+ * Allocates a connection for the accepted netconn. Returns NULL, if all connections are in use.
+ */
+connection_t* connection_open(struct netconn* conn) {
+	connection_t *connection = pool_alloc(connection_pool);
+	if (NULL == connection) {
+		return NULL;
+	}
+	connection->data = pool_alloc(connection_data_pool);
+	if (NULL == connection->data) { // Cannot happen: Both pools have MAX_CONNECTIONS entries.
+		Error_Handler();
+	}
+	connection->data->transfer = HTTP_TRANSFER_NONE;
+	connection->data->request_len = 0;
+	connection->last_activity = osKernelSysTick();
+	connection->id = connection_id_counter++;
+	connection->tx = NULL;
+	connection->conn = conn;
+	connection->type = CONNECTION_TYPE_UNKNOWN;
+	connection->framed = 0;
+	connection->send_type = SEND_TYPE_NONE;
+	connection->out_offset = 0;
+	connection->out_len = 0;
+	connection->closing = 0;
+	connection->error = ERR_OK;
+	send_data_connection_open(connection);
+	return connection;
+}
+
+/**
+ * Does all pending work of the connection without blocking: Writes the output buffer and queued data,
+ * continues a file transfer and handles received messages. New messages are only read, if the last
+ * response is written completely. Otherwise they stay in the receive mailbox and the TCP window closes.
+ * Returns EXIT, if the connection should be closed.
+ */
+uint8_t connection_process(connection_t* connection) {
+	if (connection->close_requested) {
+		return EXIT;
+	}
+
+	while (1) {
+		if (!connection_flush(connection)) {
+			// The send buffer is full. The server task is woken up, if there is space again.
+			break;
+		}
+		if (connection->error != ERR_OK) {
+			return EXIT;
+		}
+		if (connection->data->transfer != HTTP_TRANSFER_NONE) {
+			if (!http_continue_transfer(connection)) {
+				break;
+			}
+			continue;
+		}
+		if (connection->closing) {
+			return EXIT;
+		}
+		if (connection->type == CONNECTION_TYPE_HTTP && http_request_pending(connection)) {
+			// A pipelined request. It waited, until the last response was written.
+			if (http_handle_pending_request(connection) == EXIT) {
+				connection->closing = 1;
+			}
+			continue;
+		}
+		if (connection->type == CONNECTION_TYPE_TCP && tcp_frame_pending(connection)) {
+			// Pipelined frames. They waited for space in the output buffer.
+			if (tcp_handle_pending_frames(connection) == EXIT) {
+				connection->closing = 1;
+			}
+			continue;
+		}
+		if (!is_readable(connection->conn)) {
+			if (connection_is_idle_http(connection) &&
+					osKernelSysTick() - connection->last_activity >= HTTP_KEEP_ALIVE_TIMEOUT*1000) {
+				return EXIT;
+			}
+			break;
+		}
+		if (connection_receive(connection) == EXIT) {
+			connection->closing = 1;
+		}
+		if (connection->error != ERR_OK) {
+			return EXIT;
+		}
+	}
+	return NOEXIT;
+}
+
+/**
+ * Returns 1, if the connection is an HTTP connection, that waits for the next request.
  */
-void connection_task_function(void const *argument) {
-	uint16_t id = connection_id_counter++; // To keep track of all prints..
-	connection_t* connection = (connection_t*) argument;
+uint8_t connection_is_idle_http(connection_t* connection) {
+	return connection->type == CONNECTION_TYPE_HTTP && connection->data->transfer == HTTP_TRANSFER_NONE &&
+			connection->out_offset >= connection->out_len && !http_request_pending(connection);
+}
 
-	err_t recv_err;
+/**
+ * Returns 1, if netconn_recv will not block.
+ */
+static uint8_t is_readable(struct netconn* conn) {
+	return !sys_mbox_valid(&conn->recvmbox) || ERR_IS_FATAL(conn->last_err) ||
+			osMessageWaiting(conn->recvmbox) > 0;
+}
+
+/**
+ * Receives one message and dispatches it to the handler of the connection type.
+ * Returns EXIT, if the connection should be closed after writing the response.
+ */
+static uint8_t connection_receive(connection_t* connection) {
 	struct netbuf* recv;
 	uint8_t* data;
 	uint16_t len;
 
+	err_t recv_err = netconn_recv(connection->conn, &recv);
+	if (recv_err != ERR_OK) {
+		connection->error = recv_err;
+		return EXIT;
+	}
+	connection->last_activity = osKernelSysTick();
+
+	//connection->conn->pcb.tcp->flags |= TF_NODELAY | TF_ACK_NOW;
+	//connection->conn->pcb.tcp->flags |= TF_ACK_NOW;
+	//connection->conn->pcb.tcp->flags |= TF_ACK_DELAY;
+	connection->conn->pcb.tcp->flags |= TF_NODELAY | TF_ACK_DELAY;
+
+	// get access to the data
+	netbuf_data(recv, (void**)&data, &len);
+
 	uint8_t exit = NOEXIT;
-	while (exit == NOEXIT && (recv_err = netconn_recv(connection->conn, &recv)) == ERR_OK) {
-		osThreadYield();
-
-		osMutexWait(connection->write_mutex, osWaitForever);
-
-		//connection->conn->pcb.tcp->flags |= TF_NODELAY | TF_ACK_NOW;
-		//connection->conn->pcb.tcp->flags |= TF_ACK_NOW;
-		//connection->conn->pcb.tcp->flags |= TF_ACK_DELAY;
-		connection->conn->pcb.tcp->flags |= TF_NODELAY | TF_ACK_DELAY;
-
-		// get access to the data
-		netbuf_data(recv, (void**)&data, &len);
-
-		// If this is the first message, guess the connection type.
-		if (connection->type == CONNECTION_TYPE_UNKNOWN) {
-			if (!get_connection_type(connection, data, len)) {
-				// Could not get the type, throw http error and exit
-				char* response = "HTTP/1.1 400 Bad request"CRLF"Connection: close"CRLF"Content-Length: 34"CRLF
-						CRLF"Request too short.";
-				netconn_write(connection->conn, response, strlen(response), NETCONN_COPY);
-				exit = EXIT;
-			}
+
+	// If this is the first message, guess the connection type.
+	if (connection->type == CONNECTION_TYPE_UNKNOWN) {
+		if (!get_connection_type(connection, data, len)) {
+			// Could not get the type, throw http error and exit
+			char* response = "HTTP/1.1 400 Bad request"CRLF"Connection: close"CRLF"Content-Length: 34"CRLF
+					CRLF"Request too short.";
+			connection_write(connection, response, strlen(response));
+			exit = EXIT;
 		}
+	}
 
-		// If until everything was fine, dispatch the message.
-		if (exit == NOEXIT) {
-			switch(connection->type) {
-			case CONNECTION_TYPE_HTTP:
-				exit = handle_HTTP(connection, data, len);
-				break;
-			case CONNECTION_TYPE_WEBSOCKET:
-				exit = handle_WebSocket(connection, data, len);
-				break;
-			case CONNECTION_TYPE_TCP:
+	// If until everything was fine, dispatch the message.
+	if (exit == NOEXIT) {
+		switch(connection->type) {
+		case CONNECTION_TYPE_HTTP:
+			exit = handle_HTTP(connection, data, len);
+			break;
+		case CONNECTION_TYPE_WEBSOCKET:
+			exit = handle_WebSocket(connection, data, len);
+			break;
+		case CONNECTION_TYPE_TCP:
+			exit = handle_TCP(connection, data, len);
+			// Frames may span the fragments of the netbuf.
+			while (exit == NOEXIT && connection->framed && netbuf_next(recv) >= 0) {
+				netbuf_data(recv, (void**)&data, &len);
 				exit = handle_TCP(connection, data, len);
-				break;
-			default:
-				Error_Handler();
 			}
+			break;
+		default:
+			Error_Handler();
 		}
+	}
+
+	netbuf_delete(recv);
+	return exit;
+}
 
-		osMutexRelease(connection->write_mutex);
-		netbuf_delete(recv);
+/**
+ * Writes as much output as the TCP send buffer takes. A partially written data message must be
+ * completed first, then the output buffer is written and afterwards the queued data.
+ * Returns 1, if the output buffer is empty.
+ */
+static uint8_t connection_flush(connection_t* connection) {
+	if (send_data_is_writing(connection) && !send_data_transmit(connection)) {
+		return connection->out_offset >= connection->out_len;
+	}
+
+	if (connection->out_offset < connection->out_len) {
+		size_t written = 0;
+		err_t err = netconn_write_partly(connection->conn, connection->data->buffer + connection->out_offset,
+				connection->out_len - connection->out_offset, NETCONN_COPY | NETCONN_DONTBLOCK, &written);
+		if (err == ERR_OK) {
+			connection->out_offset += written;
+		} else if (err != ERR_WOULDBLOCK) {
+			connection->error = err;
+			connection->out_offset = connection->out_len;
+		}
+		if (connection->out_offset < connection->out_len) {
+			return 0;
+		}
 	}
+	connection->out_offset = 0;
+	connection->out_len = 0;
+
+	send_data_transmit(connection);
+	return 1;
+}
+
+/**
+ * Copies the data into the output buffer of the connection. The data is written by the server task.
+ * If the buffer is full, the data is cut.
+ */
+void connection_write(connection_t* connection, const void* data, uint16_t len) {
+	uint16_t max_len;
+	uint8_t* buffer = connection_write_begin(connection, &max_len);
+	if (len > max_len) {
+		len = max_len;
+	}
+	memcpy(buffer, data, len);
+	connection_write_end(connection, buffer, len);
+}
+
+/**
+ * Returns the free space at the end of the output buffer. So a response can be built in place.
+ * The space must be commited with connection_write_end.
+ */
+uint8_t* connection_write_begin(connection_t* connection, uint16_t* max_len) {
+	*max_len = CONNECTION_BUFFER_SIZE - connection->out_len;
+	return (uint8_t*)connection->data->buffer + connection->out_len;
+}
 
-	// Connection ended
-	if (EXIT == exit) {
+/**
+ * Commits len bytes starting at `begin` to the output buffer. `begin` must be in the space returned
+ * by connection_write_begin. Some space may be left out at the beginning, e.g. for a shorter header.
+ */
+void connection_write_end(connection_t* connection, uint8_t* begin, uint16_t len) {
+	uint8_t* tail = (uint8_t*)connection->data->buffer + connection->out_len;
+	if (begin != tail) {
+		if (connection->out_offset == connection->out_len) {
+			// Nothing to write before. Just start later.
+			connection->out_offset = connection->out_len = begin - (uint8_t*)connection->data->buffer;
+		} else {
+			memmove(tail, begin, len);
+		}
+	}
+	connection->out_len += len;
+}
+
+/**
+ * Closes the connection and frees all its resources.
+ */
+void connection_close(connection_t* connection) {
+	uint16_t id = connection->id;
+
+	if (connection->close_requested) {
+		printf("Connection %u is too slow and will be closed by the server\n", id);
+	} else if (ERR_OK == connection->error) {
 		printf("Connection %u will be closed by the server\n", id);
 	} else {
-		switch (recv_err) {
+		switch (connection->error) {
 		case ERR_ABRT:
 			printf("Connection %u aborted.\n", id);
 			break;
@@ -99,25 +297,23 @@ void connection_task_function(void const *argument) {
 			printf("Connection %u closed.\n", id);
 			break;
 		default:
-			printf("A critical connection %u error occurred: %d\n", id, recv_err);
+			printf("A critical connection %u error occurred: %d\n", id, connection->error);
 			break;
 		}
 	}
 
+	// Release the transmit queue. The send service must not write anymore.
+	send_data_connection_close(connection);
+	http_close_transfer(connection);
+
 	// Close connection and discard connection identifier.
 	netconn_close(connection->conn);
 	netconn_delete(connection->conn);
 	connection->conn = NULL;
 
-	// Clean up mutex
-	osMutexDelete(connection->write_mutex);
-	connection->write_mutex = NULL;
-
-	// terminate this thread, free the conneciton data and release connection semaphore to allow new connections.
-	osThreadId this_thread = connection->thread;
+	pool_free(connection_data_pool, connection->data);
+	connection->data = NULL;
 	pool_free(connection_pool, (void*) connection);
-	osSemaphoreRelease(connection_semaphore);
-	osThreadTerminate(this_thread);
 }
 
 /**
@@ -131,6 +327,15 @@ static uint8_t get_connection_type(connection_t* connection, uint8_t* data, uint
 	if (data[0] == CONNECT_MAGIC1 && data[1] == CONNECT_MAGIC2) {
 		connection->type = CONNECTION_TYPE_TCP;
 		connection->send_type = data[2];
+		if (data[2] & SEND_TYPE_STATUS) {
+			send_full_state(); // The deltas need a base.
+		}
+	} else if (len > TCP_FRAME_HEADER_SIZE + 2 && data[TCP_FRAME_HEADER_SIZE] == CONNECT_MAGIC1 &&
+			data[TCP_FRAME_HEADER_SIZE + 1] == CONNECT_MAGIC2) {
+		// The same message in a frame. The type is set, when the frame is handled.
+		connection->type = CONNECTION_TYPE_TCP;
+		connection->framed = 1;
+		connection->send_type = SEND_TYPE_NONE;
 	} else { // Everything else should be HTTP request. If they are not, the http module will send an error.
 		connection->type = CONNECTION_TYPE_HTTP;
 		connection->send_type = SEND_TYPE_NONE;
@@ -192,9 +397,40 @@ uint16_t format_connections_stats(uint8_t* data, uint16_t max_length) {
 			if (c->send_type & SEND_TYPE_FFT) {
 				pos += snprintf(pos, max_length - ((char*)data - pos), " FFT,");
 			}
+			if (NULL != c->tx) {
+				pos += snprintf(pos, max_length - ((char*)data - pos), " Policy %s, Queued %lu, Dropped %lu,",
+						send_policy_names[c->send_policy], send_data_get_queued(c), c->tx->dropped);
+			}
 			// Make the last comma a newline for the next loop.
 			*(pos-1) = '\n';
 		}
 	}
+	pos += format_udp_stream_stats((uint8_t*)pos, max_length - (pos - (char*)data));
+	return strlen((char*)data);
+}
+
+/**
+ * Formats the usage of the FreeRTOS heap and the connection resources into the given buffer as a
+ * string with respect to max_length. After the first connections the numbers must be stable, even
+ * if many connections are opened and closed.
+ * Returns the length of the written string (excl. null terminator)
+ */
+uint16_t format_memory_stats(uint8_t* data, uint16_t max_length) {
+	char* pos = (char*)data;
+	sys_arch_cache_stats_t cache;
+	sys_arch_get_cache_stats(&cache);
+
+	pos += snprintf(pos, max_length - (pos - (char*)data), "Heap: free %u, min. free %u\n",
+			xPortGetFreeHeapSize(), xPortGetMinimumEverFreeHeapSize());
+	pos += snprintf(pos, max_length - (pos - (char*)data), "Mailboxes and semaphores: created %lu, reused %lu, "
+			"deleted %lu, cached %lu\n", cache.created, cache.reused, cache.deleted, cache.cached);
+	pool_stats_t pool;
+	pool_get_stats(connection_pool, &pool);
+	pos += snprintf(pos, max_length - (pos - (char*)data), "Connections: used %lu, max. used %lu, opened %u, "
+			"refused %lu\n", pool.used, pool.high_watermark, connection_id_counter, pool.failures);
+	pool_get_stats(data_descriptor_pool, &pool);
+	pos += snprintf(pos, max_length - (pos - (char*)data), "Data descriptors: used %lu, max. used %lu, "
+			"allocations %lu, failures %lu\n", pool.used, pool.high_watermark, pool.allocations, pool.failures);
+	pos += format_http_cache_stats((uint8_t*)pos, max_length - (pos - (char*)data));
 	return strlen((char*)data);
 }
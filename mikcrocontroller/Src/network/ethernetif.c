@@ -76,26 +76,60 @@
 #if defined ( __ICCARM__ ) /*!< IAR Compiler */
 #pragma data_alignment=4
 #endif
-__ALIGN_BEGIN ETH_DMADescTypeDef  DMARxDscrTab[ETH_RXBUFNB] __ALIGN_END;/* Ethernet Rx MA Descriptor */
+__ALIGN_BEGIN ETH_DMADescTypeDef  DMARxDscrTab[ETH_RX_MAX_BUFFERS] __ALIGN_END;/* Ethernet Rx MA Descriptor */
 
 #if defined ( __ICCARM__ ) /*!< IAR Compiler */
 #pragma data_alignment=4
 #endif
 __ALIGN_BEGIN ETH_DMADescTypeDef  DMATxDscrTab[ETH_TXBUFNB] __ALIGN_END;/* Ethernet Tx DMA Descriptor */
 
-#if defined ( __ICCARM__ ) /*!< IAR Compiler */
-#pragma data_alignment=4
-#endif
-__ALIGN_BEGIN uint8_t Rx_Buff[ETH_RXBUFNB][ETH_RX_BUF_SIZE] __ALIGN_END; /* Ethernet Receive Buffer */
-
-#if defined ( __ICCARM__ ) /*!< IAR Compiler */
-#pragma data_alignment=4
-#endif
-__ALIGN_BEGIN uint8_t Tx_Buff[ETH_TXBUFNB][ETH_TX_BUF_SIZE] __ALIGN_END; /* Ethernet Transmit Buffer */
-
-/* Semaphore to signal incoming packets */
-osSemaphoreId RxSemaphore = NULL;
-osSemaphoreId TxSemaphore = NULL;
+// The receive buffers are allocated from the heap (see ethernetif_set_rx_buffers). Each one is aligned
+// to a cache line, so invalidating one buffer does not touch the others.
+#define ETH_RX_BUFFER_STRIDE	((ETH_RX_BUF_SIZE + 31) & ~((uint32_t)31))
+static uint8_t* Rx_Buff;
+static uint8_t rx_buffer_count = ETH_RXBUFNB; // One buffer per descriptor
+// Buffers more than descriptors. They replace the buffers of frames lent to lwIP.
+#define ETH_RX_SPARE_BUFFERS	(rx_buffer_count - rx_buffer_count / 4)
+
+// A receive buffer. A received frame is handed to lwIP in its buffer without copying and the
+// descriptor gets a spare buffer. So the descriptor goes back to the DMA at once and a frame, that
+// is not read by an application, cannot stop the DMA in the ring. The buffer becomes a spare buffer,
+// when lwIP frees the pbuf. `pc` must be the first member.
+typedef struct rx_buffer {
+	struct pbuf_custom pc;
+	uint8_t* data;
+	struct rx_buffer* next_free;
+} rx_buffer_t;
+
+static rx_buffer_t rx_buffers[2*ETH_RX_MAX_BUFFERS];
+static rx_buffer_t* rx_desc_buffers[ETH_RX_MAX_BUFFERS]; // The buffer of every descriptor
+static rx_buffer_t* rx_spare_buffers; // List of the buffers, that are neither attached nor lent
+static uint8_t rx_next; // The descriptor of the next frame
+
+// Frames are sent directly from the pbufs. These buffers are only used for frames with pbufs,
+// that cannot be given to the DMA (see is_zero_copy_possible). SRAM1 is reachable by the DMA.
+__ALIGN_BEGIN uint8_t Tx_Bounce_Buff[ETH_TX_BOUNCE_BUFFERS][ETH_TX_BUF_SIZE] __ALIGN_END __section(".sram1");
+
+// Per descriptor: The pbuf (chain) referenced until the frame is sent. Set for the last
+// descriptor of a frame. The bounce buffer used by the descriptor or -1.
+static struct pbuf* tx_pbufs[ETH_TXBUFNB];
+static int8_t tx_bounce[ETH_TXBUFNB];
+static uint8_t tx_bounce_used[ETH_TX_BOUNCE_BUFFERS];
+// The oldest descriptor given to the DMA, that was not reclaimed yet.
+static ETH_DMADescTypeDef* tx_reclaim_desc;
+static uint32_t tx_in_flight;
+// Protects the tx descriptors. Frames are sent in the tcpip thread and reclaimed there and in the interface thread.
+static osMutexId tx_mutex;
+
+ethernetif_stats_t ethernetif_stats;
+
+/* Semaphore to signal incoming packets and completed transmissions */
+osSemaphoreId InterfaceSemaphore = NULL;
+
+static void ethernetif_tx_reclaim();
+static void rx_pbuf_free(struct pbuf* p);
+static void rx_give_back(ETH_DMADescTypeDef* desc);
+static rx_buffer_t* rx_take_spare_buffer();
 
 /* Global Ethernet handle */
 ETH_HandleTypeDef heth;
@@ -171,12 +205,14 @@ void HAL_ETH_MspDeInit(ETH_HandleTypeDef* ethHandle) {
  * @retval None
  */
 void HAL_ETH_RxCpltCallback(ETH_HandleTypeDef* heth) {
-	osSemaphoreRelease(RxSemaphore);
+	osSemaphoreRelease(InterfaceSemaphore);
 }
 
+/**
+ * A frame was sent. The interface thread releases the pbufs.
+ */
 void HAL_ETH_TxCpltCallback(ETH_HandleTypeDef* heth) {
-	print_to_debugger_str("TX complete\n");
-	//osSemaphoreRelease(TxSemaphore);
+	osSemaphoreRelease(InterfaceSemaphore);
 }
 
 void HAL_ETH_ErrorCallback(ETH_HandleTypeDef* heth) {
@@ -222,11 +258,44 @@ static void low_level_init(struct netif *netif)
 		/* Set netif link flag */
 		netif->flags |= NETIF_FLAG_LINK_UP;
 	}
-	/* Initialize Tx Descriptors list: Chain Mode */
-	HAL_ETH_DMATxDescListInit(&heth, DMATxDscrTab, &Tx_Buff[0][0], ETH_TXBUFNB);
+	/* Initialize Tx Descriptors list: Chain Mode. The buffer addresses are set for every frame. */
+	HAL_ETH_DMATxDescListInit(&heth, DMATxDscrTab, &Tx_Bounce_Buff[0][0], ETH_TXBUFNB);
+	for (int i = 0; i < ETH_TXBUFNB; i++) {
+		tx_pbufs[i] = NULL;
+		tx_bounce[i] = -1;
+	}
+	for (int i = 0; i < ETH_TX_BOUNCE_BUFFERS; i++) {
+		tx_bounce_used[i] = 0;
+	}
+	tx_reclaim_desc = heth.TxDesc;
+	tx_in_flight = 0;
+	osMutexDef(tx_mutex);
+	tx_mutex = osMutexCreate(osMutex(tx_mutex));
+	if (NULL == tx_mutex) {
+		Error_Handler();
+	}
 
 	/* Initialize Rx Descriptors list: Chain Mode  */
-	HAL_ETH_DMARxDescListInit(&heth, DMARxDscrTab, &Rx_Buff[0][0], ETH_RXBUFNB);
+	uint8_t rx_buffers_total = rx_buffer_count + ETH_RX_SPARE_BUFFERS;
+	Rx_Buff = pvPortMalloc(rx_buffers_total * ETH_RX_BUFFER_STRIDE + 31);
+	if (NULL == Rx_Buff) {
+		Error_Handler();
+	}
+	Rx_Buff = (uint8_t*)(((uint32_t)Rx_Buff + 31) & ~((uint32_t)31));
+	HAL_ETH_DMARxDescListInit(&heth, DMARxDscrTab, Rx_Buff, rx_buffer_count);
+	rx_spare_buffers = NULL;
+	for (int i = 0; i < rx_buffers_total; i++) {
+		rx_buffers[i].pc.custom_free_function = rx_pbuf_free;
+		rx_buffers[i].data = Rx_Buff + i*ETH_RX_BUFFER_STRIDE;
+		if (i < rx_buffer_count) {
+			DMARxDscrTab[i].Buffer1Addr = (uint32_t)rx_buffers[i].data;
+			rx_desc_buffers[i] = rx_buffers + i;
+		} else {
+			rx_buffers[i].next_free = rx_spare_buffers;
+			rx_spare_buffers = rx_buffers + i;
+		}
+	}
+	rx_next = 0;
 
 	// enable transmit interrupt
     __HAL_ETH_DMA_ENABLE_IT(&heth, ETH_DMA_IT_T);
@@ -255,13 +324,9 @@ static void low_level_init(struct netif *netif)
 	netif->flags |= NETIF_FLAG_BROADCAST;
 #endif /* LWIP_ARP */
 
-	/* create a binary semaphore used for informing ethernetif of frame reception */
-	osSemaphoreDef(RXSEM);
-	RxSemaphore = osSemaphoreCreate(osSemaphore(RXSEM), 1);
-
-	// Finn: try do do so for transmission
-	osSemaphoreDef(TXSEM);
-	TxSemaphore = osSemaphoreCreate(osSemaphore(TXSEM), 1);
+	/* create a binary semaphore used for informing ethernetif of frame reception and transmission */
+	osSemaphoreDef(IFSEM);
+	InterfaceSemaphore = osSemaphoreCreate(osSemaphore(IFSEM), 1);
 
 	/* create the task that handles the ETH_MAC */
 	osThreadDef(EthIf, ethernetif_input, osPriorityRealtime, 0, INTERFACE_THREAD_STACK_SIZE);
@@ -284,11 +349,72 @@ static void low_level_init(struct netif *netif)
 
 }
 
+/**
+ * Checks, if the DMA can read the pbuf directly: The payload must be word aligned and in
+ * DTCM, SRAM1/2 or the external SRAM. Everything else (e.g. flash) is copied.
+ */
+static uint8_t is_zero_copy_possible(struct pbuf* q) {
+	uint32_t address = (uint32_t)q->payload;
+	if (address & 0x3) {
+		return 0;
+	}
+	return (address >= 0x20000000 && address + q->len <= 0x20050000) ||
+			(address >= 0x60000000 && address + q->len <= 0x60800000);
+}
+
+/**
+ * Writes the cache lines covering the range back to the memory. DTCM is not cached.
+ */
+static void clean_dcache_range(const void* data, uint32_t len) {
+	uint32_t address = (uint32_t)data;
+	if (address >= 0x20010000) {
+		uint32_t aligned = address & ~((uint32_t)0x1F);
+		SCB_CleanDCache_by_Addr((uint32_t*)aligned, len + (address - aligned));
+	}
+}
+
+/**
+ * Writes the cached payload back to the memory, so the DMA reads the current data.
+ */
+static void clean_dcache_for_dma(struct pbuf* q) {
+	clean_dcache_range(q->payload, q->len);
+}
+
+/**
+ * Releases pbufs and bounce buffers of all descriptors, that the DMA is done with.
+ * Must be called with the tx_mutex.
+ */
+static void ethernetif_tx_reclaim_locked() {
+	while (tx_in_flight > 0 && (tx_reclaim_desc->Status & ETH_DMATXDESC_OWN) == (uint32_t)RESET) {
+		uint32_t i = tx_reclaim_desc - DMATxDscrTab;
+		if (NULL != tx_pbufs[i]) {
+			pbuf_free(tx_pbufs[i]);
+			tx_pbufs[i] = NULL;
+		}
+		if (tx_bounce[i] >= 0) {
+			tx_bounce_used[tx_bounce[i]] = 0;
+			tx_bounce[i] = -1;
+		}
+		tx_reclaim_desc = (ETH_DMADescTypeDef*)tx_reclaim_desc->Buffer2NextDescAddr;
+		tx_in_flight--;
+	}
+}
+
+static void ethernetif_tx_reclaim() {
+	osMutexWait(tx_mutex, osWaitForever);
+	ethernetif_tx_reclaim_locked();
+	osMutexRelease(tx_mutex);
+}
+
 /**
  * This function should do the actual transmission of the packet. The packet is
  * contained in the pbuf that is passed to the function. This pbuf
  * might be chained.
  *
+ * Each pbuf gets its own descriptor pointing to the payload. The pbuf is referenced until
+ * the DMA has sent the frame. If a pbuf cannot be read by the DMA or there are not enough
+ * descriptors for the chain, the frame is copied into a bounce buffer.
+ *
  * @param netif the lwip network interface structure for this ethernetif
  * @param p the MAC packet to send (e.g. IP packet including MAC addresses and type)
  * @return ERR_OK if the packet could be sent
@@ -301,73 +427,95 @@ static void low_level_init(struct netif *netif)
  */
 static err_t low_level_output(struct netif *netif, struct pbuf *p)
 {
-	err_t errval;
+	err_t errval = ERR_OK;
 	struct pbuf *q;
-	uint8_t *buffer = (uint8_t *)(heth.TxDesc->Buffer1Addr);
-	__IO ETH_DMADescTypeDef *DmaTxDesc;
-	uint32_t framelength = 0;
-	uint32_t bufferoffset = 0;
-	uint32_t byteslefttocopy = 0;
-	uint32_t payloadoffset = 0;
-	DmaTxDesc = heth.TxDesc;
-
-	//if (osSemaphoreWait(TxSemaphore, 1000/*TIME_WAITING_FOR_INPUT*/) == osOK) {
-	/*	print_to_debugger_str("Tx sem ok\n");
-	} else {
-		Error_Handler();
-	}*/
-
-
-	/* copy frame from pbufs to driver buffers */
-	for(q = p; q != NULL; q = q->next)
-	{
-		/* Is this buffer available? If not, goto error */
-		if((DmaTxDesc->Status & ETH_DMATXDESC_OWN) != (uint32_t)RESET)
-		{
-			errval = ERR_USE;
-			goto error;
+	ETH_DMADescTypeDef *first = heth.TxDesc;
+	ETH_DMADescTypeDef *desc;
+	uint32_t descriptors = 0;
+	uint8_t zero_copy = 1;
+
+	osMutexWait(tx_mutex, osWaitForever);
+	ethernetif_tx_reclaim_locked();
+
+	for (q = p; q != NULL; q = q->next) {
+		if (q->len > 0) {
+			descriptors++;
+			if (!is_zero_copy_possible(q)) {
+				zero_copy = 0;
+			}
 		}
+	}
+	if (descriptors == 0) {
+		osMutexRelease(tx_mutex);
+		return ERR_OK;
+	}
+	if (descriptors > ETH_TXBUFNB - tx_in_flight) {
+		zero_copy = 0;
+	}
 
-		/* Get bytes in current lwIP buffer */
-		byteslefttocopy = q->len;
-		payloadoffset = 0;
-
-		/* Check if the length of data to copy is bigger than Tx buffer size*/
-		while( (byteslefttocopy + bufferoffset) > ETH_TX_BUF_SIZE )
-		{
-			/* Copy data to Tx buffer*/
-			memcpy( (uint8_t*)((uint8_t*)buffer + bufferoffset), (uint8_t*)((uint8_t*)q->payload + payloadoffset), (ETH_TX_BUF_SIZE - bufferoffset) );
-
-			/* Point to next descriptor */
-			DmaTxDesc = (ETH_DMADescTypeDef *)(DmaTxDesc->Buffer2NextDescAddr);
-
-			/* Check if the buffer is available */
-			if((DmaTxDesc->Status & ETH_DMATXDESC_OWN) != (uint32_t)RESET)
-			{
-				errval = ERR_USE;
-				goto error;
+	if (zero_copy) {
+		desc = first;
+		ETH_DMADescTypeDef *last = first;
+		for (q = p; q != NULL; q = q->next) {
+			if (q->len == 0) {
+				continue;
 			}
-
-			buffer = (uint8_t *)(DmaTxDesc->Buffer1Addr);
-
-			byteslefttocopy = byteslefttocopy - (ETH_TX_BUF_SIZE - bufferoffset);
-			payloadoffset = payloadoffset + (ETH_TX_BUF_SIZE - bufferoffset);
-			framelength = framelength + (ETH_TX_BUF_SIZE - bufferoffset);
-			bufferoffset = 0;
+			clean_dcache_for_dma(q);
+			desc->Buffer1Addr = (uint32_t)q->payload;
+			desc->ControlBufferSize = q->len & ETH_DMATXDESC_TBS1;
+			desc->Status &= ~(ETH_DMATXDESC_FS | ETH_DMATXDESC_LS | ETH_DMATXDESC_IC);
+			last = desc;
+			desc = (ETH_DMADescTypeDef*)desc->Buffer2NextDescAddr;
+		}
+		first->Status |= ETH_DMATXDESC_FS;
+		last->Status |= ETH_DMATXDESC_LS | ETH_DMATXDESC_IC;
+		tx_pbufs[last - DMATxDscrTab] = p;
+		pbuf_ref(p);
+
+		// Give the descriptors to the DMA. The first one at last, so the DMA does not start with a partial frame.
+		__DSB();
+		for (ETH_DMADescTypeDef* d = (ETH_DMADescTypeDef*)first->Buffer2NextDescAddr; d != desc;
+				d = (ETH_DMADescTypeDef*)d->Buffer2NextDescAddr) {
+			d->Status |= ETH_DMATXDESC_OWN;
+		}
+		__DSB();
+		first->Status |= ETH_DMATXDESC_OWN;
+		heth.TxDesc = desc;
+		tx_in_flight += descriptors;
+		ethernetif_stats.tx_zero_copy++;
+	} else {
+		int8_t bounce = -1;
+		for (int8_t i = 0; i < ETH_TX_BOUNCE_BUFFERS; i++) {
+			if (!tx_bounce_used[i]) {
+				bounce = i;
+				break;
+			}
+		}
+		if (tx_in_flight >= ETH_TXBUFNB || bounce < 0 || p->tot_len > ETH_TX_BUF_SIZE) {
+			errval = ERR_USE;
+			ethernetif_stats.tx_busy++;
+		} else {
+			pbuf_copy_partial(p, Tx_Bounce_Buff[bounce], p->tot_len, 0);
+			clean_dcache_range(Tx_Bounce_Buff[bounce], p->tot_len);
+			tx_bounce_used[bounce] = 1;
+			tx_bounce[first - DMATxDscrTab] = bounce;
+			first->Buffer1Addr = (uint32_t)Tx_Bounce_Buff[bounce];
+			first->ControlBufferSize = p->tot_len & ETH_DMATXDESC_TBS1;
+			first->Status |= ETH_DMATXDESC_FS | ETH_DMATXDESC_LS | ETH_DMATXDESC_IC;
+			__DSB();
+			first->Status |= ETH_DMATXDESC_OWN;
+			heth.TxDesc = (ETH_DMADescTypeDef*)first->Buffer2NextDescAddr;
+			tx_in_flight++;
+			ethernetif_stats.tx_copied++;
 		}
-
-		/* Copy the remaining bytes */
-		memcpy( (uint8_t*)((uint8_t*)buffer + bufferoffset), (uint8_t*)((uint8_t*)q->payload + payloadoffset), byteslefttocopy );
-		bufferoffset = bufferoffset + byteslefttocopy;
-		framelength = framelength + byteslefttocopy;
 	}
 
-	/* Prepare transmit descriptors to give to DMA */
-	HAL_ETH_TransmitFrame(&heth, framelength);
-
-	errval = ERR_OK;
-
-error:
+	/* When Tx Buffer unavailable flag is set: clear it and resume transmission */
+	if ((heth.Instance->DMASR & ETH_DMASR_TBUS) != (uint32_t)RESET)
+	{
+		heth.Instance->DMASR = ETH_DMASR_TBUS;
+		heth.Instance->DMATPDR = 0;
+	}
 
 	/* When Transmit Underflow flag is set, clear it and issue a Transmit Poll Demand to resume transmission */
 	if ((heth.Instance->DMASR & ETH_DMASR_TUS) != (uint32_t)RESET)
@@ -378,85 +526,32 @@ error:
 		/* Resume DMA transmission*/
 		heth.Instance->DMATPDR = 0;
 	}
+	osMutexRelease(tx_mutex);
 	return errval;
 }
 
 /**
- * Should allocate a pbuf and transfer the bytes of the incoming
- * packet from the interface into the pbuf.
- *
- * @param netif the lwip network interface structure for this ethernetif
- * @return a pbuf filled with the received packet (including MAC header)
- *         NULL on memory error
+ * Sets the number of receive buffers. Must be called before the interface is initialized.
  */
-static struct pbuf * low_level_input(struct netif *netif)
-{
-	struct pbuf *p = NULL;
-	struct pbuf *q = NULL;
-	uint16_t len = 0;
-	uint8_t *buffer;
-	__IO ETH_DMADescTypeDef *dmarxdesc;
-	uint32_t bufferoffset = 0;
-	uint32_t payloadoffset = 0;
-	uint32_t byteslefttocopy = 0;
-	uint32_t i=0;
-
-
-	/* get received frame */
-	if (HAL_ETH_GetReceivedFrame_IT(&heth) != HAL_OK)
-		return NULL;
-
-	/* Obtain the size of the packet and put it into the "len" variable. */
-	len = heth.RxFrameInfos.length;
-	buffer = (uint8_t *)heth.RxFrameInfos.buffer;
-
-	if (len > 0)
-	{
-		/* We allocate a pbuf chain of pbufs from the Lwip buffer pool */
-		p = pbuf_alloc(PBUF_RAW, len, PBUF_POOL);
-	}
-
-	if (p != NULL)
-	{
-		dmarxdesc = heth.RxFrameInfos.FSRxDesc;
-		bufferoffset = 0;
-		for(q = p; q != NULL; q = q->next)
-		{
-			byteslefttocopy = q->len;
-			payloadoffset = 0;
-
-			/* Check if the length of bytes to copy in current pbuf is bigger than Rx buffer size*/
-			while( (byteslefttocopy + bufferoffset) > ETH_RX_BUF_SIZE )
-			{
-				/* Copy data to pbuf */
-				memcpy( (uint8_t*)((uint8_t*)q->payload + payloadoffset), (uint8_t*)((uint8_t*)buffer + bufferoffset), (ETH_RX_BUF_SIZE - bufferoffset));
-
-				/* Point to next descriptor */
-				dmarxdesc = (ETH_DMADescTypeDef *)(dmarxdesc->Buffer2NextDescAddr);
-				buffer = (uint8_t *)(dmarxdesc->Buffer1Addr);
-
-				byteslefttocopy = byteslefttocopy - (ETH_RX_BUF_SIZE - bufferoffset);
-				payloadoffset = payloadoffset + (ETH_RX_BUF_SIZE - bufferoffset);
-				bufferoffset = 0;
-			}
-			/* Copy remaining data in pbuf */
-			memcpy( (uint8_t*)((uint8_t*)q->payload + payloadoffset), (uint8_t*)((uint8_t*)buffer + bufferoffset), byteslefttocopy);
-			bufferoffset = bufferoffset + byteslefttocopy;
-		}
-	}
-
-	/* Release descriptors to DMA */
-	/* Point to first descriptor */
-	dmarxdesc = heth.RxFrameInfos.FSRxDesc;
-	/* Set Own bit in Rx descriptors: gives the buffers back to DMA */
-	for (i=0; i< heth.RxFrameInfos.SegCount; i++)
-	{
-		dmarxdesc->Status |= ETH_DMARXDESC_OWN;
-		dmarxdesc = (ETH_DMADescTypeDef *)(dmarxdesc->Buffer2NextDescAddr);
+void ethernetif_set_rx_buffers(uint8_t count) {
+	if (count < ETH_RX_MIN_BUFFERS) {
+		count = ETH_RX_MIN_BUFFERS;
+	} else if (count > ETH_RX_MAX_BUFFERS) {
+		count = ETH_RX_MAX_BUFFERS;
 	}
+	rx_buffer_count = count;
+}
 
-	/* Clear Segment_Count */
-	heth.RxFrameInfos.SegCount =0;
+/**
+ * Gives the descriptor back to the DMA and resumes the reception, if it was suspended
+ * because no descriptor was left.
+ */
+static void rx_give_back(ETH_DMADescTypeDef* desc) {
+	// lwIP may have written into a lent buffer (e.g. an ICMP echo reply). These dirty lines
+	// must not be evicted over the next frame.
+	SCB_InvalidateDCache_by_Addr((uint32_t*)desc->Buffer1Addr, ETH_RX_BUFFER_STRIDE);
+	desc->Status = ETH_DMARXDESC_OWN;
+	__DSB();
 
 	/* When Rx Buffer unavailable flag is set: clear it and resume reception */
 	if ((heth.Instance->DMASR & ETH_DMASR_RBUS) != (uint32_t)RESET)
@@ -466,7 +561,94 @@ static struct pbuf * low_level_input(struct netif *netif)
 		/* Resume DMA reception */
 		heth.Instance->DMARPDR = 0;
 	}
-	return p;
+}
+
+/**
+ * Called by lwIP, when a zero-copy frame is not used anymore. The buffer becomes a spare buffer.
+ */
+static void rx_pbuf_free(struct pbuf* p) {
+	SYS_ARCH_DECL_PROTECT(old_level);
+	rx_buffer_t* rx = (rx_buffer_t*)p;
+
+	SYS_ARCH_PROTECT(old_level);
+	rx->next_free = rx_spare_buffers;
+	rx_spare_buffers = rx;
+	SYS_ARCH_UNPROTECT(old_level);
+}
+
+/**
+ * Returns a spare buffer or NULL, if lwIP holds all of them.
+ */
+static rx_buffer_t* rx_take_spare_buffer() {
+	SYS_ARCH_DECL_PROTECT(old_level);
+	SYS_ARCH_PROTECT(old_level);
+	rx_buffer_t* rx = rx_spare_buffers;
+	if (NULL != rx) {
+		rx_spare_buffers = rx->next_free;
+	}
+	SYS_ARCH_UNPROTECT(old_level);
+	return rx;
+}
+
+/**
+ * Returns the next received frame or NULL. The frame is passed in a custom pbuf pointing
+ * to its buffer and the descriptor gets a spare buffer. Only if there is no spare buffer,
+ * the frame is copied into a pbuf from the pool. In both cases the descriptor is given back
+ * immediately.
+ *
+ * @param netif the lwip network interface structure for this ethernetif
+ * @return a pbuf filled with the received packet (including MAC header)
+ *         NULL, if there are no more frames
+ */
+static struct pbuf * low_level_input(struct netif *netif)
+{
+	struct pbuf *p;
+
+	for (;;) {
+		uint8_t index = rx_next;
+		ETH_DMADescTypeDef* desc = DMARxDscrTab + index;
+		uint32_t status = desc->Status;
+		if ((status & ETH_DMARXDESC_OWN) != (uint32_t)RESET) {
+			return NULL;
+		}
+		rx_next = (rx_next + 1) % rx_buffer_count;
+
+		// The buffers can hold every frame, so a frame has exactly one descriptor.
+		if ((status & (ETH_DMARXDESC_FS | ETH_DMARXDESC_LS)) != (ETH_DMARXDESC_FS | ETH_DMARXDESC_LS) ||
+				(status & ETH_DMARXDESC_ES) != (uint32_t)RESET) {
+			ethernetif_stats.rx_dropped++;
+			rx_give_back(desc);
+			continue;
+		}
+
+		/* Obtain the size of the packet without the CRC. */
+		uint16_t len = ((status & ETH_DMARXDESC_FL) >> ETH_DMARXDESC_FRAMELENGTHSHIFT) - 4;
+		rx_buffer_t* rx = rx_desc_buffers[index];
+		uint8_t* buffer = rx->data;
+		SCB_InvalidateDCache_by_Addr((uint32_t*)buffer, ETH_RX_BUFFER_STRIDE);
+
+		rx_buffer_t* spare = rx_take_spare_buffer();
+		if (NULL != spare) {
+			rx_desc_buffers[index] = spare;
+			desc->Buffer1Addr = (uint32_t)spare->data;
+			rx_give_back(desc);
+			p = pbuf_alloced_custom(PBUF_RAW, len, PBUF_REF, &rx->pc, buffer, ETH_RX_BUF_SIZE);
+			ethernetif_stats.rx_zero_copy++;
+			return p;
+		}
+
+		p = pbuf_alloc(PBUF_RAW, len, PBUF_POOL);
+		if (p != NULL) {
+			pbuf_take(p, buffer, len);
+			ethernetif_stats.rx_copied++;
+		} else {
+			ethernetif_stats.rx_dropped++;
+		}
+		rx_give_back(desc);
+		if (p != NULL) {
+			return p;
+		}
+	}
 }
 
 /**
@@ -484,7 +666,8 @@ void ethernetif_input( void const * argument )
 	struct netif *netif = (struct netif *) argument;
 
 	for( ;; ) {
-		if (osSemaphoreWait(RxSemaphore, TIME_WAITING_FOR_INPUT) == osOK) {
+		if (osSemaphoreWait(InterfaceSemaphore, TIME_WAITING_FOR_INPUT) == osOK) {
+			ethernetif_tx_reclaim();
 			do {
 				p = low_level_input( netif );
 				if (p != NULL) {
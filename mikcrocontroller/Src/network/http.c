@@ -1,40 +1,74 @@
 /*
  * http.c
  *
+ * Serves the webpage. Files are delivered from the cache (see http_cache.c) with ETags, so browsers
+ * can revalidate them (304 Not Modified). Files, that are not cached, are read from the SD card.
+ *
+ * Connections are kept alive, so a browser loads all files over a few connections. Received bytes are
+ * collected in the request buffer of the connection. One request is handled at a time: The next
+ * (pipelined) request is handled, when the response is completely written (see connection_process).
+ * Idle connections are closed after HTTP_KEEP_ALIVE_TIMEOUT.
+ *
+ * Files below HTTP_FILES_ROOT (e.g. recordings) are downloaded from HTTP_FILES_ROUTE. A single byte
+ * range can be requested, so interrupted downloads can be resumed. A directory is answered with a
+ * listing of its entries.
+ *
  *  Created on: Oct 13, 2018
  *      Author: finn
  */
 #include "http.h"
 #include "lwip/api.h"
 #include "string.h"
+#include "stdlib.h"
 #include "fatfs.h"
 #include "connection.h"
 #include "websocket.h"
 #include "utils.h"
+#include "http_cache.h"
+#include "shaper.h"
+#include "stdio.h"
 
 static void parse_header(char* header_begin, char* header_end, request_headers_t* headers);
-static void get_mime_type(char* filename, char* mime_type);
-static uint8_t deliver_resource(connection_t* connection, char* resource);
+static void get_mime_type(const char* filename, char* mime_type);
+static uint8_t deliver_resource(connection_t* connection, char* resource, request_headers_t* headers,
+		uint8_t keep_alive);
+static uint8_t deliver_cached_resource(connection_t* connection, const http_cache_entry_t* entry,
+		request_headers_t* headers, uint8_t keep_alive);
+static uint8_t continue_cached_transfer(connection_t* connection);
+static uint8_t deliver_data_file(connection_t* connection, const char* path, request_headers_t* headers,
+		uint8_t keep_alive);
+static uint8_t deliver_directory_listing(connection_t* connection, uint8_t keep_alive);
+static uint8_t parse_range(const char* value, uint32_t size, uint32_t* first, uint32_t* len);
+static uint8_t handle_request(connection_t* connection, char* data);
+static const char* connection_header(uint8_t keep_alive);
+static uint8_t has_gzip_variant(const char* filename);
 static void send_error(connection_t* connection, char* message, uint16_t statuscode, char* file, int line);
 
 #define _SEND_ERROR(conn, msg, code)			send_error((conn), (msg), (code), __FILE__, __LINE__)
 #define SERVER_ERROR(conn, msg)					_SEND_ERROR((conn), (msg), 500)
 #define BAD_REQUEST_ERROR(conn, msg)			_SEND_ERROR((conn), (msg), 400)
+#define NOT_FOUND_ERROR(conn, msg)				_SEND_ERROR((conn), (msg), 404)
 #define METHOD_NOT_ALLOWED_ERROR(conn, msg)		_SEND_ERROR((conn), (msg), 405)
 #define REQUEST_URL_TOO_LONG_ERROR(conn, msg)	_SEND_ERROR((conn), (msg), 414)
+#define NOT_ACCEPTABLE_ERROR(conn, msg)			_SEND_ERROR((conn), (msg), 406)
 #define IM_A_TEAPOT_ERROR(conn, msg)			_SEND_ERROR((conn), (msg), 418)
 
-volatile uint8_t http_permitted = 1;
+// Results of parse_range
+#define RANGE_NONE				0 // No (supported) range. The whole file is sent.
+#define RANGE_OK				1
+#define RANGE_NOT_SATISFIABLE	2
+
+// A file, that exists only as `<name>.gz`, is not sent to clients without gzip support.
+#define GZIP_ONLY_MESSAGE		"The file is only available gzip encoded."
 
-// Lock access to the state-file on the SD-card.
-static osMutexId http_resource_mutex;
+#define _STR(x)	#x
+#define STR(x)	_STR(x)
 
 /**
  * Initialize this module.
  */
 void http_init() {
-	osMutexDef(httpResourceMutex);
-	http_resource_mutex = osMutexCreate(osMutex(httpResourceMutex));
+	http_cache_init();
 }
 
 // HTTP request:
@@ -45,16 +79,56 @@ void http_init() {
 // CRLF
 // <payload>
 
-uint8_t handle_HTTP(connection_t* connection, uint8_t* _data, uint16_t len) {
-	char* data = (char*) _data;
+/**
+ * Appends the received data to the request buffer of the connection and handles the first request,
+ * if it is complete.
+ */
+uint8_t handle_HTTP(connection_t* connection, uint8_t* data, uint16_t len) {
+	connection_data_t* d = connection->data;
+	if (len > CONNECTION_REQUEST_BUFFER_SIZE - 1 - d->request_len) {
+		d->request_len = 0;
+		BAD_REQUEST_ERROR(connection, "The request is too large.");
+		return EXIT;
+	}
+	memcpy(d->request + d->request_len, data, len);
+	d->request_len += len;
+	d->request[d->request_len] = 0;
+	return http_handle_pending_request(connection);
+}
+
+/**
+ * Returns 1, if a complete request waits in the request buffer of the connection.
+ */
+uint8_t http_request_pending(connection_t* connection) {
+	connection_data_t* d = connection->data;
+	return d->request_len > 0 && NULL != strstr(d->request, CRLF""CRLF);
+}
 
-	/*if (data[len-1] != 0) {
-		data[len-1] = 0;
-	}*/
-	if (data[len] != 0) {
-		data[len] = 0;
+/**
+ * Handles the first request of the request buffer, if it is complete, and removes it from the buffer.
+ * Requests have no body (only GET is allowed).
+ */
+uint8_t http_handle_pending_request(connection_t* connection) {
+	connection_data_t* d = connection->data;
+	char* end = strstr(d->request, CRLF""CRLF);
+	if (NULL == end) {
+		return NOEXIT; // Wait for the rest.
 	}
+	uint16_t request_len = end + 4 - d->request;
+
+	uint8_t exit = handle_request(connection, d->request);
 
+	d->request_len -= request_len;
+	memmove(d->request, d->request + request_len, d->request_len);
+	d->request[d->request_len] = 0;
+	return exit;
+}
+
+/**
+ * Handles one request. The request is null terminated after the headers.
+ * Returns EXIT, if the connection should be closed after the response.
+ */
+static uint8_t handle_request(connection_t* connection, char* data) {
 	if (strncmp(data, "GET", 3) != 0) {
 		METHOD_NOT_ALLOWED_ERROR(connection, "Just GET requests are valid.");
 		return EXIT;
@@ -96,8 +170,6 @@ uint8_t handle_HTTP(connection_t* connection, uint8_t* _data, uint16_t len) {
 		return EXIT;
 	}
 
-	printf("\nGet request. Resource: %s, protocol: %s\n", resource, protocol);
-
 	// Headers, we are searching values for. If some headers are not given, the pointers will be NULL.
 	request_headers_t headers = {0};
 	char* header_begin = crlf+2; // Skip CRLF
@@ -106,6 +178,7 @@ uint8_t handle_HTTP(connection_t* connection, uint8_t* _data, uint16_t len) {
 		char* header_end = strstr(header_begin, CRLF);
 		if (NULL == header_end) {
 			BAD_REQUEST_ERROR(connection, "The headers are malformed");
+			return EXIT;
 		}
 
 		if (header_end - header_begin <= 0) {
@@ -118,27 +191,45 @@ uint8_t handle_HTTP(connection_t* connection, uint8_t* _data, uint16_t len) {
 		header_begin = header_end + 2; // Skip CRLF
 	} while (1);
 
-	// Note: Here may be content, but we do not need it..
+	// HTTP/1.1 connections are persistent, if the client does not want to close it.
+	uint8_t keep_alive = NULL == headers.connection || strcicmp(headers.connection, "close") != 0;
 
 	// Catch special routes. Deliver the requested resource per default.
-	// Always exit, to keep browser from blocking connections..
 	uint8_t exit = EXIT;
 	if (strcmp(resource, "/ws") == 0) {
 		if (websocket_handshake(connection, &headers)) {
 			connection->type = CONNECTION_TYPE_WEBSOCKET;
+			connection->send_policy = SEND_POLICY_DROP_OLDEST; // A slow browser must not stop a measurement.
 			exit = NOEXIT;
 		} else {
 			BAD_REQUEST_ERROR(connection, "The given headers are malformed.");
 		}
+	} else if (strncmp(resource, HTTP_FILES_ROUTE, strlen(HTTP_FILES_ROUTE)) == 0 &&
+			(resource[strlen(HTTP_FILES_ROUTE)] == 0 || resource[strlen(HTTP_FILES_ROUTE)] == '/')) {
+		exit = deliver_data_file(connection, resource + strlen(HTTP_FILES_ROUTE), &headers, keep_alive);
+		if (!keep_alive) {
+			exit = EXIT;
+		}
 	} else if (strcmp(resource, "/brew-coffee") == 0) {
 		IM_A_TEAPOT_ERROR(connection, "I'm not able to brew coffee, tea is preferred. Can you bring me some?");
 	} else {
-		deliver_resource(connection, resource);
+		exit = deliver_resource(connection, resource, &headers, keep_alive);
+		if (!keep_alive) {
+			exit = EXIT;
+		}
 	}
 
 	return exit;
 }
 
+/**
+ * Returns the Connection header for a response.
+ */
+static const char* connection_header(uint8_t keep_alive) {
+	return keep_alive ? "Connection: keep-alive"CRLF"Keep-Alive: timeout="STR(HTTP_KEEP_ALIVE_TIMEOUT)""CRLF :
+			"Connection: close"CRLF;
+}
+
 /**
  * Parses one header line. The structure should be <key: "value">, with optional whitespaces
  * (maybe multiple) after the colon. Assign the raw value (with trimmed whitespaces to the header
@@ -180,45 +271,65 @@ static void parse_header(char* header_begin, char* header_end, request_headers_t
 		headers->sec_websocket_version = value;
 	} else if (strcicmp(header_begin, "origin") == 0) {
 		headers->origin = value;
+	} else if (strcicmp(header_begin, "accept-encoding") == 0) {
+		headers->accept_encoding = value;
+	} else if (strcicmp(header_begin, "if-none-match") == 0) {
+		headers->if_none_match = value;
+	} else if (strcicmp(header_begin, "range") == 0) {
+		headers->range = value;
 	}
 }
 
 /**
  * Delivers the requested resource to the connection.
- * Tries to open the existing file. If it is a path, or a non existing file, the index.html
- * is deliverd. If any other error occurs, or the index.html is not found, an error will be send.
+ * Looks for the file in the cache first. Otherwise tries to open the existing file. If it is a path,
+ * or a non existing file, the index.html is deliverd. If the file exists only as `<name>.gz` and
+ * the client does not accept gzip, 406 Not Acceptable is sent. Files read from the SD card are never
+ * sent precompressed. If any other error occurs, or the index.html is not found, an error will be send.
+ * The response header is written and the file is transferred by http_continue_transfer.
  * Returns EXIT on failure, NOEXIT on success.
  */
-static uint8_t deliver_resource(connection_t* connection, char* resource) {
-	// Try to get some memory
-	connection_data_t* data_buffer = (connection_data_t*) pool_alloc(connection_data_pool);
-	if (NULL == data_buffer) {
-		SERVER_ERROR(connection, "No memory for data_buffer.");
+static uint8_t deliver_resource(connection_t* connection, char* resource, request_headers_t* headers,
+		uint8_t keep_alive) {
+	connection_data_t* data = connection->data;
+
+	const char* name = strcmp(resource, "/") == 0 ? "/index.html" : resource;
+	uint8_t accept_gzip = NULL != headers->accept_encoding && NULL != strstr(headers->accept_encoding, "gzip");
+	const http_cache_entry_t* entry = http_cache_find(name, accept_gzip);
+	if (NULL == entry && http_cache_contains(name)) {
+		NOT_ACCEPTABLE_ERROR(connection, GZIP_ONLY_MESSAGE);
 		return EXIT;
 	}
+	if (NULL == entry && http_cache_is_complete()) {
+		// The file does not exist. It is a route of the webpage.
+		entry = http_cache_find("/index.html", accept_gzip);
+	}
+	if (NULL != entry) {
+		return deliver_cached_resource(connection, entry, headers, keep_alive);
+	}
 
 	// Format the filename
 	if (strlen(resource) == 1 && resource[0] == '/') {
-		strcpy(data_buffer->filename, "0:/www/index.html");
+		strcpy(data->filename, "0:/www/index.html");
 	} else if (resource[0] == '/') {
-		sprintf(data_buffer->filename, "0:/www%s", resource);
+		sprintf(data->filename, "0:/www%s", resource);
 	} else {
-		sprintf(data_buffer->filename, "0:/www/%s", resource);
+		sprintf(data->filename, "0:/www/%s", resource);
 	}
 
-	osMutexWait(http_resource_mutex, osWaitForever);
-
 	uint8_t exit = NOEXIT;
-	FIL file;
 	FRESULT fres;
 
 	// Try to open the file
-	if ((fres = f_open(&file, data_buffer->filename, FA_READ)) != FR_OK) {
+	if ((fres = f_open(&data->file, data->filename, FA_READ)) != FR_OK) {
 		char error_buffer[32];
-		if (fres == FR_NO_FILE || fres == FR_NO_PATH || fres == FR_INVALID_NAME) {
+		if (fres == FR_NO_FILE && has_gzip_variant(data->filename)) {
+			NOT_ACCEPTABLE_ERROR(connection, GZIP_ONLY_MESSAGE);
+			exit = EXIT;
+		} else if (fres == FR_NO_FILE || fres == FR_NO_PATH || fres == FR_INVALID_NAME) {
 			// file was not found or is a directory. Send index.html instead.
-			strcpy(data_buffer->filename, "0:/www/index.html");
-			if ((fres = f_open(&file, data_buffer->filename, FA_READ)) != FR_OK) {
+			strcpy(data->filename, "0:/www/index.html");
+			if ((fres = f_open(&data->file, data->filename, FA_READ)) != FR_OK) {
 				snprintf(error_buffer, sizeof(error_buffer), "File open error: %d", fres);
 				SERVER_ERROR(connection, error_buffer);
 				exit = EXIT;
@@ -230,87 +341,330 @@ static uint8_t deliver_resource(connection_t* connection, char* resource) {
 		}
 	}
 
-	// Continue, if the file was opened.
+	// Continue, if the file was opened. FatFs locks the volume itself (_FS_REENTRANT), so every
+	// connection reads its own file without a global lock.
 	if (NOEXIT == exit) {
-		uint32_t filesize = f_size(&file);
-		printf("openend %s, size: %lu\n", data_buffer->filename, filesize);
+		uint32_t filesize = f_size(&data->file);
 
 		// Get the MIME type.
 		char mime_type[25]; // application/octet-stream is the longest with 24+1 chars.
-		get_mime_type(data_buffer->filename, mime_type);
+		get_mime_type(data->filename, mime_type);
 
 		// Write response header.
-		char response[128]; // The sing below are about 80 chars. With mime-type max 104, so about 20 chars for the
-		// filesize should be enough.
+		char response[192];
 		int response_len = snprintf(response, sizeof(response),
-				"HTTP/1.1 200 OK"CRLF"Connection: Close"CRLF"Content-Type: %s"CRLF"Content-Length: %lu"CRLF""CRLF,
-				mime_type, filesize);
-		netconn_write(connection->conn, response, response_len, NETCONN_COPY);
-
-		// Read file.
-		unsigned int bytes_read;
-		// Time the reading and sending
-		uint64_t start = measure_reference_timer_ticks;
-		uint8_t first = 1;
-
-		// Read in 64K blocks. The last iteration might send less data.
-		while (1) {
-			// Wait to read.
-			while (!http_permitted) {
-				osDelay(10);
-			}
-			fres = f_read(&file, data_buffer->buffer, sizeof data_buffer->buffer, &bytes_read);
-			if (fres != FR_OK || bytes_read == 0) {
-				break; // eof
-			}
-			printf("bytes read: %u\n", bytes_read);
+				"HTTP/1.1 200 OK"CRLF"%sContent-Type: %s"CRLF"Content-Length: %lu"CRLF""CRLF,
+				connection_header(keep_alive), mime_type, filesize);
+		connection_write(connection, response, response_len);
+		data->file_remaining = filesize;
+		data->transfer = HTTP_TRANSFER_FILE;
+	}
 
-			if (first) {
-				first = 0;
-				char* b = data_buffer->buffer;
-				printf("first 8 bytes: %c %c %c %c %c %c %c %c\n", b[0], b[1], b[2], b[3], b[4], b[5], b[6], b[7]);
-			}
+	return exit;
+}
+
+/**
+ * Returns 1, if `<filename>.gz` exists on the SD card.
+ */
+static uint8_t has_gzip_variant(const char* filename) {
+	char gzip_filename[sizeof(((connection_data_t*)0)->filename) + 3];
+	snprintf(gzip_filename, sizeof(gzip_filename), "%s.gz", filename);
+	return f_stat(gzip_filename, NULL) == FR_OK;
+}
+
+/**
+ * Delivers a file below HTTP_FILES_ROOT. `path` is the part of the resource after HTTP_FILES_ROUTE.
+ * If a single byte range is requested, just this range is sent (206 Partial Content). A directory
+ * is answered with a listing of its entries.
+ * Returns EXIT on failure, NOEXIT on success.
+ */
+static uint8_t deliver_data_file(connection_t* connection, const char* path, request_headers_t* headers,
+		uint8_t keep_alive) {
+	connection_data_t* data = connection->data;
+	snprintf(data->filename, sizeof(data->filename), HTTP_FILES_ROOT"%s", path);
+	size_t filename_len = strlen(data->filename);
+	if (data->filename[filename_len - 1] == '/') {
+		data->filename[filename_len - 1] = 0;
+	}
+
+	FRESULT fres = f_open(&data->file, data->filename, FA_READ);
+	if (fres == FR_NO_FILE) {
+		// Maybe a directory.
+		return deliver_directory_listing(connection, keep_alive);
+	} else if (fres == FR_NO_PATH || fres == FR_INVALID_NAME) {
+		NOT_FOUND_ERROR(connection, "The file does not exist.");
+		return EXIT;
+	} else if (fres != FR_OK) {
+		char error_buffer[32];
+		snprintf(error_buffer, sizeof(error_buffer), "File open error: %d", fres);
+		SERVER_ERROR(connection, error_buffer);
+		return EXIT;
+	}
+
+	uint32_t filesize = f_size(&data->file);
+	uint32_t first = 0;
+	uint32_t len = filesize;
+	uint8_t range = NULL == headers->range ? RANGE_NONE : parse_range(headers->range, filesize, &first, &len);
+
+	char response[256];
+	int response_len;
+	if (range == RANGE_NOT_SATISFIABLE) {
+		f_close(&data->file);
+		response_len = snprintf(response, sizeof(response), "HTTP/1.1 416 Range Not Satisfiable"CRLF"%s"
+				"Content-Range: bytes */%lu"CRLF"Content-Length: 0"CRLF""CRLF,
+				connection_header(keep_alive), filesize);
+		connection_write(connection, response, response_len);
+		return NOEXIT;
+	}
+
+	if (first > 0 && (fres = f_lseek(&data->file, first)) != FR_OK) {
+		f_close(&data->file);
+		char error_buffer[32];
+		snprintf(error_buffer, sizeof(error_buffer), "File seek error: %d", fres);
+		SERVER_ERROR(connection, error_buffer);
+		return EXIT;
+	}
+
+	if (range == RANGE_OK) {
+		response_len = snprintf(response, sizeof(response), "HTTP/1.1 206 Partial Content"CRLF"%s"
+				"Content-Type: application/octet-stream"CRLF"Content-Length: %lu"CRLF
+				"Content-Range: bytes %lu-%lu/%lu"CRLF"Accept-Ranges: bytes"CRLF""CRLF,
+				connection_header(keep_alive), len, first, first + len - 1, filesize);
+	} else {
+		response_len = snprintf(response, sizeof(response), "HTTP/1.1 200 OK"CRLF"%s"
+				"Content-Type: application/octet-stream"CRLF"Content-Length: %lu"CRLF
+				"Accept-Ranges: bytes"CRLF""CRLF, connection_header(keep_alive), len);
+	}
+	connection_write(connection, response, response_len);
+	data->file_remaining = len;
+	data->transfer = HTTP_TRANSFER_FILE;
+	return NOEXIT;
+}
+
+/**
+ * Answers with the entries of the directory `filename` as plain text, one line per entry:
+ * <name>\t<size>. Names of directories end with a slash. The listing is written behind some space
+ * for the header into the output buffer, so the header with the Content-Length is put just before
+ * it afterwards. Entries, that do not fit into the output buffer, are left out.
+ * Returns EXIT on failure, NOEXIT on success.
+ */
+static uint8_t deliver_directory_listing(connection_t* connection, uint8_t keep_alive) {
+	static DIR dir; // Only used by the server task.
+	static FILINFO info;
+	connection_data_t* data = connection->data;
+
+	FRESULT fres = f_opendir(&dir, data->filename);
+	if (fres != FR_OK) {
+		NOT_FOUND_ERROR(connection, "The file does not exist.");
+		return EXIT;
+	}
 
-			// Send the 64K in 16K chunks..
-			unsigned int bytes_to_send = bytes_read;
-			char *bytes_to_send_position = data_buffer->buffer;
-			const unsigned int blocksize = 16384;
-
-			while (bytes_to_send > blocksize) {
-				// Wait between sucessive transmissions, if http is blocked.
-				while (!http_permitted) {
-					osDelay(10);
-				}
-				netconn_write(connection->conn, bytes_to_send_position, blocksize, NETCONN_COPY);
-				// printf("bytes send: %u\n", blocksize);
-				bytes_to_send -= blocksize;
-				bytes_to_send_position += blocksize;
-				osDelay(1); // general delay
+	char header[192];
+	uint16_t max_len;
+	uint8_t* buffer = connection_write_begin(connection, &max_len);
+	char* body = (char*)buffer + sizeof(header);
+	char* pos = body;
+	char* end = (char*)buffer + max_len;
+	while ((fres = f_readdir(&dir, &info)) == FR_OK && info.fname[0] != 0) {
+		int len = snprintf(pos, end - pos, "%s%s\t%lu\n", info.fname, (info.fattrib & AM_DIR) ? "/" : "",
+				info.fsize);
+		if (len >= end - pos) {
+			break;
+		}
+		pos += len;
+	}
+	f_closedir(&dir);
+
+	int header_len = snprintf(header, sizeof(header), "HTTP/1.1 200 OK"CRLF"%s"
+			"Content-Type: text/plain"CRLF"Content-Length: %u"CRLF"Cache-Control: no-cache"CRLF""CRLF,
+			connection_header(keep_alive), (unsigned int)(pos - body));
+	memcpy(body - header_len, header, header_len);
+	connection_write_end(connection, (uint8_t*)body - header_len, header_len + (pos - body));
+	return NOEXIT;
+}
+
+/**
+ * Parses a single byte range of a file with the given size: "bytes=<first>-<last>",
+ * "bytes=<first>-" or "bytes=-<suffix length>". Multiple ranges are not supported, so the whole
+ * file is sent then, like for malformed ranges.
+ * Returns RANGE_OK (`first` and `len` are set), RANGE_NONE or RANGE_NOT_SATISFIABLE.
+ */
+static uint8_t parse_range(const char* value, uint32_t size, uint32_t* first, uint32_t* len) {
+	if (strncmp(value, "bytes=", 6) != 0 || NULL != strchr(value, ',')) {
+		return RANGE_NONE;
+	}
+	const char* begin = value + 6;
+	const char* dash = strchr(begin, '-');
+	if (NULL == dash || (dash == begin && dash[1] == 0)) {
+		return RANGE_NONE;
+	}
+
+	char* end;
+	uint32_t last;
+	if (dash == begin) {
+		// Suffix: the last bytes of the file
+		uint32_t suffix = strtoul(dash + 1, &end, 10);
+		if (*end != 0) {
+			return RANGE_NONE;
+		}
+		if (suffix == 0 || size == 0) {
+			return RANGE_NOT_SATISFIABLE;
+		}
+		*first = suffix < size ? size - suffix : 0;
+		last = size - 1;
+	} else {
+		*first = strtoul(begin, &end, 10);
+		if (end != dash) {
+			return RANGE_NONE;
+		}
+		if (dash[1] == 0) {
+			last = size - 1;
+		} else {
+			last = strtoul(dash + 1, &end, 10);
+			if (*end != 0 || last < *first) {
+				return RANGE_NONE;
 			}
-			// Write the rest.
-			if (bytes_to_send > 0) {
-				while (!http_permitted) {
-					osDelay(10);
-				}
-				netconn_write(connection->conn, bytes_to_send_position, bytes_to_send, NETCONN_COPY);
-				// printf("bytes send: %u\n", bytes_to_send);
+			if (last >= size) {
+				last = size - 1;
 			}
-			printf("bytes send (sum): %u\n", bytes_read);
 		}
+		if (*first >= size) {
+			return RANGE_NOT_SATISFIABLE;
+		}
+	}
+	*len = last - *first + 1;
+	return RANGE_OK;
+}
 
-		uint64_t end = measure_reference_timer_ticks;
-		printf("done reading\ntook %lums\n", (uint32_t)(end-start)/100);
+/**
+ * Delivers a file of the cache. If the browser has the file already (If-None-Match matches the ETag),
+ * just 304 Not Modified is sent. html files must always be revalidated, other files may be used by
+ * the browser for HTTP_CACHE_MAX_AGE seconds. The file is transferred by http_continue_transfer.
+ * Returns NOEXIT.
+ */
+static uint8_t deliver_cached_resource(connection_t* connection, const http_cache_entry_t* entry,
+		request_headers_t* headers, uint8_t keep_alive) {
+	char etag[11];
+	snprintf(etag, sizeof(etag), "\"%08lx\"", entry->etag);
+
+	char mime_type[25];
+	get_mime_type(entry->name, mime_type);
+	char cache_control[24];
+	if (strcmp(mime_type, "text/html") == 0) {
+		strcpy(cache_control, "no-cache");
+	} else {
+		snprintf(cache_control, sizeof(cache_control), "max-age=%d", HTTP_CACHE_MAX_AGE);
+	}
 
-		if ((fres = f_close(&file)) != FR_OK) {
-			printf("error closing file: %d\n", fres);
-			exit = EXIT;
+	char response[256];
+	int response_len;
+	if (NULL != headers->if_none_match && NULL != strstr(headers->if_none_match, etag)) {
+		http_cache_count_not_modified();
+		response_len = snprintf(response, sizeof(response), "HTTP/1.1 304 Not Modified"CRLF"%s"
+				"ETag: %s"CRLF"Cache-Control: %s"CRLF"Vary: Accept-Encoding"CRLF""CRLF,
+				connection_header(keep_alive), etag, cache_control);
+		connection_write(connection, response, response_len);
+		return NOEXIT;
+	}
+
+	response_len = snprintf(response, sizeof(response), "HTTP/1.1 200 OK"CRLF"%s"
+			"Content-Type: %s"CRLF"Content-Length: %lu"CRLF"%sETag: %s"CRLF"Cache-Control: %s"CRLF
+			"Vary: Accept-Encoding"CRLF""CRLF, connection_header(keep_alive), mime_type, entry->len,
+			entry->gzip ? "Content-Encoding: gzip"CRLF : "", etag, cache_control);
+	connection_write(connection, response, response_len);
+
+	connection_data_t* data = connection->data;
+	data->cache_data = entry->data;
+	data->cache_len = entry->len;
+	data->cache_offset = 0;
+	data->transfer = HTTP_TRANSFER_CACHE;
+	return NOEXIT;
+}
+
+/**
+ * Continues the file transfer of the connection. Reads the next block of the file into the output
+ * buffer, which must be empty. The blocks end at sector boundaries of the file, so FatFs reads the
+ * sectors directly into the buffer with one multi sector read instead of copying them one by one
+ * through the sector buffer of the file. The file is closed at its end.
+ * Returns 0, if the transfer has to wait for tokens (see shaper.c) or the send buffer is full.
+ */
+uint8_t http_continue_transfer(connection_t* connection) {
+	if (!shaper_permits(SHAPER_CLASS_HTTP)) {
+		return 0; // The server task is woken up, when there are tokens again.
+	}
+
+	connection_data_t* data = connection->data;
+	if (data->transfer == HTTP_TRANSFER_CACHE) {
+		return continue_cached_transfer(connection);
+	}
+	uint16_t max_len;
+	uint8_t* buffer = connection_write_begin(connection, &max_len);
+	uint32_t len = HTTP_BLOCK_SIZE - f_tell(&data->file) % _MIN_SS;
+	if (len > max_len) {
+		len = max_len;
+	}
+	if (len > data->file_remaining) {
+		len = data->file_remaining;
+	}
+
+	unsigned int bytes_read = 0;
+	FRESULT fres = len > 0 ? f_read(&data->file, buffer, len, &bytes_read) : FR_OK;
+	data->file_remaining -= bytes_read;
+
+	if (fres != FR_OK || bytes_read == 0) {
+		http_close_transfer(connection);
+		if (fres != FR_OK) {
+			printf("error reading file: %d\n", fres);
 		}
+		return 1;
 	}
 
-	osMutexRelease(http_resource_mutex);
+	connection_write_end(connection, buffer, bytes_read);
+	shaper_consume(SHAPER_CLASS_HTTP, bytes_read);
+	return 1;
+}
 
-	pool_free(connection_data_pool, data_buffer);
-	return exit;
+/**
+ * Writes the next part of a cached file. The cache does not change, so lwIP references the data
+ * until it is acknowledged instead of copying it (NETCONN_NOCOPY).
+ * Returns 0, if the send buffer is full.
+ */
+static uint8_t continue_cached_transfer(connection_t* connection) {
+	connection_data_t* data = connection->data;
+	if (data->cache_offset < data->cache_len) {
+		size_t written = 0;
+		err_t err = netconn_write_partly(connection->conn, data->cache_data + data->cache_offset,
+				data->cache_len - data->cache_offset, NETCONN_NOCOPY | NETCONN_DONTBLOCK, &written);
+		if (err == ERR_OK) {
+			data->cache_offset += written;
+			shaper_consume(SHAPER_CLASS_HTTP, written);
+		} else if (err != ERR_WOULDBLOCK) {
+			connection->error = err;
+			data->cache_offset = data->cache_len;
+		}
+		if (data->cache_offset < data->cache_len) {
+			return 0;
+		}
+	}
+	http_close_transfer(connection);
+	return 1;
+}
+
+/**
+ * Ends a running transfer. The file is closed, if it was read from the SD card.
+ */
+void http_close_transfer(connection_t* connection) {
+	connection_data_t* data = connection->data;
+	HttpTransfer transfer = data->transfer;
+	data->transfer = HTTP_TRANSFER_NONE;
+	if (transfer != HTTP_TRANSFER_FILE) {
+		return;
+	}
+
+	FRESULT fres = f_close(&data->file);
+	if (fres != FR_OK) {
+		printf("error closing file: %d\n", fres);
+	}
 }
 
 /**
@@ -318,8 +672,8 @@ static uint8_t deliver_resource(connection_t* connection, char* resource) {
  * the given buffer. The buffer needs at least 24+1 space, because
  * "application/octet-stream" is the longest string with 24 chars.
  */
-static void get_mime_type(char* filename, char* mime_type) {
-	char *ext = NULL;
+static void get_mime_type(const char* filename, char* mime_type) {
+	const char *ext = NULL;
 	size_t filename_len = strlen(filename);
 	// search the last dot. dot+1 is the file extension.
 	for (int i = filename_len - 1; i >= 0; i--) {
@@ -358,7 +712,7 @@ static void get_mime_type(char* filename, char* mime_type) {
  * length is 511 and will be cut, if the given message is longer.
  */
 static void send_error(connection_t* connection, char* message, uint16_t statuscode, char* file, int line) {
-	static char error_response[1024+128]; // There may be race conditions if multiple threads try to use this; But this should be a minor case.
+	static char error_response[1024+128]; // Only used by the server task.
 	// Cut message to 512 bytes.
 	static char error_message[512];
 	int message_len = snprintf(error_message, 512, "%s", message);
@@ -370,6 +724,10 @@ static void send_error(connection_t* connection, char* message, uint16_t statusc
 		message_len = sprintf(error_response, "HTTP/1.1 500 Internal Server Error"CRLF"Connection: close"CRLF"Content-Length: %d"CRLF""CRLF"%s",
 					message_len, error_message_with_line);
 		break;
+	case 404: // Not Found
+		message_len = sprintf(error_response, "HTTP/1.1 404 Not Found"CRLF"Connection: close"CRLF"Content-Length: %d"CRLF""CRLF"%s",
+					message_len, error_message);
+		break;
 	case 400: // Bad request
 		message_len = sprintf(error_response, "HTTP/1.1 400 Bad Request"CRLF"Connection: close"CRLF"Content-Length: %d"CRLF""CRLF"%s",
 					message_len, error_message);
@@ -378,6 +736,10 @@ static void send_error(connection_t* connection, char* message, uint16_t statusc
 		message_len = sprintf(error_response, "HTTP/1.1 405 Method Not Allowed"CRLF"Connection: close"CRLF"Content-Length: %d"CRLF""CRLF"%s",
 					message_len, error_message);
 		break;
+	case 406: // Not Acceptable
+		message_len = sprintf(error_response, "HTTP/1.1 406 Not Acceptable"CRLF"Connection: close"CRLF"Content-Length: %d"CRLF""CRLF"%s",
+					message_len, error_message);
+		break;
 	case 414: // Request-URL Too Long
 		message_len = sprintf(error_response, "HTTP/1.1 414 Request-URL Too Long"CRLF"Connection: close"CRLF"Content-Length: %d"CRLF""CRLF"%s",
 					message_len, error_message);
@@ -390,5 +752,5 @@ static void send_error(connection_t* connection, char* message, uint16_t statusc
 		Error_Handler();
 	}
 
-	netconn_write(connection->conn, error_response, message_len, NETCONN_COPY);
+	connection_write(connection, error_response, message_len);
 }
@@ -0,0 +1,211 @@
+/*
+ * http_cache.c
+ *
+ * Keeps the files of the webpage (HTTP_ROOT on the SD card) in the SDRAM, so they are served without
+ * touching the SD card. All files are loaded once at startup. A file `<name>.gz` is the precompressed
+ * variant of `<name>` and is delivered to browsers, that accept gzip. The cache never changes
+ * afterwards, so the data can be written to the connections without copying (see http.c).
+ * Files, that do not fit into the cache, are read from the SD card.
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: finn
+ */
+
+#include "http_cache.h"
+#include "fatfs.h"
+#include "string.h"
+#include "stdio.h"
+
+#define ALIGN4(x)	(((x) + 3) & ~3)
+
+static uint8_t __aligned(4) cache_memory[HTTP_CACHE_SIZE] __section(".extsram");
+static uint32_t cache_used;
+static http_cache_entry_t entries[HTTP_CACHE_MAX_FILES];
+static uint32_t entry_count;
+static uint8_t complete; // All files of HTTP_ROOT are in the cache.
+
+static uint32_t hits;
+static uint32_t misses;
+static uint32_t not_modified;
+
+// Only used while loading. Static, because they are too large for the stack of the init task.
+static char path[255 + 7 + 1];
+static DIR dirs[HTTP_CACHE_MAX_DEPTH];
+static FILINFO info;
+static FIL file;
+
+static uint8_t load_file(uint32_t size);
+static uint32_t hash(const uint8_t* data, uint32_t len);
+
+/**
+ * Loads all files below HTTP_ROOT into the cache. Must be called, before the server task is started.
+ */
+void http_cache_init() {
+	cache_used = 0;
+	entry_count = 0;
+	complete = 1;
+	hits = 0;
+	misses = 0;
+	not_modified = 0;
+
+	strcpy(path, HTTP_ROOT);
+	if (f_opendir(&dirs[0], path) != FR_OK) {
+		complete = 0;
+		return;
+	}
+
+	uint8_t depth = 0;
+	while (1) {
+		FRESULT fres = f_readdir(&dirs[depth], &info);
+		if (fres != FR_OK || info.fname[0] == 0) {
+			// End of the directory. Go back to the parent.
+			f_closedir(&dirs[depth]);
+			if (fres != FR_OK) {
+				complete = 0;
+			}
+			if (depth == 0) {
+				break;
+			}
+			depth--;
+			*strrchr(path, '/') = 0;
+			continue;
+		}
+
+		size_t len = strlen(path);
+		if (len + 1 + strlen(info.fname) >= sizeof(path)) {
+			complete = 0;
+			continue;
+		}
+		path[len] = '/';
+		strcpy(path + len + 1, info.fname);
+
+		if (info.fattrib & AM_DIR) {
+			if (depth + 1 < HTTP_CACHE_MAX_DEPTH && f_opendir(&dirs[depth + 1], path) == FR_OK) {
+				depth++;
+				continue; // The path is shortened, when the directory ends.
+			}
+			complete = 0;
+		} else if (!load_file(info.fsize)) {
+			complete = 0;
+		}
+		path[len] = 0;
+	}
+
+	printf("HTTP cache: %lu files, %lu bytes%s\n", entry_count, cache_used, complete ? "" : ", incomplete");
+}
+
+/**
+ * Loads the file at `path` into the cache. Returns 0, if it does not fit or cannot be read.
+ */
+static uint8_t load_file(uint32_t size) {
+	const char* name = path + strlen(HTTP_ROOT);
+	size_t name_len = strlen(name);
+	uint8_t gzip = name_len > 3 && strcmp(name + name_len - 3, ".gz") == 0;
+	if (gzip) {
+		name_len -= 3;
+	}
+
+	uint32_t space = ALIGN4(name_len + 1) + ALIGN4(size);
+	if (entry_count >= HTTP_CACHE_MAX_FILES || space > HTTP_CACHE_SIZE - cache_used) {
+		return 0;
+	}
+	char* entry_name = (char*)cache_memory + cache_used;
+	uint8_t* entry_data = cache_memory + cache_used + ALIGN4(name_len + 1);
+
+	if (f_open(&file, path, FA_READ) != FR_OK) {
+		return 0;
+	}
+	unsigned int bytes_read = 0;
+	FRESULT fres = f_read(&file, entry_data, size, &bytes_read);
+	f_close(&file);
+	if (fres != FR_OK || bytes_read != size) {
+		return 0;
+	}
+
+	memcpy(entry_name, name, name_len);
+	entry_name[name_len] = 0;
+
+	http_cache_entry_t* entry = entries + entry_count;
+	entry->name = entry_name;
+	entry->data = entry_data;
+	entry->len = size;
+	entry->etag = hash(entry_data, size);
+	entry->gzip = gzip;
+	entry_count++;
+	cache_used += space;
+	return 1;
+}
+
+/**
+ * FNV-1a hash of the data. Used for the ETags.
+ */
+static uint32_t hash(const uint8_t* data, uint32_t len) {
+	uint32_t h = 2166136261UL;
+	for (uint32_t i = 0; i < len; i++) {
+		h ^= data[i];
+		h *= 16777619UL;
+	}
+	return h;
+}
+
+/**
+ * Returns 1, if all files of HTTP_ROOT are in the cache. Then a file, that is not found, does not exist.
+ */
+inline uint8_t http_cache_is_complete() {
+	return complete;
+}
+
+/**
+ * Returns the cached file with the given name or NULL. The precompressed variant is preferred, if
+ * `accept_gzip` is set. Called by the server task.
+ */
+const http_cache_entry_t* http_cache_find(const char* name, uint8_t accept_gzip) {
+	const http_cache_entry_t* plain = NULL;
+	for (uint32_t i = 0; i < entry_count; i++) {
+		if (strcmp(entries[i].name, name) != 0) {
+			continue;
+		}
+		if (!entries[i].gzip) {
+			plain = entries + i;
+		} else if (accept_gzip) {
+			hits++;
+			return entries + i;
+		}
+	}
+	if (NULL != plain) {
+		hits++;
+	} else {
+		misses++;
+	}
+	return plain;
+}
+
+/**
+ * Returns 1, if a variant of the file with the given name is cached. So if http_cache_find returns
+ * NULL for a cached name, just the precompressed variant exists.
+ */
+uint8_t http_cache_contains(const char* name) {
+	for (uint32_t i = 0; i < entry_count; i++) {
+		if (strcmp(entries[i].name, name) == 0) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Counts a request, that was answered with 304 Not Modified.
+ */
+void http_cache_count_not_modified() {
+	not_modified++;
+}
+
+/**
+ * Formats the usage of the cache into the given buffer as a string with respect to max_length.
+ * Returns the length of the written string (excl. null terminator)
+ */
+uint16_t format_http_cache_stats(uint8_t* data, uint16_t max_length) {
+	return snprintf((char*)data, max_length, "HTTP cache: files %lu, bytes %lu of %u%s, hits %lu, "
+			"not modified %lu, misses %lu\n", entry_count, cache_used, HTTP_CACHE_SIZE,
+			complete ? "" : " (incomplete)", hits, not_modified, misses);
+}
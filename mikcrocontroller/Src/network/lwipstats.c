@@ -9,6 +9,7 @@
 
 #ifdef NETWORK_STATS
 #include "string.h"
+#include "ethernetif.h"
 
 extern struct stats_ lwip_stats;
 
@@ -48,6 +49,13 @@ uint16_t format_network_stats(uint8_t* buffer, uint16_t max_length) {
 	pos += snprintf(pos, max_length - ((char*)buffer - pos), "         | %"ALIGNED_U32" |%"ALIGNED_U32" |%"ALIGNED_U32" |%"ALIGNED_U32"\n",
 		(u32_t)mem->avail, (u32_t)mem->used, (u32_t)mem->max, (u32_t)mem->err);
 
+	pos += snprintf(pos, max_length - ((char*)buffer - pos), "\nETH TX | zero-copy | copied | busy\n");
+	pos += snprintf(pos, max_length - ((char*)buffer - pos), "       | %9lu | %6lu | %4lu\n",
+		ethernetif_stats.tx_zero_copy, ethernetif_stats.tx_copied, ethernetif_stats.tx_busy);
+	pos += snprintf(pos, max_length - ((char*)buffer - pos), "ETH RX | zero-copy | copied | dropped\n");
+	pos += snprintf(pos, max_length - ((char*)buffer - pos), "       | %9lu | %6lu | %7lu\n",
+		ethernetif_stats.rx_zero_copy, ethernetif_stats.rx_copied, ethernetif_stats.rx_dropped);
+
 	char whitespaces[15+1];
 	whitespaces[0] = '\0';
 
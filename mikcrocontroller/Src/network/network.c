@@ -12,6 +12,8 @@
 #include "send_data.h"
 #include "sd_config.h"
 #include "http.h"
+#include "overload.h"
+#include "shaper.h"
 
 static uint8_t use_dhcp;
 static uint8_t dhcp_timeout;
@@ -31,13 +33,17 @@ extern ETH_HandleTypeDef heth;
 
 osThreadId network_status_task_handle;
 osThreadId server_task_handle;
-osSemaphoreId connection_semaphore;
+// Released by the netconn callback and the send service. The server task waits for it.
+static osSemaphoreId server_semaphore;
 
-DEFINE_POOL_IN_HEAP(connection_pool, MAX_CONNECTIONS, connection_t);
+// Static, so accepting and closing connections does not use the heap.
+DEFINE_POOL(connection_pool, MAX_CONNECTIONS, connection_t);
 
-static void start_server_task();
 static void network_status_task_function(void const *argument);
 static void server_task_function(void const *argument);
+static void server_netconn_callback(struct netconn* conn, enum netconn_evt evt, u16_t len);
+static void accept_connections();
+static uint8_t close_idle_http_connection();
 
 /**
  * Network initialization. Sets up LwIP.
@@ -48,13 +54,18 @@ void network_init(sd_config_t* config)
 	network_status_task_handle = NULL;
 	server_task_handle = NULL;
 
-	osSemaphoreDef(connection_semaphore_def);
-	connection_semaphore = osSemaphoreCreate(osSemaphore(connection_semaphore_def), MAX_CONNECTIONS);
+	osSemaphoreDef(server_semaphore_def);
+	server_semaphore = osSemaphoreCreate(osSemaphore(server_semaphore_def), 1);
 
 	pool_init(connection_pool);
 
 	connections_init();
-	send_data_init();
+	send_data_init(config->send_deadline);
+	send_data_set_weights(config->weight_data, config->weight_fft, config->weight_debug);
+	shaper_init();
+	shaper_set_rate(SHAPER_CLASS_HTTP, config->rate_http);
+	shaper_set_rate(SHAPER_CLASS_FFT, config->rate_fft);
+	overload_init(config->overload_policy);
 	http_init();
 
 	ip4_addr_copy(default_ip_addr, config->ip_addr);
@@ -88,6 +99,7 @@ void network_init(sd_config_t* config)
 
 	tcpip_init(NULL, NULL);
 
+	ethernetif_set_rx_buffers(config->rx_buffers);
 	// add the network interface with RTOS
 	netif_add(&networkinterface, &ip_addr, &netmask, &gateway, NULL, &ethernetif_init, &tcpip_input);
 
@@ -110,9 +122,17 @@ void network_start() {
 	if (NULL == network_status_task_handle) {
 		Error_Handler();
 	}
+
+	// The server task serves all connections. It listens on any address, so it can be started before
+	// an address is assigned.
+	osThreadDef(server_task, server_task_function, osPriorityNormal, 1, 1024);
+	server_task_handle = osThreadCreate(osThread(server_task), NULL);
+	if (NULL == server_task_handle) {
+		Error_Handler();
+	}
 }
 
-// checks the status of the link. Handles the DHCP and manages the server task.
+// checks the status of the link. Handles the DHCP.
 static void network_status_task_function(void const *argument) {
 	uint8_t link_status = 0;
 	uint8_t wait_for_dhcp = 0; // Not used, if use_dhcp == 0
@@ -145,25 +165,10 @@ static void network_status_task_function(void const *argument) {
 
 					dhcp_timeout_counter = 0;
 					wait_for_dhcp = 1;
-				} else {
-					// directly start the servertask, because we have an ip assigned per default.
-					start_server_task();
 				}
 			} else {
 				// When the netif link is down this function must be called
 				netif_set_down(&networkinterface);
-
-				// stop server thread
-				if (NULL != server_task_handle) {
-					if (osThreadTerminate(server_task_handle) == osOK) {
-						if (NULL != server_connection) {
-							netconn_close(server_connection);
-							netconn_delete(server_connection);
-							server_connection = NULL;
-						}
-					}
-					server_task_handle = NULL;
-				}
 			}
 		}
 
@@ -178,9 +183,6 @@ static void network_status_task_function(void const *argument) {
 						b_ip_addr, b_netmask, b_gateway);
 
 				wait_for_dhcp = 0;
-
-				// start echo thread
-				start_server_task();
 			} else if ((dhcp_timeout_counter * NETWORK_STATUS_TASK_DELAY) > (dhcp_timeout_counter * 1000)) {
 				dhcp_stop(&networkinterface);
 				netif_set_addr(&networkinterface, &default_ip_addr, &default_netmask, &default_gateway);
@@ -192,7 +194,6 @@ static void network_status_task_function(void const *argument) {
 
 
 				wait_for_dhcp = 0;
-				start_server_task();
 			}
 		}
 
@@ -201,28 +202,33 @@ static void network_status_task_function(void const *argument) {
 }
 
 /**
- * Starts the server task...
+ * Wakes up the server task. Can be called from tasks and interrupts.
  */
-static void start_server_task() {
-	osThreadDef(server_task, server_task_function, osPriorityNormal, 1, 1024);
-	if (NULL == server_task_handle) {
-		server_task_handle = osThreadCreate(osThread(server_task), NULL);
-		if (NULL == server_task_handle) {
-			Error_Handler();
-		}
+void network_server_wakeup() {
+	if (NULL != server_semaphore) {
+		osSemaphoreRelease(server_semaphore);
 	}
 }
 
 /**
- * The server task. Binds to the the listening port and accepts new connections.
+ * Called by lwIP for every event of the listening connection and all accepted connections. New
+ * connections, received data, errors and free space in the send buffer (tcp_sent) wake up the server task.
  */
-static void server_task_function(void const *argument) {
-	osThreadDef(connection_task, connection_task_function, osPriorityNormal, MAX_CONNECTIONS, 1024);
+static void server_netconn_callback(struct netconn* conn, enum netconn_evt evt, u16_t len) {
+	if (evt == NETCONN_EVT_RCVPLUS || evt == NETCONN_EVT_SENDPLUS || evt == NETCONN_EVT_ERROR) {
+		network_server_wakeup();
+	}
+}
 
-	err_t err, accept_err;
-	struct netconn* accepted_connection;
+/**
+ * The server task. Binds to the the listening port and serves all connections in one event loop.
+ * Nothing blocks on the network: Data is only received, if it is available, and written, if the TCP
+ * send buffer has space. If nothing is to do, the task waits for the next event.
+ */
+static void server_task_function(void const *argument) {
+	err_t err;
 
-	server_connection = netconn_new(NETCONN_TCP);
+	server_connection = netconn_new_with_callback(NETCONN_TCP, server_netconn_callback);
 	if (NULL == server_connection) {
 		Error_Handler();
 	}
@@ -231,45 +237,90 @@ static void server_task_function(void const *argument) {
 
 	// Bind to our port.
 	err = netconn_bind(server_connection, NULL, LISTEN_PORT);
-	if (err == ERR_OK) {
-		// Tell connection to go into listening mode.
-		netconn_listen(server_connection);
-		while (1) {
-			osThreadYield();
-			osSemaphoreWait(connection_semaphore, osWaitForever);
-			// Grab new connection.
-			accept_err = netconn_accept(server_connection, &accepted_connection);
-
-			// Process the new connection.
-			if (accept_err == ERR_OK) {
-				// start new thread. pass acceptedConnection as arg.
-				connection_t *connection = pool_alloc(connection_pool);
-				if (NULL == connection) { // this should not happen, in fact this is secured by the connectionSemaphore.
-					printf("No free task id was found! Aborting..\n");
-					if (NULL != accepted_connection) {
-						netconn_close(accepted_connection);
-						netconn_delete(accepted_connection);
-					}
-					continue;
-				}
-				connection->conn = accepted_connection;
-				connection->type = CONNECTION_TYPE_UNKNOWN;
-				connection->send_type = SEND_TYPE_NONE;
-				const osMutexDef_t mutex = {0};
-				connection->write_mutex = osMutexCreate(&mutex);
-				// the thread is automatically started. Make sure it is the last thing to initialize
-				connection->thread = osThreadCreate(osThread(connection_task), (void*)connection);
-				if (NULL == connection->thread) {
-					Error_Handler();
-				}
-			} else {
-				printf("cannot accept the connection. Code: %d\n", accept_err);
-				osSemaphoreRelease(connection_semaphore);
-			}
-		}
-	} else {
+	if (err != ERR_OK) {
 		printf("cannot bind. Errorcode: %d\n", err);
 		netconn_delete(server_connection);
 		server_connection = NULL;
+		osThreadTerminate(NULL);
+		return;
+	}
+
+	// Tell connection to go into listening mode.
+	netconn_listen(server_connection);
+	while (1) {
+		accept_connections();
+
+		uint32_t timeout = osWaitForever;
+		connection_t **connections = (connection_t**)pool_get_entries(connection_pool);
+		for (uint32_t i = 0; i < connection_pool->entrycount; i++) {
+			connection_t* c = connections[i];
+			if (NULL == c) {
+				continue;
+			}
+			if (connection_process(c) == EXIT) {
+				connection_close(c);
+			} else if (connection_is_idle_http(c)) {
+				// Come back to close the connection, when it is idle for too long.
+				uint32_t idle = osKernelSysTick() - c->last_activity;
+				uint32_t left = idle < HTTP_KEEP_ALIVE_TIMEOUT*1000 ? HTTP_KEEP_ALIVE_TIMEOUT*1000 - idle : 1;
+				if (left < timeout) {
+					timeout = left;
+				}
+			}
+		}
+
+		if (send_data_process()) {
+			timeout = 1; // Check the coalesce deadline.
+		} else if (overload_get_level() != OVERLOAD_LEVEL_NONE && timeout > OVERLOAD_STEP_INTERVAL) {
+			timeout = OVERLOAD_STEP_INTERVAL; // Check, if the overload is over.
+		}
+
+		osSemaphoreWait(server_semaphore, timeout);
+	}
+}
+
+/**
+ * Closes the HTTP connection, that waits longest for a request. Returns 0, if there is none.
+ */
+static uint8_t close_idle_http_connection() {
+	connection_t* oldest = NULL;
+	connection_t **connections = (connection_t**)pool_get_entries(connection_pool);
+	for (uint32_t i = 0; i < connection_pool->entrycount; i++) {
+		connection_t* c = connections[i];
+		if (NULL != c && connection_is_idle_http(c) &&
+				(NULL == oldest || (int32_t)(c->last_activity - oldest->last_activity) < 0)) {
+			oldest = c;
+		}
+	}
+	if (NULL == oldest) {
+		return 0;
+	}
+	connection_close(oldest);
+	return 1;
+}
+
+/**
+ * Accepts all pending connections. If all connections are in use, an idle HTTP connection is closed
+ * for it. Otherwise the new connection is closed.
+ */
+static void accept_connections() {
+	struct netconn* accepted_connection;
+
+	while (osMessageWaiting(server_connection->acceptmbox) > 0) {
+		err_t accept_err = netconn_accept(server_connection, &accepted_connection);
+		if (accept_err != ERR_OK) {
+			printf("cannot accept the connection. Code: %d\n", accept_err);
+			continue;
+		}
+
+		connection_t* connection = connection_open(accepted_connection);
+		if (NULL == connection && close_idle_http_connection()) {
+			connection = connection_open(accepted_connection);
+		}
+		if (NULL == connection) {
+			printf("No free connection! Closing the new one..\n");
+			netconn_close(accepted_connection);
+			netconn_delete(accepted_connection);
+		}
 	}
 }
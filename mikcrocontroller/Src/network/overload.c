@@ -0,0 +1,182 @@
+/*
+ * overload.c
+ *
+ * Decides, what happens, if the network cannot take the data as fast as it is produced.
+ *
+ * With OVERLOAD_POLICY_STOP a packet, that cannot be queued, stops the measurement and flushes the
+ * queues (see send_data). With OVERLOAD_POLICY_DEGRADE the measurement keeps running: The server
+ * task watches the usage of the data descriptors and the queues of blocking connections (see
+ * send_data_process). If it is above OVERLOAD_HIGH_WATERMARK or a packet could not be queued, the
+ * next level is entered: First the FFTs are paused, then the raw stream is decimated and at last
+ * whole data packets are dropped. If the usage stays below OVERLOAD_LOW_WATERMARK for
+ * OVERLOAD_RECOVERY_DELAY, the previous level is entered. Every change of the level is sent to the
+ * clients with the state (flags.overload). Lost packets are counted as DROP_CAUSE_OVERLOAD and show
+ * up as gaps in the sequence numbers.
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: finn
+ */
+
+#include "overload.h"
+#include "state.h"
+#include "send_data.h"
+#include "config.h"
+#include "cmsis_os.h"
+#include "stdio.h"
+
+static volatile uint8_t policy = OVERLOAD_POLICY_STOP;
+static volatile uint8_t level = OVERLOAD_LEVEL_NONE;
+static volatile uint8_t failure_reported;
+
+static uint32_t level_since; // Tick of the last level change
+static uint32_t below_since; // Tick, since the usage is below the low watermark
+static uint8_t below;
+
+static uint32_t transitions;
+static uint8_t decimation_step[MAX_MEASUREMENTS]; // Per measurement, so all of them keep samples
+static uint32_t packet_step;
+static volatile uint32_t skipped_samples;
+
+static const char* policy_names[] = {"stop", "degrade"};
+static const char* level_names[] = {"none", "pause fft", "decimate", "drop"};
+
+static void set_level(uint8_t new_level);
+
+/**
+ * Initializes the overload handling with the given policy (see OverloadPolicy).
+ */
+void overload_init(uint8_t p) {
+	policy = p > OVERLOAD_POLICY_DEGRADE ? OVERLOAD_POLICY_STOP : p;
+	level = OVERLOAD_LEVEL_NONE;
+	failure_reported = 0;
+	level_since = osKernelSysTick();
+	below = 0;
+	transitions = 0;
+	packet_step = 0;
+	skipped_samples = 0;
+	for (int i = 0; i < MAX_MEASUREMENTS; i++) {
+		decimation_step[i] = 0;
+	}
+}
+
+/**
+ * Sets the policy. Returns 0, if the policy does not exist. The level is reset on the next
+ * call of overload_process, if the policy is OVERLOAD_POLICY_STOP.
+ */
+uint8_t overload_set_policy(uint8_t p) {
+	if (p > OVERLOAD_POLICY_DEGRADE) {
+		return 0;
+	}
+	policy = p;
+	return 1;
+}
+
+/**
+ * Returns 1, if failed packets should degrade the measurement instead of stopping it.
+ */
+inline uint8_t overload_is_degrading() {
+	return policy == OVERLOAD_POLICY_DEGRADE;
+}
+
+/**
+ * Returns the current level (see OverloadLevel).
+ */
+inline uint8_t overload_get_level() {
+	return level;
+}
+
+/**
+ * Tells, that a packet could not be queued. The next level is entered by the server task.
+ * Can be called from interrupts.
+ */
+inline void overload_report_failure() {
+	failure_reported = 1;
+}
+
+/**
+ * Adjusts the level to the given usage in percent. Called by the server task.
+ */
+void overload_process(uint8_t usage) {
+	if (policy != OVERLOAD_POLICY_DEGRADE) {
+		failure_reported = 0;
+		if (level != OVERLOAD_LEVEL_NONE) {
+			set_level(OVERLOAD_LEVEL_NONE);
+		}
+		return;
+	}
+
+	uint32_t now = osKernelSysTick();
+	uint8_t failed = failure_reported;
+	failure_reported = 0;
+	if (failed || usage >= OVERLOAD_HIGH_WATERMARK) {
+		below = 0;
+		if (level < OVERLOAD_LEVEL_DROP && now - level_since >= OVERLOAD_STEP_INTERVAL) {
+			set_level(level + 1);
+		}
+		return;
+	}
+
+	if (level == OVERLOAD_LEVEL_NONE || usage > OVERLOAD_LOW_WATERMARK) {
+		below = 0;
+		return;
+	}
+	if (!below) {
+		below = 1;
+		below_since = now;
+	} else if (now - below_since >= OVERLOAD_RECOVERY_DELAY) {
+		below_since = now;
+		set_level(level - 1);
+	}
+}
+
+/**
+ * Returns 1, if the sample of the given measurement should not be put into the data stream.
+ * Called for every sample by the DRDY interrupt.
+ */
+uint8_t overload_skip_sample(uint8_t measurement_index) {
+	if (level < OVERLOAD_LEVEL_DECIMATE || measurement_index >= MAX_MEASUREMENTS) {
+		return 0;
+	}
+	if (++decimation_step[measurement_index] < OVERLOAD_DECIMATION) {
+		skipped_samples++;
+		return 1;
+	}
+	decimation_step[measurement_index] = 0;
+	return 0;
+}
+
+/**
+ * Returns 1, if the data packet should be dropped. The drop is counted. Called for every data
+ * packet by the DRDY interrupt.
+ */
+uint8_t overload_drop_packet() {
+	if (level < OVERLOAD_LEVEL_DROP) {
+		return 0;
+	}
+	if (++packet_step & 0x01) {
+		send_data_count_drop(DROP_CAUSE_OVERLOAD);
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * Changes the level and sends the new state to all clients.
+ */
+static void set_level(uint8_t new_level) {
+	level = new_level;
+	level_since = osKernelSysTick();
+	packet_step = 0;
+	transitions++;
+	set_overload_level_flag(new_level);
+	send_state();
+}
+
+/**
+ * Formats the overload policy and statistics into the given buffer as a string with respect to max_length.
+ * Returns the length of the written string (excl. null terminator)
+ */
+uint16_t format_overload_stats(uint8_t* data, uint16_t max_length) {
+	return snprintf((char*)data, max_length, "Overload: policy %s, level %s, transitions %lu, skipped samples %lu\n",
+			policy_names[policy], level_names[level], transitions, skipped_samples);
+}
@@ -0,0 +1,60 @@
+/*
+ * round_robin.c
+ *
+ * Deficit round robin: The classes get their turns one after another. When it is the turn of a class,
+ * it gets weight*quantum bytes and writes messages as long as these bytes last. Bytes, that are not
+ * enough for the next message, are kept for the next turn, so large messages are not starved. A class
+ * without a message (or one, that may not write now) loses its bytes, so it cannot save them up.
+ * Used by send_data.c to share a connection between the send types. It has no dependencies, so it is
+ * tested on the host (see test/round_robin_test.c).
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: finn
+ */
+
+#include "round_robin.h"
+
+/**
+ * Resets the deficits. The first class has the first turn.
+ */
+void round_robin_reset(round_robin_t* rr) {
+	for (uint8_t i = 0; i < ROUND_ROBIN_MAX_CLASSES; i++) {
+		rr->deficit[i] = 0;
+	}
+	rr->turn = 0;
+}
+
+/**
+ * Returns the class, whose message should be written next, and takes its length from the deficit.
+ * lengths[i] is the length of the next message of class i or 0, if class i has nothing to write now.
+ * Returns count, if no class has something to write.
+ */
+uint8_t round_robin_next(round_robin_t* rr, const uint32_t* lengths, const uint8_t* weights, uint8_t count,
+		uint32_t quantum) {
+	uint8_t waiting = 0;
+	for (uint8_t i = 0; i < count; i++) {
+		if (lengths[i] > 0) {
+			waiting = 1;
+		}
+	}
+	if (!waiting) {
+		return count;
+	}
+
+	// Terminates: The deficit of a waiting class grows every round.
+	while (1) {
+		uint8_t i = rr->turn;
+		if (lengths[i] > 0) {
+			if (rr->deficit[i] >= lengths[i]) {
+				rr->deficit[i] -= lengths[i];
+				return i;
+			}
+		} else {
+			rr->deficit[i] = 0;
+		}
+
+		// Next turn.
+		rr->turn = (rr->turn + 1) % count;
+		rr->deficit[rr->turn] += weights[rr->turn] * quantum;
+	}
+}
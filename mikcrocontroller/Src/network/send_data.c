@@ -3,13 +3,35 @@
  *
  * Takes care about transmitting data over the network.
  *
- * The `send_task_function` tries to send data from the associated queue over the network.
- * For all four data types (see connection.h) gets an own queue and task to handle
- * the different payloads:
- * The FFT task gives huge amounts of data (>256KB) slowly, but measurements are fast (~4KB) in ~186 times
- * per second.
+ * Every connection has an own transmit queue per send type (see connection_tx_t). A packet is copied once into a
+ * buffer of the smallest fitting size class, that is attached to a data descriptor from the shared
+ * pool. The descriptor is put into the queue of every connection that
+ * subscribed to the send type and is reference counted, so it is released, if the last connection has
+ * written it. So a slow connection just fills its own queue and does not hold back other connections.
  *
- * The functions below takes care about putting the data (also from interrupts) into the queues.
+ * If the queue of a connection for the send type is full, the send policy of the connection decides what happens:
+ * - SEND_POLICY_BLOCK: The producer fails. For measurement data the measurement is stopped (see send_data).
+ * - SEND_POLICY_DROP_OLDEST: The oldest packet in the connection's queue is dropped.
+ * - SEND_POLICY_DISCONNECT: The connection is closed.
+ *
+ * The server task (see network.c) writes the queued data to the connections (see send_data_transmit).
+ * Non blocking writes are used, so a message may be written partially. The rest is written, when the
+ * TCP send buffer has space again. Small messages are coalesced to fill whole TCP segments.
+ * Every queued packet wakes up the server task. Status messages are written before all other messages,
+ * so they are not delayed by a burst of FFTs. Data, FFT and debug messages share the rest of the
+ * connection by weight with a deficit round robin (see tx_next). The queueing latency is measured per
+ * send type (see format_tx_stats).
+ *
+ * Clients can pace the data with credits (see send_data_grant_credit): Once a client granted credit
+ * for a send type, messages of this type are only written within the credit. The other messages wait
+ * in the queue, so the send policy of the connection applies, if the client does not grant enough.
+ *
+ * The optional UDP stream (see udp_stream.c) has an own queue, that always drops the oldest packet.
+ *
+ * The functions below takes care about putting the data (also from interrupts) into the queues. The
+ * queues are lock free (see adc_queue.c), so the server task takes descriptors without masking
+ * interrupts. Putting a descriptor into all queues and the reference counting are still done with
+ * masked interrupts (see send_data_lock), so a descriptor is queued for all connections at once.
  *
  *  Created on: Oct 24, 2018
  *      Author: finn
@@ -26,162 +48,786 @@
 #include "state.h"
 #include "measure.h"
 #include "websocket.h"
+#include "udp_stream.h"
+#include "overload.h"
+#include "shaper.h"
+#include "recorder.h"
 
+uint8_t send_queue_flush;
+uint8_t initialized = 0;
+static volatile uint8_t status_dropped; // A state message was dropped, see note_status_drop
+
+// The headers of all data descriptors. They stay in the DTCM, only the payload is in the SDRAM.
+DEFINE_POOL(data_descriptor_pool, DATA_DESCRIPTOR_POOL_SIZE, DataDescriptor);
+
+// The payload buffers per size class, see DATA_BUFFER_SMALL_SIZE.
+typedef struct {
+	uint8_t data[DATA_BUFFER_SMALL_SIZE];
+} data_buffer_small_t;
 typedef struct {
-	Queue* queue;
-	uint8_t is_data_task;
-} send_task_argument_t;
+	uint8_t data[DATA_BUFFER_MTU_SIZE];
+} data_buffer_mtu_t;
+typedef struct {
+	uint8_t data[DATA_BUFFER_LARGE_SIZE];
+} data_buffer_large_t;
+DEFINE_POOL_IN_SECTION(data_buffer_small_pool, DATA_BUFFER_SMALL_COUNT, data_buffer_small_t, ".extsram");
+DEFINE_POOL_IN_SECTION(data_buffer_mtu_pool, DATA_BUFFER_MTU_COUNT, data_buffer_mtu_t, ".extsram");
+DEFINE_POOL_IN_SECTION(data_buffer_large_pool, DATA_BUFFER_LARGE_COUNT, data_buffer_large_t, ".extsram");
 
-// 4 arguments for every queue
-send_task_argument_t send_task_arguments[4];
+// Descriptors with a callback, that are not referenced anymore. The callback is called by the server task.
+#if RELEASE_QUEUE_SIZE < DATA_DESCRIPTOR_POOL_SIZE
+#error "The release queue must hold all data descriptors"
+#endif
+DEFINE_QUEUE(release_queue, RELEASE_QUEUE_SIZE);
 
-uint32_t lock_http_threshold;
-uint32_t release_http_threshold;
+// The transmit state for every connection. Indexed like the entries of the connection pool.
+static connection_tx_t connection_tx[MAX_CONNECTIONS];
+static uint8_t __aligned(4) coalesce_buffers[MAX_CONNECTIONS][COALESCE_BUFFER_SIZE] __section(".extsram");
+static uint32_t coalesce_deadline;
 
-uint8_t send_queue_flush;
-uint8_t initialized = 0;
-Queue* queues[4];
+// The queue for the UDP stream. It does not use coalescing.
+DEFINE_QUEUE(udp_queue, UDP_TX_QUEUE_SIZE);
+static uint32_t udp_dropped;
+
+// The send type index is the bit of the send type, see SEND_TYPE_COUNT.
+#define TYPE_INDEX(send_type)	__builtin_ctz(send_type)
+
+static const uint32_t queue_sizes[SEND_TYPE_COUNT] = {CONNECTION_TX_QUEUE_SIZE_DEBUG,
+		CONNECTION_TX_QUEUE_SIZE_STATUS, CONNECTION_TX_QUEUE_SIZE_DATA, CONNECTION_TX_QUEUE_SIZE_FFT};
+static const char* type_names[SEND_TYPE_COUNT] = {"debug", "status", "data", "fft"};
 
-// Space for all data descriptors
-DEFINE_POOL_IN_SECTION(data_descriptor_pool, DATA_DESCRIPTOR_POOL_SIZE, DataDescriptor, ".extsram");
-DEFINE_QUEUE(debug_queue, DEBUG_QUEUE_SIZE);
-DEFINE_QUEUE(status_queue, STATUS_QUEUE_SIZE);
-DEFINE_QUEUE(data_queue, DATA_QUEUE_SIZE);
-DEFINE_QUEUE(fft_queue, FFT_QUEUE_SIZE);
+// The send types, that share the connection by weight, in the order of the rounds. These are the classes
+// of the round robin of a connection.
+#define WEIGHTED_TYPES	3
+static const uint8_t weighted_types[WEIGHTED_TYPES] = {TYPE_INDEX(SEND_TYPE_DATA), TYPE_INDEX(SEND_TYPE_FFT),
+		TYPE_INDEX(SEND_TYPE_DEBUG)};
+static uint8_t weights[SEND_TYPE_COUNT];
+static uint8_t round_robin_weights[WEIGHTED_TYPES]; // The weights in the order of weighted_types
+#if WEIGHTED_TYPES > ROUND_ROBIN_MAX_CLASSES
+#error "The round robin must have a class for every weighted send type"
+#endif
+
+// The queueing latency per send type in ms: from putting a descriptor into the queue until it is written.
+typedef struct {
+	uint32_t messages;
+	uint32_t sum;
+	uint32_t max;
+} latency_stats_t;
+static latency_stats_t latency_stats[SEND_TYPE_COUNT];
+
+// Lost packets per cause, see DropCause.
+static uint32_t drop_counters[DROP_CAUSE_COUNT];
+static const char* drop_cause_names[DROP_CAUSE_COUNT] = {
+		"pool exhausted", "queue full", "drop oldest", "connection closed", "flush", "fft busy", "overload"};
 
 static uint8_t internal_send_data(uint8_t send_type, uint8_t* data, uint32_t len, void (*callback)(void*), void* cb_argument);
-void send_task_function(void const *argument);
+static void data_descriptor_release(DataDescriptor* dd);
+static void connection_tx_drop(connection_tx_t* tx, DropCause cause);
+static void connection_tx_drop_oldest(connection_tx_t* tx, uint8_t index);
+static void udp_drop_oldest();
+static void connection_tx_drop_pending(connection_tx_t* tx);
+static void transmit_udp();
+static uint8_t reclaim_data_descriptor(uint32_t buffer_size);
+static uint8_t data_descriptor_available(uint32_t buffer_size);
+static void data_descriptor_free(DataDescriptor* dd);
+static void call_released_callbacks();
+static uint8_t get_usage();
+static uint8_t has_credit(connection_tx_t* tx, DataDescriptor* d, uint8_t index);
+
+/**
+ * Masks all interrupts, that may send data. This can be used from tasks and interrupts.
+ */
+static inline UBaseType_t send_data_lock() {
+	return taskENTER_CRITICAL_FROM_ISR();
+}
 
 /**
- * Initializes the data send task.
+ * Restores the interrupt mask.
  */
-void send_data_init() {
+static inline void send_data_unlock(UBaseType_t mask) {
+	taskEXIT_CRITICAL_FROM_ISR(mask);
+}
+
+/**
+ * Initializes the data send service. Small messages are coalesced for at most `coalesce_deadline_ms`
+ * milliseconds. 0 disables coalescing.
+ */
+void send_data_init(uint8_t coalesce_deadline_ms) {
 	pool_init(data_descriptor_pool);
+	pool_init(data_buffer_small_pool);
+	pool_init(data_buffer_mtu_pool);
+	pool_init(data_buffer_large_pool);
+	coalesce_deadline = coalesce_deadline_ms;
 	send_queue_flush = 0;
+	status_dropped = 0;
 
-	lock_http_threshold = (uint32_t)((float)(DATA_QUEUE_SIZE)/4);
-	release_http_threshold = (uint32_t)((float)(DATA_QUEUE_SIZE)/8);
+	for (int i = 0; i < DROP_CAUSE_COUNT; i++) {
+		drop_counters[i] = 0;
+	}
+	for (int i = 0; i < SEND_TYPE_COUNT; i++) {
+		latency_stats[i].messages = 0;
+		latency_stats[i].sum = 0;
+		latency_stats[i].max = 0;
+	}
+	send_data_set_weights(TX_DEFAULT_WEIGHT_DATA, TX_DEFAULT_WEIGHT_FFT, TX_DEFAULT_WEIGHT_DEBUG);
 
-	queues[0] = debug_queue;
-	queues[1] = status_queue;
-	queues[2] = data_queue;
-	queues[3] = fft_queue;
+	queue_reset(release_queue);
+	for (int i = 0; i < MAX_CONNECTIONS; i++) {
+		QueueSlot* slots = connection_tx[i].queue_slots;
+		for (int j = 0; j < SEND_TYPE_COUNT; j++) {
+			queue_init(&connection_tx[i].queues[j], slots, queue_sizes[j]);
+			slots += queue_sizes[j];
+			connection_tx[i].pending[j] = NULL;
+		}
+		connection_tx[i].drop_pending = 0;
+		connection_tx[i].current = NULL;
+		connection_tx[i].credit_types = 0;
+		connection_tx[i].offset = 0;
+		connection_tx[i].dropped = 0;
+		connection_tx[i].coalesce_buffer = coalesce_buffers[i];
+		connection_tx[i].coalesced = 0;
+		connection_tx[i].coalesce_offset = 0;
+	}
+	queue_reset(udp_queue);
+	udp_dropped = 0;
 
-	send_task_arguments[0].queue = debug_queue;
-	send_task_arguments[0].is_data_task = 0;
-	send_task_arguments[1].queue = status_queue;
-	send_task_arguments[1].is_data_task = 0;
-	send_task_arguments[2].queue = data_queue;
-	send_task_arguments[2].is_data_task = 1;
-	send_task_arguments[3].queue = fft_queue;
-	send_task_arguments[3].is_data_task = 0;
+	initialized = 1;
+}
 
-	osThreadDef(send_task, send_task_function, osPriorityNormal, 4, 512);
-	for (int i = 0; i < 4; i++) {
-		osThreadCreate(osThread(send_task), (void*)(send_task_arguments + i));
+/**
+ * Assigns a transmit queue to the new connection. The connection must be allocated in the connection pool.
+ * WebSocket clients are browsers, that should not stop a measurement. So they will drop data instead, see
+ * http.c. All other connections block per default.
+ */
+void send_data_connection_open(connection_t* connection) {
+	connection_t **connections = (connection_t**)pool_get_entries(connection_pool);
+	uint32_t i = 0;
+	while (i < connection_pool->entrycount && connections[i] != connection) {
+		i++;
 	}
-	initialized = 1;
+	if (i == connection_pool->entrycount) {
+		Error_Handler();
+	}
+
+	connection_tx_t* tx = connection_tx + i;
+	for (int j = 0; j < SEND_TYPE_COUNT; j++) {
+		queue_reset(&tx->queues[j]);
+		tx->pending[j] = NULL;
+	}
+	round_robin_reset(&tx->round_robin);
+	tx->drop_pending = 0;
+	tx->current = NULL;
+	tx->offset = 0;
+	tx->dropped = 0;
+	tx->coalesced = 0;
+	tx->coalesce_offset = 0;
+	tx->credit_types = 0;
+
+	connection->send_policy = SEND_POLICY_BLOCK;
+	connection->close_requested = 0;
+	connection->tx = tx;
 }
 
 /**
- * The data send task.
- *
- * It handles sending all data given in the queue. The queue is provided via the argument.
- * Data descriptors contains a pointer to the data, the data length, data type and an optional callback.
- * Also an array for book-keeping, to which connection the data was send.
- *
- * The current data descriptor will be removed, if the data was transmitted to every associated connection.
- */
-void send_task_function(void const *_arg) {
-	send_task_argument_t* arg = (send_task_argument_t*)_arg;
-	Queue* queue = arg->queue;
-	while(1) {
-		osDelay(1);
-
-		// If we got a queue overflow, we want to inform the client about this.
-		// So we need to make space. If we had an overrun, we can clear the complete queue...
-		if (arg->is_data_task && send_queue_flush) {
-			http_permitted = 1;
-			send_queue_flush = 0;
-			update_complete_state(1);
+ * Removes the transmit queue from the connection and releases all queued data. Must be called by the
+ * server task.
+ */
+void send_data_connection_close(connection_t* connection) {
+	connection_tx_t* tx = connection->tx;
+	if (NULL == tx) {
+		return;
+	}
+
+	UBaseType_t mask = send_data_lock();
+	connection->tx = NULL;
+	connection_tx_drop(tx, DROP_CAUSE_CLOSED);
+	send_data_unlock(mask);
+
+	// Nobody can access the descriptors anymore.
+	connection_tx_drop_pending(tx);
+	if (NULL != tx->current) {
+		data_descriptor_release(tx->current);
+		tx->current = NULL;
+		tx->offset = 0;
+	}
+	tx->coalesced = 0;
+	tx->coalesce_offset = 0;
+}
+
+/**
+ * Returns 1, if a message is partially written to the connection. The connection must not write
+ * anything else until the message is completed.
+ */
+uint8_t send_data_is_writing(connection_t* connection) {
+	connection_tx_t* tx = connection->tx;
+	return NULL != tx && (tx->offset > 0 || tx->coalesce_offset > 0);
+}
+
+/**
+ * Does the work of the send service, which is not bound to a connection. Called by the server task.
+ * Released descriptors with a callback are handled here, so the callbacks are never called from an
+ * interrupt. Returns 1, if small messages wait in a coalesce buffer, so the server task has to come
+ * back after the deadline.
+ */
+uint8_t send_data_process() {
+	// If we got a queue overflow, we want to inform the client about this.
+	if (send_queue_flush) {
+		send_queue_flush = 0;
+		update_complete_state(1);
+	}
+	if (status_dropped) {
+		status_dropped = 0;
+		send_full_state();
+	}
+
+	transmit_udp();
+
+	call_released_callbacks();
+
+	overload_process(get_usage());
+
+	for (int i = 0; i < MAX_CONNECTIONS; i++) {
+		if (connection_tx[i].coalesced > 0) {
+			return 1;
 		}
+	}
+	return 0;
+}
 
-		// try at most to empty the queue.
-		uint32_t queue_fill = queue_allocated(queue);
-		for (uint32_t i = 0; i < queue_fill; i++) {
-			DataDescriptor* d = (DataDescriptor*) queue_marker_front(queue);
-			if (d == NULL) {
-				break;
+/**
+ * Returns the usage of the data descriptors, the buffers for data packets and the queues of blocking
+ * connections in percent. The maximum of them is returned.
+ */
+static uint8_t get_usage() {
+	uint32_t usage = pool_get_used_entries_count(data_descriptor_pool) * 100 / DATA_DESCRIPTOR_POOL_SIZE;
+	uint32_t buffers = pool_get_used_entries_count(data_buffer_mtu_pool) * 100 / DATA_BUFFER_MTU_COUNT;
+	if (buffers > usage) {
+		usage = buffers;
+	}
+
+	connection_t **connections = (connection_t**)pool_get_entries(connection_pool);
+	for (uint32_t i = 0; i < connection_pool->entrycount; i++) {
+		connection_t* c = connections[i];
+		if (NULL == c || NULL == c->tx || c->send_policy != SEND_POLICY_BLOCK) {
+			continue;
+		}
+		for (int j = 0; j < SEND_TYPE_COUNT; j++) {
+			uint32_t queue = queue_allocated(&c->tx->queues[j]) * 100 / queue_sizes[j];
+			if (queue > usage) {
+				usage = queue;
+			}
+		}
+	}
+	return (uint8_t)usage;
+}
+
+/**
+ * Writes data from *offset up to len non blocking to the connection. Returns 1, if all data is written.
+ * If the connection is broken, all queued data of the connection is dropped and 1 is returned, too.
+ * The server task will notice the broken connection on the next receive.
+ */
+static uint8_t write_partly(connection_t* c, uint8_t* data, uint32_t* offset, uint32_t len) {
+	if (*offset >= len) {
+		return 1;
+	}
+
+	size_t written = 0;
+	err_t err = netconn_write_partly(c->conn, data + *offset, len - *offset,
+			NETCONN_COPY | NETCONN_DONTBLOCK, &written);
+	if (err == ERR_OK) {
+		*offset += written;
+	} else if (err != ERR_WOULDBLOCK) {
+		UBaseType_t mask = send_data_lock();
+		connection_tx_drop(c->tx, DROP_CAUSE_CLOSED);
+		send_data_unlock(mask);
+		*offset = len;
+	}
+	return *offset >= len;
+}
+
+/**
+ * Returns 1, if the descriptor may be written: Its send type is not flow controlled or there is enough
+ * credit. The credit is counted in bytes of the ADCP packet, so it is the same for TCP and WebSocket clients.
+ */
+static uint8_t has_credit(connection_tx_t* tx, DataDescriptor* d, uint8_t index) {
+	return !(tx->credit_types & (1 << index)) || tx->credit[index] >= d->adcp_len;
+}
+
+/**
+ * Returns 1, if the pending descriptor of the send type may be written now: There is credit and
+ * FFTs are within their rate (see shaper.c).
+ */
+static uint8_t may_write(connection_tx_t* tx, DataDescriptor* d, uint8_t index) {
+	return has_credit(tx, d, index) && (index != TYPE_INDEX(SEND_TYPE_FFT) || shaper_permits(SHAPER_CLASS_FFT));
+}
+
+/**
+ * Takes the pending descriptor of the send type for writing. The credit and the tokens are taken
+ * and the queueing latency is counted.
+ */
+static DataDescriptor* tx_take(connection_tx_t* tx, uint8_t index) {
+	DataDescriptor* d = tx->pending[index];
+	tx->pending[index] = NULL;
+	if (tx->credit_types & (1 << index)) {
+		tx->credit[index] -= d->adcp_len;
+	}
+	if (index == TYPE_INDEX(SEND_TYPE_FFT)) {
+		shaper_consume(SHAPER_CLASS_FFT, d->adcp_len);
+	}
+
+	uint32_t latency = osKernelSysTick() - d->queued_at;
+	latency_stats_t* stats = latency_stats + index;
+	stats->messages++;
+	stats->sum += latency;
+	if (latency > stats->max) {
+		stats->max = latency;
+	}
+	return d;
+}
+
+/**
+ * Returns the next descriptor, that should be written to the connection, or NULL, if no message may be
+ * written now. Status messages have strict priority. The other send types are served in rounds (deficit
+ * round robin, see round_robin.c): When it is the turn of a send type, it gets weight*TX_WEIGHT_QUANTUM
+ * bytes and writes messages as long as these bytes last. A send type without messages or credit loses
+ * its bytes, so it cannot save them up. Must be called by the server task.
+ */
+static DataDescriptor* tx_next(connection_tx_t* tx) {
+	if (tx->drop_pending) {
+		connection_tx_drop_pending(tx);
+	}
+	for (uint8_t i = 0; i < SEND_TYPE_COUNT; i++) {
+		if (NULL == tx->pending[i]) {
+			tx->pending[i] = (DataDescriptor*) queue_dequeue(&tx->queues[i]);
+		}
+	}
+
+	uint8_t index = TYPE_INDEX(SEND_TYPE_STATUS);
+	if (NULL != tx->pending[index] && may_write(tx, tx->pending[index], index)) {
+		return tx_take(tx, index);
+	}
+
+	// The ADCP header is part of every message, so a length is never 0.
+	uint32_t lengths[WEIGHTED_TYPES];
+	for (uint8_t i = 0; i < WEIGHTED_TYPES; i++) {
+		index = weighted_types[i];
+		DataDescriptor* d = tx->pending[index];
+		lengths[i] = NULL != d && may_write(tx, d, index) ? d->adcp_len : 0;
+	}
+	uint8_t next = round_robin_next(&tx->round_robin, lengths, round_robin_weights, WEIGHTED_TYPES,
+			TX_WEIGHT_QUANTUM);
+	if (next == WEIGHTED_TYPES) {
+		return NULL;
+	}
+	return tx_take(tx, weighted_types[next]);
+}
+
+/**
+ * Sets the weights for data, FFT and debug messages (see tx_next). Returns 0, if a weight is not
+ * within 1..TX_WEIGHT_MAX.
+ */
+uint8_t send_data_set_weights(uint8_t data, uint8_t fft, uint8_t debug) {
+	if (data < 1 || data > TX_WEIGHT_MAX || fft < 1 || fft > TX_WEIGHT_MAX ||
+			debug < 1 || debug > TX_WEIGHT_MAX) {
+		return 0;
+	}
+	weights[TYPE_INDEX(SEND_TYPE_DATA)] = data;
+	weights[TYPE_INDEX(SEND_TYPE_FFT)] = fft;
+	weights[TYPE_INDEX(SEND_TYPE_DEBUG)] = debug;
+	for (uint8_t i = 0; i < WEIGHTED_TYPES; i++) {
+		round_robin_weights[i] = weights[weighted_types[i]];
+	}
+	return 1;
+}
+
+/**
+ * Returns the amount of messages, that wait to be written to the connection.
+ */
+uint32_t send_data_get_queued(connection_t* connection) {
+	connection_tx_t* tx = connection->tx;
+	if (NULL == tx) {
+		return 0;
+	}
+	uint32_t queued = 0;
+	for (int i = 0; i < SEND_TYPE_COUNT; i++) {
+		queued += queue_allocated(&tx->queues[i]) + (NULL != tx->pending[i]);
+	}
+	return queued;
+}
+
+/**
+ * Adds credit for one send type of the connection. The first grant enables the flow control for this
+ * type. CREDIT_UNLIMITED disables it again. The credit available afterwards is returned in `available`.
+ * Returns 0, if send_type is not exactly one send type. Must be called by the server task.
+ */
+uint8_t send_data_grant_credit(connection_t* c, uint8_t send_type, uint32_t credit, uint32_t* available) {
+	connection_tx_t* tx = c->tx;
+	if (NULL == tx || send_type == SEND_TYPE_NONE || send_type >= (1 << SEND_TYPE_COUNT) ||
+			(send_type & (send_type - 1)) != 0) {
+		return 0;
+	}
+
+	uint8_t index = TYPE_INDEX(send_type);
+	if (credit == CREDIT_UNLIMITED) {
+		tx->credit_types &= ~send_type;
+		*available = CREDIT_UNLIMITED;
+		network_server_wakeup();
+		return 1;
+	}
+	if (!(tx->credit_types & send_type)) {
+		tx->credit_types |= send_type;
+		tx->credit[index] = 0;
+	}
+	// Saturate below CREDIT_UNLIMITED
+	if (credit >= CREDIT_UNLIMITED - tx->credit[index]) {
+		tx->credit[index] = CREDIT_UNLIMITED - 1;
+	} else {
+		tx->credit[index] += credit;
+	}
+	*available = tx->credit[index];
+	network_server_wakeup(); // Write the messages, that waited for the credit.
+	return 1;
+}
+
+/**
+ * Writes as much queued data to the connection as the TCP send buffer takes. A message, that does not
+ * fit completely, is continued on the next call. Must be called by the server task.
+ *
+ * Messages, that fit into the coalesce buffer, are copied there and the descriptor is released. The buffer
+ * is written, if the next message does not fit, it contains at least one full segment or the oldest
+ * message waits longer than the deadline. So one write can fill many TCP segments instead of
+ * writing every small packet on its own. Bigger messages are written directly.
+ * Returns 1, if no message is partially written afterwards.
+ */
+uint8_t send_data_transmit(connection_t* c) {
+	connection_tx_t* tx = c->tx;
+	if (NULL == tx || c->close_requested) {
+		return 1;
+	}
+
+	uint8_t flush = 0;
+	while (1) {
+		// Write the coalesce buffer, if it is due or already partially written.
+		if (tx->coalesced > 0 && (flush || tx->coalesce_offset > 0)) {
+			if (!write_partly(c, tx->coalesce_buffer, &tx->coalesce_offset, tx->coalesced)) {
+				break; // The send buffer is full.
 			}
+			tx->coalesced = 0;
+			tx->coalesce_offset = 0;
+			flush = 0;
+			continue;
+		}
+
+		if (NULL == tx->current) {
+			tx->current = tx_next(tx);
+			tx->offset = 0;
 
-			// check every connection
-			connection_t **connections = (connection_t**)pool_get_entries(connection_pool);
-			for (uint32_t j = 0; j < connection_pool->entrycount; j++) {
-				if (d->connections[j]) {
+			if (NULL == tx->current) {
+				// Nothing more to coalesce (or no credit). Write the buffer, if it is worth it or waited long enough.
+				if (tx->coalesced >= TCP_MSS ||
+						(tx->coalesced > 0 && osKernelSysTick() - tx->coalesce_start >= coalesce_deadline)) {
+					flush = 1;
 					continue;
 				}
-				connection_t* c = connections[j];
-
-				if (NULL == c || NULL == c->conn || !(d->type & c->send_type)) {
-					d->connections[j] = 1; // Connection is handled (because it does not exist, or the send type does not match).
-				} else {
-					// We need to have a write access..
-					if (osMutexWait(c->write_mutex, 1) == osOK) {
-
-						// get the datapointer. It differs, which protocol we need to send the data to.
-						uint8_t* dataptr = NULL;
-						uint16_t datalen = 0;
-						if (c->type == CONNECTION_TYPE_TCP) {
-							dataptr = d->adcp_dataptr;
-							datalen = d->adcp_len;
-						} else if (c->type == CONNECTION_TYPE_WEBSOCKET) {
-							dataptr = d->ws_dataptr;
-							datalen = d->ws_len;
-						} else {
-							// This should never happen, or I missed a connection type
-							d->connections[j] = 1;
-							osMutexRelease(c->write_mutex);
-							continue;
-						}
-
-						// Write the data
-						netconn_write(c->conn, dataptr, datalen, NETCONN_COPY);
-
-						// Connection handeled
-						d->connections[j] = 1;
-						osMutexRelease(c->write_mutex);
-					}
-				}
+				break;
 			}
+		}
+		DataDescriptor* d = tx->current;
 
+		// get the datapointer. It differs, which protocol we need to send the data to.
+		uint8_t* dataptr;
+		uint16_t datalen;
+		if (c->type == CONNECTION_TYPE_TCP) {
+			dataptr = d->adcp_dataptr;
+			datalen = d->adcp_len;
+		} else if (c->type == CONNECTION_TYPE_WEBSOCKET) {
+			dataptr = d->ws_dataptr;
+			datalen = d->ws_len;
+		} else {
+			// This should never happen, or I missed a connection type
+			dataptr = NULL;
+			datalen = 0;
+		}
 
-			// check of data is send to all connections
-			uint8_t send_to_all = 1;
-			for (uint32_t j = 0; j < connection_pool->entrycount; j++) {
-				if (!d->connections[j]) {
-					send_to_all = 0;
-					break;
-				}
+		if (tx->offset == 0 && coalesce_deadline > 0 && datalen <= COALESCE_BUFFER_SIZE) {
+			if (datalen > COALESCE_BUFFER_SIZE - tx->coalesced) {
+				flush = 1; // Does not fit anymore. The message stays current.
+				continue;
 			}
-			if (send_to_all) {
-				queue_marker_dequeue(queue);
+			if (tx->coalesced == 0) {
+				tx->coalesce_start = osKernelSysTick();
+			}
+			memcpy(tx->coalesce_buffer + tx->coalesced, dataptr, datalen);
+			tx->coalesced += datalen;
+		} else {
+			// Keep the order: The coalesced messages must be written before.
+			if (tx->coalesced > 0) {
+				flush = 1;
+				continue;
+			}
+			if (!write_partly(c, dataptr, &tx->offset, datalen)) {
+				break; // The send buffer is full.
+			}
+		}
 
-				// Data is all send, call the callback.
-				if (NULL != d->callback) {
-					(*d->callback)(d->cb_argument);
-				}
+		// Message written or coalesced.
+		tx->current = NULL;
+		tx->offset = 0;
+		data_descriptor_release(d);
+	}
+
+	return !send_data_is_writing(c);
+}
+
+/**
+ * Sends all queued packets of the UDP stream.
+ */
+static void transmit_udp() {
+	DataDescriptor* batch[SEND_DATA_BATCH_SIZE];
+	uint32_t n;
+	while ((n = queue_dequeue_batch(udp_queue, (void**)batch, SEND_DATA_BATCH_SIZE)) > 0) {
+		for (uint32_t i = 0; i < n; i++) {
+			udp_stream_send(batch[i]->adcp_dataptr, batch[i]->adcp_len, batch[i]->udp_sequence);
+			data_descriptor_release(batch[i]);
+		}
+	}
+}
+
+/**
+ * Calls the callbacks of all released descriptors and frees them.
+ */
+static void call_released_callbacks() {
+	DataDescriptor* batch[SEND_DATA_BATCH_SIZE];
+	void (*callbacks[SEND_DATA_BATCH_SIZE])(void*);
+	void* cb_arguments[SEND_DATA_BATCH_SIZE];
+	uint32_t n;
+	while ((n = queue_dequeue_batch(release_queue, (void**)batch, SEND_DATA_BATCH_SIZE)) > 0) {
+		for (uint32_t i = 0; i < n; i++) {
+			callbacks[i] = batch[i]->callback;
+			cb_arguments[i] = batch[i]->cb_argument;
+			data_descriptor_free(batch[i]);
+		}
+
+		for (uint32_t i = 0; i < n; i++) {
+			(*callbacks[i])(cb_arguments[i]);
+		}
+	}
+}
+
+/**
+ * Decrements the references of the descriptor. If it is not referenced anymore, it is freed. If it has
+ * a callback, this will be done by the server task.
+ */
+static void data_descriptor_release(DataDescriptor* dd) {
+	UBaseType_t mask = send_data_lock();
+	if (dd->references > 0) {
+		dd->references--;
+	}
+	if (dd->references == 0) {
+		if (NULL == dd->callback) {
+			data_descriptor_free(dd);
+		} else if (queue_enqueue(release_queue, dd) == QUEUE_ERR) {
+			Error_Handler(); // Cannot happen: Every descriptor fits into the queue.
+		}
+	}
+	send_data_unlock(mask);
+}
+
+/**
+ * Frees the descriptor and its payload buffer.
+ */
+static void data_descriptor_free(DataDescriptor* dd) {
+	if (NULL != dd->buffer) {
+		pool_free(dd->buffer_pool, dd->buffer);
+	}
+	pool_free(data_descriptor_pool, (void*) dd);
+}
+
+/**
+ * Allocates a payload buffer with at least `size` bytes from the smallest size class with free
+ * buffers. The pool is returned in `pool`. Returns NULL, if no class has a free buffer.
+ */
+static uint8_t* data_buffer_alloc(uint32_t size, Pool** pool) {
+	Pool* classes[] = {data_buffer_small_pool, data_buffer_mtu_pool, data_buffer_large_pool};
+	const uint32_t sizes[] = {DATA_BUFFER_SMALL_SIZE, DATA_BUFFER_MTU_SIZE, DATA_BUFFER_LARGE_SIZE};
+	for (uint8_t i = 0; i < 3; i++) {
+		if (size > sizes[i]) {
+			continue;
+		}
+		uint8_t* buffer = pool_alloc(classes[i]);
+		if (NULL != buffer) {
+			*pool = classes[i];
+			return buffer;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Returns 1, if a descriptor and a buffer of `buffer_size` bytes can be allocated. A buffer size
+ * of 0 means, that no buffer is needed.
+ */
+static uint8_t data_descriptor_available(uint32_t buffer_size) {
+	if (pool_get_free_entries_count(data_descriptor_pool) == 0) {
+		return 0;
+	}
+	return buffer_size == 0 ||
+			(buffer_size <= DATA_BUFFER_SMALL_SIZE && pool_get_free_entries_count(data_buffer_small_pool) > 0) ||
+			(buffer_size <= DATA_BUFFER_MTU_SIZE && pool_get_free_entries_count(data_buffer_mtu_pool) > 0) ||
+			pool_get_free_entries_count(data_buffer_large_pool) > 0;
+}
+
+/**
+ * Remembers, that a state message was dropped. The next one must be a full state, because the
+ * clients cannot apply the following deltas. Must be called locked.
+ */
+static inline void note_status_drop(DataDescriptor* dd) {
+	if (dd->type == SEND_TYPE_STATUS) {
+		status_dropped = 1;
+	}
+}
+
+/**
+ * Drops all queued descriptors of the connection. Must be called locked. The pending descriptors belong
+ * to the server task, so they are dropped by it (see tx_next).
+ */
+static void connection_tx_drop(connection_tx_t* tx, DropCause cause) {
+	DataDescriptor* dd;
+	for (int i = 0; i < SEND_TYPE_COUNT; i++) {
+		while (NULL != (dd = (DataDescriptor*) queue_dequeue(&tx->queues[i]))) {
+			note_status_drop(dd);
+			data_descriptor_release(dd);
+			tx->dropped++;
+			drop_counters[cause]++;
+		}
+	}
+	tx->drop_pending_cause = cause;
+	tx->drop_pending = 1;
+}
+
+/**
+ * Drops the pending descriptors of the connection. Must be called by the server task.
+ */
+static void connection_tx_drop_pending(connection_tx_t* tx) {
+	UBaseType_t mask = send_data_lock();
+	for (int i = 0; i < SEND_TYPE_COUNT; i++) {
+		if (NULL != tx->pending[i]) {
+			note_status_drop(tx->pending[i]);
+			data_descriptor_release(tx->pending[i]);
+			tx->pending[i] = NULL;
+			tx->dropped++;
+			drop_counters[tx->drop_pending_cause]++;
+		}
+	}
+	tx->drop_pending = 0;
+	send_data_unlock(mask);
+}
+
+/**
+ * Drops the oldest queued descriptor of the send type. Must be called locked.
+ */
+static void connection_tx_drop_oldest(connection_tx_t* tx, uint8_t index) {
+	DataDescriptor* dd = (DataDescriptor*) queue_dequeue(&tx->queues[index]);
+	if (NULL == dd) {
+		return; // The server task was faster.
+	}
+	note_status_drop(dd);
+	data_descriptor_release(dd);
+	tx->dropped++;
+	drop_counters[DROP_CAUSE_DROP_OLDEST]++;
+}
+
+/**
+ * Drops the oldest packet of the UDP stream. Must be called locked.
+ */
+static void udp_drop_oldest() {
+	DataDescriptor* dd = (DataDescriptor*) queue_dequeue(udp_queue);
+	if (NULL == dd) {
+		return; // The server task was faster.
+	}
+	note_status_drop(dd);
+	data_descriptor_release(dd);
+	udp_dropped++;
+	drop_counters[DROP_CAUSE_DROP_OLDEST]++;
+	udp_stream_count_drop();
+}
+
+/**
+ * Applies the send policy to a connection with a full queue for the send type. Must be called locked.
+ * Returns 1, if there is space in the queue afterwards.
+ */
+static uint8_t apply_send_policy(connection_t* c, uint8_t index) {
+	connection_tx_t* tx = c->tx;
+	switch (c->send_policy) {
+	case SEND_POLICY_DROP_OLDEST:
+		connection_tx_drop_oldest(tx, index);
+		return 1;
+	case SEND_POLICY_DISCONNECT:
+		connection_tx_drop(tx, DROP_CAUSE_CLOSED);
+		c->close_requested = 1;
+		return 0;
+	case SEND_POLICY_BLOCK:
+	default:
+		return 0;
+	}
+}
+
+/**
+ * Returns the index of the send type, whose oldest packet should be dropped to reclaim memory, or
+ * SEND_TYPE_COUNT, if all queues are empty. Status messages are dropped last.
+ */
+static uint8_t reclaim_type_index(connection_tx_t* tx) {
+	static const uint8_t order[SEND_TYPE_COUNT] = {TYPE_INDEX(SEND_TYPE_FFT), TYPE_INDEX(SEND_TYPE_DATA),
+			TYPE_INDEX(SEND_TYPE_DEBUG), TYPE_INDEX(SEND_TYPE_STATUS)};
+	for (uint8_t i = 0; i < SEND_TYPE_COUNT; i++) {
+		if (!queue_empty(&tx->queues[order[i]])) {
+			return order[i];
+		}
+	}
+	return SEND_TYPE_COUNT;
+}
+
+/**
+ * Tries to free a data descriptor and a buffer of `buffer_size` bytes (see data_descriptor_available)
+ * by dropping the oldest packet of the UDP stream or a connection, that does not block. Must be called
+ * locked. Returns 1, if both can be allocated afterwards.
+ */
+static uint8_t reclaim_data_descriptor(uint32_t buffer_size) {
+	connection_t **connections = (connection_t**)pool_get_entries(connection_pool);
+	uint8_t dropped = 1;
+	while (dropped) {
+		dropped = 0;
+		if (!queue_empty(udp_queue)) {
+			udp_drop_oldest();
+			dropped = 1;
+
+			if (data_descriptor_available(buffer_size)) {
+				return 1;
 			}
 		}
+		for (uint32_t i = 0; i < connection_pool->entrycount; i++) {
+			connection_t* c = connections[i];
+			if (NULL == c || NULL == c->tx || c->send_policy == SEND_POLICY_BLOCK) {
+				continue;
+			}
+			uint8_t index = reclaim_type_index(c->tx);
+			if (index == SEND_TYPE_COUNT) {
+				continue;
+			}
+			if (c->send_policy == SEND_POLICY_DISCONNECT) {
+				connection_tx_drop(c->tx, DROP_CAUSE_CLOSED);
+				c->close_requested = 1;
+			} else {
+				connection_tx_drop_oldest(c->tx, index);
+			}
+			dropped = 1;
 
-		// Maybe release a blocked HTTP service, if this is the data thread.
-		if (arg->is_data_task) {
-			uint32_t count = pool_get_used_entries_count(data_descriptor_pool);
-			if (!http_permitted && count < release_http_threshold) {
-				http_permitted = 1;
-				print_to_debugger_str("RELEASE\n");
+			if (data_descriptor_available(buffer_size)) {
+				return 1;
 			}
 		}
 	}
+	return 0;
 }
 
 /**
@@ -199,8 +845,10 @@ void send_debug_data(char* buffer, uint16_t len) {
  * if the data size is below DATA_DESCRIPTOR_USER_SPACE. You will get an error, if the data is bigger,
  * so make sure it will fit. For larger chunks of data see send_data_non_copy.
  * The data must be RAW data! Do not add any headers, this will be done for you.
- * Returns 1 on success. Failures can be an out of memory, not initialized, or send_type is NONE.
- * Note: On failure because of memory, the current measurement is stopped, and the queues are flushed!
+ * Returns 1 on success. Failures can be an out of memory, a full queue of a blocking connection,
+ * not initialized, or send_type is NONE.
+ * Note: On failure the current measurement is stopped, and the queues are flushed! If the overload
+ * policy degrades (see overload.c) or the recorder is on, the packet is just dropped instead.
  */
 uint8_t send_data(uint8_t send_type, uint8_t* data, uint16_t len) {
 	if (!initialized || send_type == SEND_TYPE_NONE) {
@@ -208,7 +856,10 @@ uint8_t send_data(uint8_t send_type, uint8_t* data, uint16_t len) {
 	}
 
 	uint8_t ret = internal_send_data(send_type, data, len, NULL, NULL);
-	if (!ret) {
+	if (!ret && overload_is_degrading()) {
+		overload_report_failure();
+	} else if (!ret && !recorder_is_recording()) {
+		// The data is lost (the recorder would keep it). Stop the measurement.
 		if (is_measure_active()) {
 			measure_stop();
 		}
@@ -228,29 +879,56 @@ inline uint8_t send_data_non_copy(uint8_t send_type, uint8_t* data, uint32_t len
 }
 
 /**
- * Allocates a datadescriptor, fill it appropriately, set headers to the given data and put in in a queue.
- * Returns 1 on success. Failures can be no memory.
+ * Allocates a datadescriptor, fill it appropriately, set headers to the given data and put in in the
+ * queues of all subscribed connections.
+ * Returns 1 on success. Failures can be no memory or a full queue of a blocking connection.
  *
  * if callback is NULL, the data will be copied and must not be bigger then 4K!
  */
 static uint8_t internal_send_data(uint8_t send_type, uint8_t* data, uint32_t len, void (*callback)(void*), void* cb_argument) {
-	DataDescriptor* dd = pool_alloc(data_descriptor_pool);
-	if (NULL == dd) {
+	if (NULL == callback && len > DATA_DESCRIPTOR_USER_SPACE) {
+		Error_Handler();
+	}
+
+	connection_t **connections = (connection_t**)pool_get_entries(connection_pool);
+	uint8_t index = TYPE_INDEX(send_type);
+	UBaseType_t mask = send_data_lock();
+
+	// A blocking connection with a full queue lets the producer fail. Check this before anything is queued.
+	for (uint32_t i = 0; i < connection_pool->entrycount; i++) {
+		connection_t* c = connections[i];
+		if (NULL != c && NULL != c->tx && (send_type & c->send_type) &&
+				c->send_policy == SEND_POLICY_BLOCK && queue_full(&c->tx->queues[index])) {
+			drop_counters[DROP_CAUSE_QUEUE_FULL]++;
+			send_data_unlock(mask);
+			return 0;
+		}
+	}
+
+	// Copied data needs a buffer for the payload and the headers.
+	uint32_t buffer_size = NULL == callback ? len + DATA_DESCRIPTOR_BUFFER_RESERVED : 0;
+	if (!data_descriptor_available(buffer_size) && !reclaim_data_descriptor(buffer_size)) {
+		drop_counters[DROP_CAUSE_POOL_EXHAUSTED]++;
+		send_data_unlock(mask);
 		return 0;
 	}
+	DataDescriptor* dd = pool_alloc(data_descriptor_pool);
+	dd->buffer = NULL;
+	dd->buffer_pool = NULL;
+	if (buffer_size > 0) {
+		dd->buffer = data_buffer_alloc(buffer_size, &dd->buffer_pool);
+	}
+	dd->references = 0;
+	send_data_unlock(mask);
 
 	dd->callback = callback;
 	dd->cb_argument = cb_argument;
 
 	uint8_t* dataptr;
 
-	// If no callback is given, use the internal space
+	// If no callback is given, copy the data into the buffer
 	if (NULL == callback) {
-		// Check data length and copy data.
-		if (len > DATA_DESCRIPTOR_USER_SPACE) {
-			Error_Handler();
-		}
-		dataptr = dd->data + DATA_DESCRIPTOR_BUFFER_RESERVED;
+		dataptr = dd->buffer + DATA_DESCRIPTOR_BUFFER_RESERVED;
 		memcpy(dataptr, data, len);
 	} else {
 		// Just use the external data.
@@ -264,74 +942,107 @@ static uint8_t internal_send_data(uint8_t send_type, uint8_t* data, uint32_t len
 	dd->ws_dataptr = websocket_write_header(dd->adcp_dataptr, dd->adcp_len, &(dd->ws_len));
 
 	dd->type = send_type;
-	for (uint32_t i = 0; i < connection_pool->entrycount; i++) {
-		dd->connections[i] = 0;
-	}
-
-	// Find right queue..
-	Queue* queue = NULL;
-	switch(send_type) {
-	case SEND_TYPE_DEBUG:
-		queue = debug_queue;
-		break;
-	case SEND_TYPE_STATUS:
-		queue = status_queue;
-		break;
-	case SEND_TYPE_DATA:
-		queue = data_queue;
-		break;
-	case SEND_TYPE_FFT:
-		queue = fft_queue;
-		break;
-	default:
-		Error_Handler();
-	}
-	if (queue_enqueue(queue, dd) == QUEUE_ERR) {
-		pool_free(data_descriptor_pool, dd);
-		return 0;
-	}
+	dd->queued_at = osKernelSysTick();
 
-	for (int i = 0; i < 4; i++) {
-		Queue* q = queues[i];
-		if (!queue_is_marker_updating(q)) {
-			while(q->head != q->marker_head) {
-				void* _dd = queue_dequeue(q);
-				pool_free(data_descriptor_pool, _dd);
-			}
+	// Put it in all queues. The descriptor is referenced once more, so it cannot be released
+	// by a dropping connection while we are looping.
+	mask = send_data_lock();
+	dd->references = 1;
+	for (uint32_t i = 0; i < connection_pool->entrycount; i++) {
+		connection_t* c = connections[i];
+		if (NULL == c || NULL == c->tx || c->close_requested || !(send_type & c->send_type)) {
+			continue;
 		}
-	}
 
-	// Some debug info for a full data queue
-	uint32_t pool_count = pool_get_used_entries_count(data_descriptor_pool);
-	uint32_t data_queue_count = queue_allocated(data_queue);
-	if (pool_count > 8) {
-		char b[128];
-		int l = sprintf(b, "pool: %lu, dqueue: %lu\n", pool_count, data_queue_count);
-		print_to_debugger(b,l);
+		Queue* queue = &c->tx->queues[index];
+		if (queue_full(queue) && !apply_send_policy(c, index)) {
+			continue;
+		}
+		if (queue_enqueue(queue, dd) == QUEUE_OK) {
+			dd->references++;
+		}
 	}
-
-	// Check for HTTP
-	if (queue == data_queue) {
-		if (http_permitted && data_queue_count > lock_http_threshold) {
-			http_permitted = 0;
-			print_to_debugger_str("AQUIRE\n");
+	if (send_type & udp_stream_get_send_type()) {
+		if (queue_full(udp_queue)) {
+			udp_drop_oldest();
+		}
+		dd->udp_sequence = udp_stream_next_sequence();
+		if (queue_enqueue(udp_queue, dd) == QUEUE_OK) {
+			dd->references++;
 		}
 	}
+	send_data_unlock(mask);
+	data_descriptor_release(dd);
+	network_server_wakeup();
 
 	return 1;
 }
 
 /**
- * Flushed the data queue. If it was flushed, a status update will be raised.
+ * Flushes the queues of all connections. A status update will be raised.
+ * Partially written messages are completed.
  */
 void send_queue_flush_and_update_status() {
 	send_queue_flush = 1;
 
-	for (int i = 0; i < 4; i++) {
-		Queue* q = queues[i];
-		while(!queue_empty(q)) {
-			DataDescriptor* dd = queue_dequeue(q);
-			pool_free(data_descriptor_pool, (void*) dd);
+	connection_t **connections = (connection_t**)pool_get_entries(connection_pool);
+	UBaseType_t mask = send_data_lock();
+	for (uint32_t i = 0; i < connection_pool->entrycount; i++) {
+		connection_t* c = connections[i];
+		if (NULL != c && NULL != c->tx) {
+			connection_tx_drop(c->tx, DROP_CAUSE_FLUSH);
 		}
 	}
+	DataDescriptor* dd;
+	while (NULL != (dd = (DataDescriptor*) queue_dequeue(udp_queue))) {
+		data_descriptor_release(dd);
+		udp_dropped++;
+		drop_counters[DROP_CAUSE_FLUSH]++;
+		udp_stream_count_drop();
+	}
+	send_data_unlock(mask);
+	network_server_wakeup();
+}
+
+/**
+ * Counts a lost packet. Can be called from interrupts.
+ */
+void send_data_count_drop(DropCause cause) {
+	UBaseType_t mask = send_data_lock();
+	drop_counters[cause]++;
+	send_data_unlock(mask);
+}
+
+/**
+ * Formats the lost packets per cause into the given buffer as a string with respect to max_length.
+ * Returns the length of the written string (excl. null terminator)
+ */
+uint16_t format_drop_stats(uint8_t* data, uint16_t max_length) {
+	char* pos = (char*)data;
+	pos += snprintf(pos, max_length - (pos - (char*)data), "Dropped packets:\n");
+	for (int i = 0; i < DROP_CAUSE_COUNT; i++) {
+		pos += snprintf(pos, max_length - (pos - (char*)data), "%s: %lu\n", drop_cause_names[i], drop_counters[i]);
+	}
+	pos += format_overload_stats((uint8_t*)pos, max_length - (pos - (char*)data));
+	return strlen((char*)data);
+}
+
+/**
+ * Formats the queueing latency per send type and the weights into the given buffer as a string with
+ * respect to max_length. Returns the length of the written string (excl. null terminator)
+ */
+uint16_t format_tx_stats(uint8_t* data, uint16_t max_length) {
+	char* pos = (char*)data;
+	pos += snprintf(pos, max_length - (pos - (char*)data), "Weights: data %u, fft %u, debug %u\n",
+			weights[TYPE_INDEX(SEND_TYPE_DATA)], weights[TYPE_INDEX(SEND_TYPE_FFT)],
+			weights[TYPE_INDEX(SEND_TYPE_DEBUG)]);
+	pos += snprintf(pos, max_length - (pos - (char*)data), "Queueing latency (ms):\n");
+	for (int i = 0; i < SEND_TYPE_COUNT; i++) {
+		latency_stats_t* stats = latency_stats + i;
+		pos += snprintf(pos, max_length - (pos - (char*)data), "%s: messages %lu, mean %lu, max %lu\n",
+				type_names[i], stats->messages, stats->messages > 0 ? stats->sum / stats->messages : 0,
+				stats->max);
+	}
+	pos += format_shaper_stats((uint8_t*)pos, max_length - (pos - (char*)data));
+	return strlen((char*)data);
 }
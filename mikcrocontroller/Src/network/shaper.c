@@ -0,0 +1,137 @@
+/*
+ * shaper.c
+ *
+ * Limits bulk traffic to a configured rate with a token bucket per class. A timer adds the tokens of
+ * SHAPER_INTERVAL to every bucket. A sender may write, as long as its bucket has tokens, and takes
+ * the written bytes afterwards, so a bucket may become negative by one write. If a sender has to wait,
+ * the timer wakes up the server task, when there are tokens again. So nobody polls.
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: finn
+ */
+
+#include "shaper.h"
+#include "network.h"
+#include "cmsis_os.h"
+#include "stdio.h"
+
+typedef struct {
+	uint32_t rate; // kB/s. 0 does not limit the class.
+	int32_t tokens; // Bytes
+	uint8_t waiting; // A sender waits for tokens.
+	uint32_t waits;
+	uint32_t bytes;
+} bucket_t;
+
+static bucket_t buckets[SHAPER_CLASS_COUNT];
+static const char* class_names[SHAPER_CLASS_COUNT] = {"http", "fft"};
+
+static osTimerId refill_timer;
+
+static void refill(void const *argument);
+
+/**
+ * Initializes the buckets with the default rates and starts the timer.
+ */
+void shaper_init() {
+	for (int i = 0; i < SHAPER_CLASS_COUNT; i++) {
+		buckets[i].tokens = 0;
+		buckets[i].waiting = 0;
+		buckets[i].waits = 0;
+		buckets[i].bytes = 0;
+	}
+	buckets[SHAPER_CLASS_HTTP].rate = SHAPER_DEFAULT_RATE_HTTP;
+	buckets[SHAPER_CLASS_FFT].rate = SHAPER_DEFAULT_RATE_FFT;
+
+	osTimerDef(shaperTimer, refill);
+	refill_timer = osTimerCreate(osTimer(shaperTimer), osTimerPeriodic, NULL);
+	osTimerStart(refill_timer, SHAPER_INTERVAL);
+}
+
+/**
+ * Sets the rate of the class in kB/s. 0 does not limit the class. Returns 0, if the class does not exist.
+ */
+uint8_t shaper_set_rate(uint8_t shaper_class, uint32_t rate) {
+	if (shaper_class >= SHAPER_CLASS_COUNT) {
+		return 0;
+	}
+	taskENTER_CRITICAL();
+	buckets[shaper_class].rate = rate;
+	buckets[shaper_class].tokens = 0;
+	taskEXIT_CRITICAL();
+	network_server_wakeup(); // A waiting sender may be unlimited now.
+	return 1;
+}
+
+/**
+ * Returns 1, if the class may write now. Otherwise the server task is woken up, when it may write
+ * again. Called by the server task.
+ */
+uint8_t shaper_permits(uint8_t shaper_class) {
+	bucket_t* bucket = buckets + shaper_class;
+	uint8_t permitted;
+	taskENTER_CRITICAL();
+	permitted = bucket->rate == 0 || bucket->tokens > 0;
+	if (!permitted && !bucket->waiting) {
+		bucket->waiting = 1;
+		bucket->waits++;
+	}
+	taskEXIT_CRITICAL();
+	return permitted;
+}
+
+/**
+ * Takes the written bytes from the bucket of the class. Called by the server task.
+ */
+void shaper_consume(uint8_t shaper_class, uint32_t bytes) {
+	bucket_t* bucket = buckets + shaper_class;
+	taskENTER_CRITICAL();
+	bucket->bytes += bytes;
+	if (bucket->rate > 0) {
+		bucket->tokens -= bytes;
+	}
+	taskEXIT_CRITICAL();
+}
+
+/**
+ * Called by the timer. Adds the tokens of one interval to all buckets and wakes up the server task,
+ * if a waiting class has tokens again.
+ */
+static void refill(void const *argument) {
+	uint8_t wakeup = 0;
+	taskENTER_CRITICAL();
+	for (int i = 0; i < SHAPER_CLASS_COUNT; i++) {
+		bucket_t* bucket = buckets + i;
+		if (bucket->rate == 0) {
+			continue;
+		}
+		int32_t burst = bucket->rate * 1024 / 1000 * SHAPER_BURST;
+		bucket->tokens += bucket->rate * 1024 / 1000 * SHAPER_INTERVAL;
+		if (bucket->tokens > burst) {
+			bucket->tokens = burst;
+		}
+		if (bucket->waiting && bucket->tokens > 0) {
+			bucket->waiting = 0;
+			wakeup = 1;
+		}
+	}
+	taskEXIT_CRITICAL();
+
+	if (wakeup) {
+		network_server_wakeup();
+	}
+}
+
+/**
+ * Formats the rates and statistics of all classes into the given buffer as a string with respect to
+ * max_length. Returns the length of the written string (excl. null terminator)
+ */
+uint16_t format_shaper_stats(uint8_t* data, uint16_t max_length) {
+	char* pos = (char*)data;
+	for (int i = 0; i < SHAPER_CLASS_COUNT; i++) {
+		bucket_t* bucket = buckets + i;
+		pos += snprintf(pos, max_length - (pos - (char*)data), "Shaper %s: rate %lu kB/s, tokens %ld, "
+				"bytes %lu, waits %lu\n", class_names[i], bucket->rate, bucket->tokens, bucket->bytes, bucket->waits);
+	}
+	return pos - (char*)data;
+}
@@ -1,6 +1,11 @@
 /*
  * tcp.c
  *
+ * A TCP client either sends one ADCP message per segment or, if the first message was framed, frames
+ * with the length of the message in front: [length (u16)][prefix][command][args]. The frames are
+ * collected in the request buffer of the connection, so a frame may span segments and one segment may
+ * hold many frames. The responses of all handled frames are written at once.
+ *
  *  Created on: Oct 15, 2018
  *      Author: finn
  */
@@ -9,30 +14,105 @@
 #include "adcp.h"
 #include "lwip/api.h"
 #include "stdio.h"
+#include "string.h"
+
+// ADCP response with 1 byte of payload: The error code.
+static const uint8_t message_too_long_error_code[] = {
+		SEND_TYPE_NONE, 1, 0, RESPONSE_MESSAGE_TOO_LONG
+};
 
-// Used to give responses, if no memory could be allocated.
-static uint8_t TCP_no_mem_error_code = RESPONSE_NO_MEMORY;
+static uint8_t handle_message(connection_t* connection, uint8_t* data, uint16_t len);
+static uint16_t get_frame_length(uint8_t* data, uint16_t len);
 
 /**
- * Handles incoming message data with length len on the given connection. Passes the message
- * through ADCP and writes the response.
+ * Handles incoming data with length len on the given connection. If the connection is framed, the
+ * data is appended to the request buffer and all complete frames are handled. Otherwise the data is
+ * one message.
  */
 uint8_t handle_TCP(connection_t* connection, uint8_t* data, uint16_t len) {
-	// Try to get some memory
-	connection_data_t* response = (connection_data_t*) pool_alloc(connection_data_pool);
-	if (NULL == response) {
-		netconn_write(connection->conn, &TCP_no_mem_error_code, 1, NETCONN_COPY);
+	if (!connection->framed) {
+		return handle_message(connection, data, len);
+	}
+
+	connection_data_t* d = connection->data;
+	if (len > CONNECTION_REQUEST_BUFFER_SIZE - d->request_len) {
+		d->request_len = 0;
+		connection_write(connection, message_too_long_error_code, sizeof(message_too_long_error_code));
 		return EXIT;
 	}
+	memcpy(d->request + d->request_len, data, len);
+	d->request_len += len;
+	return tcp_handle_pending_frames(connection);
+}
 
-	// use the connection buffer for the response.
-	uint8_t* out_data = (uint8_t*)response->buffer;
-	uint16_t out_len = 0;
-	uint8_t exit = adcp_handle_command(connection, data, len, out_data, &out_len, CONNECTION_BUFFER_SIZE);
+/**
+ * Returns 1, if a complete frame waits in the request buffer of the connection.
+ */
+uint8_t tcp_frame_pending(connection_t* connection) {
+	connection_data_t* d = connection->data;
+	return connection->framed && get_frame_length((uint8_t*)d->request, d->request_len) > 0;
+}
+
+/**
+ * Handles the complete frames of the request buffer, as long as the output buffer has space for the
+ * responses, and removes them from the buffer. The other frames are handled, when the output is written.
+ */
+uint8_t tcp_handle_pending_frames(connection_t* connection) {
+	connection_data_t* d = connection->data;
+	uint8_t* request = (uint8_t*)d->request;
+	uint16_t offset = 0;
+	uint16_t frame_len;
+	uint16_t max_len;
+	uint8_t exit = NOEXIT;
+
+	while (exit == NOEXIT && (frame_len = get_frame_length(request + offset, d->request_len - offset)) > 0) {
+		connection_write_begin(connection, &max_len);
+		if (max_len < TCP_MIN_RESPONSE_SPACE) {
+			break;
+		}
+		exit = handle_message(connection, request + offset + TCP_FRAME_HEADER_SIZE,
+				frame_len - TCP_FRAME_HEADER_SIZE);
+		offset += frame_len;
+	}
 
-	// Write message.
-	netconn_write(connection->conn, out_data, out_len, NETCONN_COPY);
+	d->request_len -= offset;
+	memmove(request, request + offset, d->request_len);
 
-	pool_free(connection_data_pool, response);
+	// A frame, that does not fit into the buffer, can never be handled.
+	if (exit == NOEXIT && d->request_len >= TCP_FRAME_HEADER_SIZE &&
+			*(uint16_t*)request > TCP_MAX_FRAME_LENGTH) {
+		d->request_len = 0;
+		connection_write(connection, message_too_long_error_code, sizeof(message_too_long_error_code));
+		exit = EXIT;
+	}
+	return exit;
+}
+
+/**
+ * Passes one message through ADCP and writes the response into the output buffer of the connection.
+ */
+static uint8_t handle_message(connection_t* connection, uint8_t* data, uint16_t len) {
+	// use the output buffer of the connection for the response.
+	uint16_t max_len;
+	uint8_t* out_data = connection_write_begin(connection, &max_len);
+	uint16_t out_len = 0;
+	uint8_t exit = adcp_handle_command(connection, data, len, out_data, &out_len, max_len);
+
+	connection_write_end(connection, out_data, out_len);
 	return exit;
 }
+
+/**
+ * Returns the length of the frame incl. the header at the beginning of the data, if it is complete.
+ * Otherwise 0.
+ */
+static uint16_t get_frame_length(uint8_t* data, uint16_t len) {
+	if (len < TCP_FRAME_HEADER_SIZE) {
+		return 0;
+	}
+	uint16_t message_len = *(uint16_t*)data;
+	if (message_len > TCP_MAX_FRAME_LENGTH || len < TCP_FRAME_HEADER_SIZE + message_len) {
+		return 0;
+	}
+	return TCP_FRAME_HEADER_SIZE + message_len;
+}
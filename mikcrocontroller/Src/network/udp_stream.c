@@ -0,0 +1,146 @@
+/*
+ * udp_stream.c
+ *
+ * Optional UDP channel for streamed data. A client configures one destination (unicast or multicast)
+ * and the send types to stream with the ADCP command CONNECTION_SET_UDP_STREAM. Every packet is
+ * transmitted once, regardless of the amount of receivers in a multicast group.
+ *
+ * Each datagram is a 32 bit sequence number (little endian) followed by one ADCP packet, exactly
+ * like it is send over TCP. There are no retransmissions: Receivers detect lost packets by gaps
+ * in the sequence. The sequence number is assigned, when the packet is queued (see send_data.c), so
+ * packets dropped from the queue are gaps, too.
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: finn
+ */
+
+#include "udp_stream.h"
+#include "lwip/api.h"
+#include "lwip/pbuf.h"
+#include "connection.h"
+#include "cmsis_os.h"
+#include "string.h"
+#include "stdio.h"
+
+static struct netconn* udp_connection = NULL;
+static ip_addr_t udp_destination;
+static uint16_t udp_port;
+static volatile uint8_t udp_send_type = SEND_TYPE_NONE;
+
+static uint32_t udp_sequence = 0;
+static uint32_t udp_sent = 0;
+static uint32_t udp_failed = 0; // Could not be handed to the network
+static uint32_t udp_dropped = 0; // Dropped from the queue
+
+/**
+ * Sets the destination and the send types of the stream. A send type of SEND_TYPE_NONE disables the stream.
+ * The sequence starts at 0 for every new configuration.
+ * Returns 0, if the netconn could not be created.
+ */
+uint8_t udp_stream_configure(ip_addr_t* destination, uint16_t port, uint8_t send_type) {
+	// Stop streaming, while changing the destination.
+	udp_send_type = SEND_TYPE_NONE;
+
+	if (send_type == SEND_TYPE_NONE) {
+		return 1;
+	}
+
+	if (NULL == udp_connection) {
+		udp_connection = netconn_new(NETCONN_UDP);
+		if (NULL == udp_connection) {
+			return 0;
+		}
+	}
+
+	ip_addr_copy(udp_destination, *destination);
+	udp_port = port;
+	udp_sequence = 0;
+	udp_sent = 0;
+	udp_failed = 0;
+	udp_dropped = 0;
+	udp_send_type = send_type;
+	return 1;
+}
+
+/**
+ * Returns the send types, that should be streamed.
+ */
+inline uint8_t udp_stream_get_send_type() {
+	return udp_send_type;
+}
+
+/**
+ * Returns the sequence number for the next queued packet. Must be called with masked interrupts,
+ * see send_data.c.
+ */
+inline uint32_t udp_stream_next_sequence() {
+	return udp_sequence++;
+}
+
+/**
+ * Sends the ADCP packet as one datagram. It is used by the server task.
+ * The packet is copied into pool pbufs, so the given memory is free after this call.
+ * Returns 1 on success. A failed packet is counted and leaves a gap in the sequence.
+ */
+uint8_t udp_stream_send(uint8_t* packet, uint16_t len, uint32_t sequence) {
+	if (udp_send_type == SEND_TYPE_NONE) {
+		return 0;
+	}
+
+	if (len > UDP_STREAM_MAX_PACKET_SIZE) {
+		udp_failed++;
+		return 0;
+	}
+
+	struct netbuf* buf = netbuf_new();
+	if (NULL == buf) {
+		udp_failed++;
+		return 0;
+	}
+	// Do not use netbuf_alloc: It takes the memory from the (small) lwIP heap.
+	buf->p = pbuf_alloc(PBUF_TRANSPORT, UDP_STREAM_SEQUENCE_SIZE + len, PBUF_POOL);
+	if (NULL == buf->p) {
+		netbuf_delete(buf);
+		udp_failed++;
+		return 0;
+	}
+	buf->ptr = buf->p;
+
+	uint8_t sequence_bytes[UDP_STREAM_SEQUENCE_SIZE];
+	memcpy(sequence_bytes, &sequence, UDP_STREAM_SEQUENCE_SIZE);
+	pbuf_take(buf->p, sequence_bytes, UDP_STREAM_SEQUENCE_SIZE);
+	pbuf_take_at(buf->p, packet, len, UDP_STREAM_SEQUENCE_SIZE);
+
+	err_t err = netconn_sendto(udp_connection, buf, &udp_destination, udp_port);
+	netbuf_delete(buf);
+
+	if (err != ERR_OK) {
+		udp_failed++;
+		return 0;
+	}
+	udp_sent++;
+	return 1;
+}
+
+/**
+ * Counts a packet, that was dropped from the queue before it could be send.
+ * Must be called with masked interrupts.
+ */
+inline void udp_stream_count_drop() {
+	udp_dropped++;
+}
+
+/**
+ * Formats the stream configuration and statistics into the given buffer as a string with respect to max_length.
+ * Returns the length of the written string (excl. null terminator)
+ */
+uint16_t format_udp_stream_stats(uint8_t* data, uint16_t max_length) {
+	if (udp_send_type == SEND_TYPE_NONE) {
+		return snprintf((char*)data, max_length, "UDP stream: -\n");
+	}
+
+	char ip[16];
+	ip4addr_ntoa_r(&udp_destination, ip, sizeof(ip));
+	return snprintf((char*)data, max_length, "UDP stream: %s:%u, Datatype 0x%02x, Sequence %lu, Sent %lu, Failed %lu, Dropped %lu\n",
+			ip, udp_port, udp_send_type, udp_sequence, udp_sent, udp_failed, udp_dropped);
+}
@@ -17,12 +17,8 @@
 
 #define WEBSOCKET_BINARY_PACKAGE	0b10000010
 
-// Websocket packet with 1 byte of payload: RESPONSE_NO_MEMORY.
+// Websocket packets with 1 byte of payload: The error code.
 // The first two bytes are FIN, opcode=2 (binary frame) and payloadlength = 1.
-const uint8_t  WebSocket_no_mem_error_code[] = {
-		WEBSOCKET_BINARY_PACKAGE, 1, RESPONSE_NO_MEMORY
-};
-
 const uint8_t  WebSocket_message_too_long_error_code[] = {
 		WEBSOCKET_BINARY_PACKAGE, 1, RESPONSE_MESSAGE_TOO_LONG
 };
@@ -81,8 +77,8 @@ uint8_t handle_WebSocket(connection_t* connection, uint8_t* data, uint16_t len)
 		payload_length = data[3] | (data[2] << 8);
 		offset += 2;
 	} else if (payload_length == 127) {
-		netconn_write(connection->conn, WebSocket_message_too_long_error_code,
-			sizeof(WebSocket_message_too_long_error_code), NETCONN_COPY);
+		connection_write(connection, WebSocket_message_too_long_error_code,
+			sizeof(WebSocket_message_too_long_error_code));
 		// We do not support payloads above 64K of size.
 	}
 
@@ -100,8 +96,8 @@ uint8_t handle_WebSocket(connection_t* connection, uint8_t* data, uint16_t len)
 	uint8_t exit = NOEXIT;
 	switch(opcode) {
 	case 1: // text frame: Not supported.
-		netconn_write(connection->conn, WebSocket_message_type_not_supported_error_code,
-					sizeof(WebSocket_message_type_not_supported_error_code), NETCONN_COPY);
+		connection_write(connection, WebSocket_message_type_not_supported_error_code,
+					sizeof(WebSocket_message_type_not_supported_error_code));
 		break;
 	case 2: // binary frame
 		exit = handle_frame(connection, payload, payload_length);
@@ -124,17 +120,15 @@ uint8_t handle_WebSocket(connection_t* connection, uint8_t* data, uint16_t len)
 }
 
 /**
- * Send a pong response to a ping. Tricky: We must return all payload data, so we need to reserve some
- * buffer space.
+ * Send a pong response to a ping. Tricky: We must return all payload data, so the pong is built in
+ * the output buffer.
  */
 static void send_pong(connection_t* connection, uint8_t* data, uint16_t len) {
-	// Try to get some memory
-	connection_data_t* response = (connection_data_t*) pool_alloc(connection_data_pool);
-	if (NULL == response) {
-		netconn_write(connection->conn, WebSocket_no_mem_error_code, sizeof(WebSocket_no_mem_error_code), NETCONN_COPY);
-		return;
+	uint16_t max_len;
+	uint8_t* buffer = connection_write_begin(connection, &max_len);
+	if (len > max_len - 4) {
+		return; // Does not fit.
 	}
-	uint8_t* buffer = (uint8_t*)response->buffer;
 
 	buffer[0] = 0x89; // FIN and opcode=9 (pong)
 	uint8_t* payload;
@@ -153,9 +147,7 @@ static void send_pong(connection_t* connection, uint8_t* data, uint16_t len) {
 	}
 
 	memcpy(payload, data, len); // copy data into the payload
-	netconn_write(connection->conn, buffer, package_len, NETCONN_COPY);
-
-	pool_free(connection_data_pool, response);
+	connection_write_end(connection, buffer, package_len);
 }
 
 /**
@@ -166,24 +158,19 @@ static void send_close(connection_t* connection) {
 		0x88, // FIN and opcode=8 (close)
 		0x00, // No mask, no payload
 	};
-	netconn_write(connection->conn, close_frame, sizeof(close_frame), NETCONN_COPY);
+	connection_write(connection, close_frame, sizeof(close_frame));
 }
 
 /**
  * Handle a frame from the connection.
  *
- * Reserved buffer and puts the request through ADCP. Writes the ADCP and WS headers and send the response.
+ * Puts the request through ADCP. Writes the ADCP and WS headers and the response into the output buffer.
  */
 static uint8_t handle_frame(connection_t* connection, uint8_t* data, uint16_t len) {
-	// Try to get some memory
-	connection_data_t* response = (connection_data_t*) pool_alloc(connection_data_pool);
-	if (NULL == response) {
-		netconn_write(connection->conn, WebSocket_no_mem_error_code, sizeof(WebSocket_no_mem_error_code), NETCONN_COPY);
-		return NOEXIT;
-	}
-	uint8_t* buffer = (uint8_t*)response->buffer;
+	uint16_t max_len;
+	uint8_t* buffer = connection_write_begin(connection, &max_len);
 
-	// We are going to write to the tcp connection directly. The format is:
+	// We are going to write into the output buffer directly. The format is:
 	//   |<-- space (2 or 0 bytes) -->|<-- WS header (2 or 4 bytes) -->|<-- ADCP header and payload -->|
 	//  (a)                          (b)                              (c)                             (d)
 	// buffer points to (a). We reserve all 4 bytes for the WS header and point with `package_begin` to the actual
@@ -197,7 +184,7 @@ static uint8_t handle_frame(connection_t* connection, uint8_t* data, uint16_t le
 	uint16_t ws_payload_length;
 
 	// Handle ADCP.
-	uint8_t exit = adcp_handle_command(connection, data, len, ws_payload_begin, &ws_payload_length, CONNECTION_BUFFER_SIZE-4);
+	uint8_t exit = adcp_handle_command(connection, data, len, ws_payload_begin, &ws_payload_length, max_len-4);
 
 	// Websocket. The header has either 2 or 4 byte length decided by the ws_payload_length.
 	// Do we need extended length?
@@ -206,9 +193,7 @@ static uint8_t handle_frame(connection_t* connection, uint8_t* data, uint16_t le
 	// print_hex(package_begin, package_length);
 
 	// Write message.
-	netconn_write(connection->conn, package_begin, package_length, NETCONN_COPY);
-
-	pool_free(connection_data_pool, response);
+	connection_write_end(connection, package_begin, package_length);
 	return exit;
 }
 
@@ -281,7 +266,7 @@ uint8_t websocket_handshake(connection_t* connection, request_headers_t* headers
 	char response[128 + WEBSOCKET_ACCEPT_LENGTH];
 	sprintf(response, "HTTP/1.1 101 Switching Protocols"CRLF"Upgrade: WebSocket"CRLF"Connection: upgrade"CRLF
 			"Sec-WebSocket-Accept: %s"CRLF""CRLF, accept_header);
-	netconn_write(connection->conn, response, strlen(response), NETCONN_COPY);
+	connection_write(connection, response, strlen(response));
 	return 1;
 }
 
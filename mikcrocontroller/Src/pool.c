@@ -1,12 +1,18 @@
 /*
  * pool.c
  *
+ * Fixed size blocks. The free blocks are linked in a list through their own memory, so allocating
+ * and freeing is O(1). The short list operations are done with masked interrupts, so the pool can be
+ * used from tasks and interrupts.
+ *
  *  Created on: Oct 22, 2018
  *      Author: finn
  */
 
 
 #include "pool.h"
+#include "error.h"
+#include "string.h"
 
 #ifdef POOL_USAGE_HIGH_WATERMARK
 #define POOL_UPDATE_USAGE_HIGH_WATERMARK(x)	pool_update_usage_high_watermark(x)
@@ -16,16 +22,58 @@ static void pool_update_usage_high_watermark(Pool* pool);
 #endif
 
 /**
- * Inits the pool. Do init every pool before using it!
+ * Masks all interrupts, that may use a pool. This can be used from tasks and interrupts.
+ */
+static inline UBaseType_t pool_lock() {
+	return taskENTER_CRITICAL_FROM_ISR();
+}
+
+/**
+ * Restores the interrupt mask.
+ */
+static inline void pool_unlock(UBaseType_t mask) {
+	taskEXIT_CRITICAL_FROM_ISR(mask);
+}
+
+/**
+ * Returns the next free block after the given one. The blocks may be unaligned (packed types), so
+ * the link is copied.
+ */
+static inline void* pool_next_free(void* block) {
+	void* next;
+	memcpy(&next, block, sizeof(void*));
+	return next;
+}
+
+static inline void pool_set_next_free(void* block, void* next) {
+	memcpy(block, &next, sizeof(void*));
+}
+
+/**
+ * Inits the pool. Do init every pool before using it! All entries are free afterwards.
  */
 void pool_init(Pool* pool) {
-	if (pool->type == PoolTypeDynamic) {
-		const osPoolDef_t pool_def = { pool->entrycount, pool->entrysize, NULL };
-		pool->pool.dyn = (void*)osPoolCreate(&pool_def);
+	if (pool->entrysize < sizeof(void*)) {
+		Error_Handler(); // The free list needs space for a pointer in every block.
 	}
+	if (pool->type == PoolTypeDynamic && NULL == pool->pool.dyn) {
+		pool->pool.dyn = pvPortMalloc(pool->entrycount * pool->entrysize);
+		if (NULL == pool->pool.dyn) {
+			Error_Handler();
+		}
+	}
+
+	// Link all blocks in order, so the first allocation gets the first block.
+	uint8_t* memory = pool->pool.stat;
+	pool->free_list = pool->entrycount > 0 ? memory : NULL;
 	for (uint32_t i = 0; i < pool->entrycount; i++) {
 		pool->free_management[i] = NULL;
+		pool_set_next_free(memory + i*pool->entrysize,
+				i + 1 < pool->entrycount ? memory + (i+1)*pool->entrysize : NULL);
 	}
+	pool->used = 0;
+	pool->allocations = 0;
+	pool->failures = 0;
 #ifdef POOL_USAGE_HIGH_WATERMARK
 	pool->usage_high_watermark = 0;
 #endif
@@ -35,60 +83,78 @@ void pool_init(Pool* pool) {
  * Allocates memory in the pool. Returns NULL if the pool is full.
  */
 void* pool_alloc(Pool* pool) {
-	if (pool->type == PoolTypeStatic) {
-		for (uint32_t i = 0; i < pool->entrycount; i++) {
-			if (NULL == pool->free_management[i]) {
-				pool->free_management[i] = pool->pool.stat + i*pool->entrysize;
-				POOL_UPDATE_USAGE_HIGH_WATERMARK(pool);
-				return (void*)pool->free_management[i];
-			}
-		}
-	} else { // dynamic.
-		for (uint32_t i = 0; i < pool->entrycount; i++) {
-			if (NULL == pool->free_management[i]) {
-				void* obj = osPoolAlloc(pool->pool.dyn);
-				if (NULL == obj) { // something is async... We think, that we have space, but cannot allocate memory??
-					Error_Handler();
-				}
-				pool->free_management[i] = obj;
-				POOL_UPDATE_USAGE_HIGH_WATERMARK(pool);
-				return obj;
-			}
-		}
+	UBaseType_t mask = pool_lock();
+	uint8_t* block = pool->free_list;
+	if (NULL == block) {
+		pool->failures++;
+		pool_unlock(mask);
+		return NULL;
 	}
-	return NULL;
+	pool->free_list = pool_next_free(block);
+	pool->free_management[(block - pool->pool.stat) / pool->entrysize] = block;
+	pool->used++;
+	pool->allocations++;
+	POOL_UPDATE_USAGE_HIGH_WATERMARK(pool);
+	pool_unlock(mask);
+	return (void*)block;
 }
 
 /**
- * Frees the given memory block in the pool.
+ * Allocates the entry with the given index, e.g. to restore entries with fixed ids. Returns NULL,
+ * if the entry is already allocated. The block is searched in the free list, so this is O(n).
  */
-uint8_t pool_free(Pool* pool, void* block) {
-	int32_t index = 0;
+void* pool_alloc_at(Pool* pool, uint32_t index) {
+	if (index >= pool->entrycount) {
+		return NULL;
+	}
+	uint8_t* block = pool->pool.stat + index*pool->entrysize;
 
-	if (pool->type == PoolTypeStatic) {
-		while(index < pool->entrycount && (pool->pool.stat + index*pool->entrysize) != (uint8_t*)block) {
-			index++;
-		}
-		if (index == pool->entrycount) {
-			return POOL_ERR;
-		} else {
-			pool->free_management[index] = NULL;
-			return POOL_OK;
-		}
+	UBaseType_t mask = pool_lock();
+	if (NULL != pool->free_management[index]) {
+		pool_unlock(mask);
+		return NULL;
+	}
+	// The entry is free, so it is in the free list. Unlink it.
+	if (pool->free_list == block) {
+		pool->free_list = pool_next_free(block);
 	} else {
-		// Free the block in the OS. Regardless of success, remove it here also.
-		osPoolFree(pool->pool.dyn, block);
-
-		while(index < pool->entrycount && pool->free_management[index] != block) {
-			index++;
-		}
-		if (index == pool->entrycount) {
-			return POOL_ERR;
-		} else {
-			pool->free_management[index] = NULL;
-			return POOL_OK;
+		uint8_t* previous = pool->free_list;
+		while (pool_next_free(previous) != block) {
+			previous = pool_next_free(previous);
 		}
+		pool_set_next_free(previous, pool_next_free(block));
+	}
+	pool->free_management[index] = block;
+	pool->used++;
+	pool->allocations++;
+	POOL_UPDATE_USAGE_HIGH_WATERMARK(pool);
+	pool_unlock(mask);
+	return (void*)block;
+}
+
+/**
+ * Frees the given memory block in the pool. Returns POOL_ERR, if the block is not
+ * an allocated entry of this pool.
+ */
+uint8_t pool_free(Pool* pool, void* block) {
+	uint8_t* b = (uint8_t*)block;
+	if (b < pool->pool.stat || b >= pool->pool.stat + pool->entrycount*pool->entrysize ||
+			(b - pool->pool.stat) % pool->entrysize != 0) {
+		return POOL_ERR;
+	}
+	uint32_t index = (b - pool->pool.stat) / pool->entrysize;
+
+	UBaseType_t mask = pool_lock();
+	if (NULL == pool->free_management[index]) {
+		pool_unlock(mask);
+		return POOL_ERR; // Already free.
 	}
+	pool->free_management[index] = NULL;
+	pool_set_next_free(block, pool->free_list);
+	pool->free_list = block;
+	pool->used--;
+	pool_unlock(mask);
+	return POOL_OK;
 }
 
 /**
@@ -109,14 +175,24 @@ inline uint32_t pool_get_free_entries_count(Pool* pool) {
 /**
  * Get the amount of used entries in the pool.
  */
-uint32_t pool_get_used_entries_count(Pool* pool) {
-	uint32_t count = 0;
-	for (uint32_t i = 0; i < pool->entrycount; i++) {
-		if (pool->free_management[i] != NULL) {
-			count++;
-		}
-	}
-	return count;
+inline uint32_t pool_get_used_entries_count(Pool* pool) {
+	return pool->used;
+}
+
+/**
+ * Copies the statistics of the pool.
+ */
+void pool_get_stats(Pool* pool, pool_stats_t* stats) {
+	UBaseType_t mask = pool_lock();
+	stats->used = pool->used;
+	stats->allocations = pool->allocations;
+	stats->failures = pool->failures;
+#ifdef POOL_USAGE_HIGH_WATERMARK
+	stats->high_watermark = pool->usage_high_watermark;
+#else
+	stats->high_watermark = 0;
+#endif
+	pool_unlock(mask);
 }
 
 /**
@@ -124,9 +200,8 @@ uint32_t pool_get_used_entries_count(Pool* pool) {
  */
 #ifdef POOL_USAGE_HIGH_WATERMARK
 static void pool_update_usage_high_watermark(Pool* pool) {
-	uint32_t usage = pool_get_used_entries_count(pool);
-	if (usage > pool->usage_high_watermark) {
-		pool->usage_high_watermark = usage;
+	if (pool->used > pool->usage_high_watermark) {
+		pool->usage_high_watermark = pool->used;
 	}
 }
 
@@ -8,6 +8,11 @@
 #include "sd_config.h"
 #include "fatfs.h"
 #include "string.h"
+#include "send_data.h"
+#include "stm32f7xx_hal.h"
+#include "overload.h"
+#include "shaper.h"
+#include "recorder.h"
 
 static sd_config_t sd_config;
 static char read_buffer[256];
@@ -17,6 +22,7 @@ static uint8_t read_from_sd_card();
 static void parse_read_buffer();
 static void parse_line(char* line);
 static void process_ip_address(char* value, ip_addr_t* dest);
+static void process_weight(char* value, uint8_t* dest);
 
 /**
  * Reads the config file from the sd card.
@@ -44,6 +50,16 @@ static void set_to_defaults() {
 	IP4_ADDR(&(sd_config.ip_addr), 192, 168, 1, 20);
 	IP4_ADDR(&(sd_config.netmask), 255, 255, 255, 0);
 	IP4_ADDR(&(sd_config.gateway), 192, 168, 1, 1);
+	sd_config.send_deadline = COALESCE_DEFAULT_DEADLINE;
+	sd_config.rx_buffers = ETH_RXBUFNB;
+	sd_config.overload_policy = OVERLOAD_POLICY_STOP;
+	sd_config.weight_data = TX_DEFAULT_WEIGHT_DATA;
+	sd_config.weight_fft = TX_DEFAULT_WEIGHT_FFT;
+	sd_config.weight_debug = TX_DEFAULT_WEIGHT_DEBUG;
+	sd_config.rate_http = SHAPER_DEFAULT_RATE_HTTP;
+	sd_config.rate_fft = SHAPER_DEFAULT_RATE_FFT;
+	sd_config.record_file_size = RECORDER_DEFAULT_FILE_SIZE;
+	sd_config.record_file_time = RECORDER_DEFAULT_FILE_TIME;
 }
 
 /*
@@ -138,6 +154,48 @@ void parse_line(char* line) {
 		process_ip_address(value, &(sd_config.netmask));
 	} else if (strcmp(key, "gateway") == 0) {
 		process_ip_address(value, &(sd_config.gateway));
+	} else if (strcmp(key, "send_deadline") == 0) {
+		int deadline = atoi(value);
+		if (deadline >= 0 && deadline < 255) {
+			sd_config.send_deadline = (uint8_t)deadline;
+		}
+	} else if (strcmp(key, "rx_buffers") == 0) {
+		int buffers = atoi(value);
+		if (buffers >= ETH_RX_MIN_BUFFERS && buffers <= ETH_RX_MAX_BUFFERS) {
+			sd_config.rx_buffers = (uint8_t)buffers;
+		}
+	} else if (strcmp(key, "overload_policy") == 0) {
+		if (strcmp(value, "stop") == 0) {
+			sd_config.overload_policy = OVERLOAD_POLICY_STOP;
+		} else if (strcmp(value, "degrade") == 0) {
+			sd_config.overload_policy = OVERLOAD_POLICY_DEGRADE;
+		}
+	} else if (strcmp(key, "weight_data") == 0) {
+		process_weight(value, &(sd_config.weight_data));
+	} else if (strcmp(key, "weight_fft") == 0) {
+		process_weight(value, &(sd_config.weight_fft));
+	} else if (strcmp(key, "weight_debug") == 0) {
+		process_weight(value, &(sd_config.weight_debug));
+	} else if (strcmp(key, "rate_http") == 0) {
+		int rate = atoi(value);
+		if (rate >= 0) {
+			sd_config.rate_http = (uint32_t)rate;
+		}
+	} else if (strcmp(key, "rate_fft") == 0) {
+		int rate = atoi(value);
+		if (rate >= 0) {
+			sd_config.rate_fft = (uint32_t)rate;
+		}
+	} else if (strcmp(key, "record_file_size") == 0) {
+		int size = atoi(value);
+		if (size >= 1 && size < 4096) { // FAT32 files must be smaller than 4G.
+			sd_config.record_file_size = (uint16_t)size;
+		}
+	} else if (strcmp(key, "record_file_time") == 0) {
+		int time = atoi(value);
+		if (time >= 0) {
+			sd_config.record_file_time = (uint32_t)time;
+		}
 	}
 }
 
@@ -151,3 +209,13 @@ static void process_ip_address(char* value, ip_addr_t* dest) {
 		ip4_addr_copy(*dest, ip_addr);
 	}
 }
+
+/**
+ * Stores the weight given as a string into `dest`, if it is valid (1..TX_WEIGHT_MAX).
+ */
+static void process_weight(char* value, uint8_t* dest) {
+	int weight = atoi(value);
+	if (weight >= 1 && weight <= TX_WEIGHT_MAX) {
+		*dest = (uint8_t)weight;
+	}
+}
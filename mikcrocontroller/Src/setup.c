@@ -16,7 +16,7 @@ SDRAM_HandleTypeDef sdramHandle;
 FMC_SDRAM_TimingTypeDef Timing;
 FMC_SDRAM_CommandTypeDef Command;
 
-static void disable_cache_for_sram();
+static void enable_mpu();
 static void SystemClock_Config();
 static void GPIO_Init();
 static void DMA_Init();
@@ -31,8 +31,7 @@ void setup() {
 	// Enable instruction- and datacache
 	SCB_EnableICache();
 	SCB_EnableDCache();
-	disable_cache_for_sram();
-	// https://community.st.com/s/question/0D50X00009XkbGoSAJ/stm32f7-dma-only-relieable-in-first-64k-of-ram
+	enable_mpu();
 
 	// Reset of all peripherals, Initializes the Flash interface and the Systick.
 	HAL_Init();
@@ -49,26 +48,12 @@ void setup() {
 }
 
 /**
- * Disables the cache for the main SRAM. This gave errors with DMA in the past...
+ * Enables the MPU with the default memory map as background, so the SRAM and the SDRAM are cached
+ * write-back. The drivers do the cache maintenance for their DMA buffers (see sd_diskio.c and
+ * ethernetif.c). The benchmark overrides the cacheability of its buffers with region 1.
  */
-static void disable_cache_for_sram() {
-	MPU_Region_InitTypeDef MPU_InitStruct;
-	// Disable the MPU
+static void enable_mpu() {
 	HAL_MPU_Disable();
-	// Configure the MPU attributes as WT for SRAM1 and SRAM2
-	MPU_InitStruct.Enable = MPU_REGION_ENABLE;
-	MPU_InitStruct.BaseAddress = 0x20010000;
-	MPU_InitStruct.Size = MPU_REGION_SIZE_256KB;
-	MPU_InitStruct.AccessPermission = MPU_REGION_FULL_ACCESS;
-	MPU_InitStruct.IsBufferable = MPU_ACCESS_NOT_BUFFERABLE;
-	MPU_InitStruct.IsCacheable = MPU_ACCESS_NOT_CACHEABLE;
-	MPU_InitStruct.IsShareable = MPU_ACCESS_SHAREABLE; // Not sharable (forum)
-	MPU_InitStruct.Number = MPU_REGION_NUMBER0;
-	MPU_InitStruct.TypeExtField = MPU_TEX_LEVEL1;
-	MPU_InitStruct.SubRegionDisable = 0x00;
-	MPU_InitStruct.DisableExec = MPU_INSTRUCTION_ACCESS_ENABLE;
-	HAL_MPU_ConfigRegion(&MPU_InitStruct);
-	// Enable the MPU
 	HAL_MPU_Enable(MPU_PRIVILEGED_DEFAULT);
 }
 
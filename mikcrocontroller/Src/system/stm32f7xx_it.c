@@ -35,6 +35,7 @@
 #include "stm32f7xx.h"
 #include "stm32f7xx_it.h"
 #include "cmsis_os.h"
+#include "benchmark.h"
 
 extern ETH_HandleTypeDef heth;
 extern TIM_HandleTypeDef htim2;
@@ -110,6 +111,13 @@ void TIM5_IRQHandler() {
 	HAL_TIM_IRQHandler(&htim5);
 }
 
+/**
+ * TIM7 is not used. Its interrupt is pended in software by the scheduler benchmark.
+ */
+void TIM7_IRQHandler() {
+	benchmark_irq_handler();
+}
+
 /**
  * @brief This function handles Ethernet global interrupt.
  */
@@ -0,0 +1,169 @@
+/*
+ * adc_queue_stress.c
+ *
+ * Host stress test for the lock free ADC queue. Several producer threads enqueue numbered entries,
+ * one consumer dequeues them in batches and checks, that every entry arrives exactly once and the
+ * entries of each producer stay in order. A second run lets the producers drop the oldest entry of
+ * a full queue, like the ADC interrupt does, so the head is claimed concurrently, too. Both runs start
+ * shortly before the positions wrap around at 2^32.
+ *
+ * Build and run from the mikcrocontroller folder:
+ *   gcc -std=gnu11 -O2 -Wall -pthread -IInc test/adc_queue_stress.c Src/network/adc_queue.c -o adc_queue_stress
+ *   ./adc_queue_stress
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: finn
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "adc_queue.h"
+
+#define QUEUE_LENGTH			64
+#define PRODUCERS				4
+#define ENTRIES_PER_PRODUCER	100000
+#define BATCH_SIZE				16
+
+// An entry is the producer in the upper bits and its index plus one in the lower bits, so it is never NULL.
+#define ENTRY(producer, index)	((void*) (((uintptr_t) (producer) << 24) | ((uintptr_t) (index) + 1)))
+#define ENTRY_PRODUCER(entry)	((uint32_t) ((uintptr_t) (entry) >> 24))
+#define ENTRY_INDEX(entry)		((uint32_t) ((uintptr_t) (entry) & 0xFFFFFF) - 1)
+
+DEFINE_QUEUE(queue, QUEUE_LENGTH)
+
+static uint8_t seen[PRODUCERS][ENTRIES_PER_PRODUCER];
+static volatile uint32_t producers_done;
+static volatile uint32_t dropped;
+static uint8_t drop_oldest;
+
+void _Error_Handler(char* file, int line) {
+	fprintf(stderr, "Error_Handler called in %s:%d\n", file, line);
+	exit(1);
+}
+
+/**
+ * Resets the queue to the given position, like queue_reset does for position 0.
+ */
+static void queue_reset_at(Queue* q, uint32_t start) {
+	for (uint32_t i = 0; i <= q->mask; i++) {
+		q->slots[(start + i) & q->mask].sequence = start + i;
+		q->slots[(start + i) & q->mask].obj = NULL;
+	}
+	q->head = q->tail = start;
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/**
+ * Marks an entry as received. Returns 0 on a duplicate or an invalid entry.
+ */
+static uint8_t receive(void* entry) {
+	uint32_t producer = ENTRY_PRODUCER(entry);
+	uint32_t index = ENTRY_INDEX(entry);
+	if (producer >= PRODUCERS || index >= ENTRIES_PER_PRODUCER) {
+		fprintf(stderr, "Invalid entry %p\n", entry);
+		return 0;
+	}
+	if (__atomic_exchange_n(&seen[producer][index], 1, __ATOMIC_RELAXED)) {
+		fprintf(stderr, "Entry %u of producer %u received twice\n", index, producer);
+		return 0;
+	}
+	return 1;
+}
+
+static void* producer_task(void* arg) {
+	uint32_t producer = (uint32_t) (uintptr_t) arg;
+	for (uint32_t i = 0; i < ENTRIES_PER_PRODUCER; i++) {
+		while (queue_enqueue(queue, ENTRY(producer, i)) != QUEUE_OK) {
+			if (drop_oldest) {
+				void* old = queue_dequeue(queue);
+				if (old != NULL) {
+					if (!receive(old)) {
+						exit(1);
+					}
+					__atomic_add_fetch(&dropped, 1, __ATOMIC_RELAXED);
+				}
+			}
+			sched_yield();
+		}
+	}
+	__atomic_add_fetch(&producers_done, 1, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+/**
+ * Runs the producers and consumes in this thread until everything is received.
+ * Returns the amount of errors.
+ */
+static uint32_t run(uint8_t drop, uint32_t start) {
+	pthread_t threads[PRODUCERS];
+	uint32_t next[PRODUCERS] = {0};
+	void* objs[BATCH_SIZE];
+	uint32_t received = 0;
+	uint32_t errors = 0;
+
+	memset(seen, 0, sizeof(seen));
+	producers_done = 0;
+	dropped = 0;
+	drop_oldest = drop;
+	queue_reset_at(queue, start);
+
+	for (uint32_t p = 0; p < PRODUCERS; p++) {
+		pthread_create(&threads[p], NULL, producer_task, (void*) (uintptr_t) p);
+	}
+
+	while (1) {
+		uint8_t done = __atomic_load_n(&producers_done, __ATOMIC_ACQUIRE) == PRODUCERS;
+		uint32_t n = queue_dequeue_batch(queue, objs, BATCH_SIZE);
+		for (uint32_t i = 0; i < n; i++) {
+			if (!receive(objs[i])) {
+				errors++;
+				continue;
+			}
+			// Without dropping the consumer sees the entries of one producer in order.
+			uint32_t producer = ENTRY_PRODUCER(objs[i]);
+			if (!drop && ENTRY_INDEX(objs[i]) != next[producer]) {
+				fprintf(stderr, "Producer %u: expected entry %u, got %u\n", producer, next[producer], ENTRY_INDEX(objs[i]));
+				errors++;
+			}
+			next[producer] = ENTRY_INDEX(objs[i]) + 1;
+		}
+		received += n;
+		if (done && n == 0) {
+			break;
+		}
+	}
+
+	for (uint32_t p = 0; p < PRODUCERS; p++) {
+		pthread_join(threads[p], NULL);
+	}
+
+	for (uint32_t p = 0; p < PRODUCERS; p++) {
+		for (uint32_t i = 0; i < ENTRIES_PER_PRODUCER; i++) {
+			if (!seen[p][i]) {
+				fprintf(stderr, "Entry %u of producer %u lost\n", i, p);
+				errors++;
+			}
+		}
+	}
+	if (!queue_empty(queue)) {
+		fprintf(stderr, "Queue not empty at the end\n");
+		errors++;
+	}
+
+	printf("%s: %u received, %u dropped, %u errors\n", drop ? "drop oldest" : "in order",
+			received, dropped, errors);
+	return errors;
+}
+
+int main(void) {
+	uint32_t errors = 0;
+	// Start shortly before the wrap around, each run passes it.
+	errors += run(0, UINT32_MAX - 1000);
+	errors += run(1, UINT32_MAX - 1000);
+	return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,157 @@
+/*
+ * pool_benchmark.c
+ *
+ * Host benchmark of the pool allocator: The free list of pool.c against the former allocator, which
+ * scanned free_management for the lowest free entry and for the freed block and counted the used
+ * entries for the high watermark. Like the "test scheduler" command, an entry is allocated and freed
+ * again on a pool, that is half allocated (every second entry). The second scenario has only the last
+ * entry free, the worst case of the scan. Both allocators are checked to hand out free blocks only.
+ *
+ * Build and run from the mikcrocontroller folder:
+ *   gcc -std=gnu11 -O2 -Wall -Itest/stub -IInc test/pool_benchmark.c Src/pool.c -o pool_benchmark
+ *   ./pool_benchmark
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: finn
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "pool.h"
+
+#define POOL_SIZE		112 // Like BENCHMARK_POOL_SIZE
+#define ROUNDS			10000000
+
+typedef struct {
+	uint8_t data[64];
+} entry_t;
+
+DEFINE_POOL(pool, POOL_SIZE, entry_t)
+
+void _Error_Handler(char* file, int line) {
+	fprintf(stderr, "Error_Handler called in %s:%d\n", file, line);
+	exit(1);
+}
+
+/**
+ * The former pool_alloc of a static pool, including the high watermark.
+ */
+static void* scan_pool_alloc(Pool* p) {
+	for (uint32_t i = 0; i < p->entrycount; i++) {
+		if (NULL == p->free_management[i]) {
+			p->free_management[i] = p->pool.stat + i*p->entrysize;
+			uint32_t usage = 0;
+			for (uint32_t j = 0; j < p->entrycount; j++) {
+				if (p->free_management[j] != NULL) {
+					usage++;
+				}
+			}
+			if (usage > p->usage_high_watermark) {
+				p->usage_high_watermark = usage;
+			}
+			return p->free_management[i];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * The former pool_free of a static pool.
+ */
+static uint8_t scan_pool_free(Pool* p, void* block) {
+	uint32_t index = 0;
+	while (index < p->entrycount && (p->pool.stat + index*p->entrysize) != (uint8_t*)block) {
+		index++;
+	}
+	if (index == p->entrycount) {
+		return POOL_ERR;
+	}
+	p->free_management[index] = NULL;
+	return POOL_OK;
+}
+
+static double now_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * Allocates all entries and frees the ones, for which keep_free returns 1.
+ */
+static void prepare(uint8_t scan, uint8_t (*keep_free)(uint32_t)) {
+	pool_init(pool);
+	void* blocks[POOL_SIZE];
+	for (uint32_t i = 0; i < POOL_SIZE; i++) {
+		blocks[i] = scan ? scan_pool_alloc(pool) : pool_alloc(pool);
+	}
+	for (uint32_t i = 0; i < POOL_SIZE; i++) {
+		if (keep_free(i)) {
+			if (scan) {
+				scan_pool_free(pool, blocks[i]);
+			} else {
+				pool_free(pool, blocks[i]);
+			}
+		}
+	}
+}
+
+/**
+ * Returns the mean ns of one allocation and free. Returns a negative value, if a block was handed
+ * out twice.
+ */
+static double measure(uint8_t scan, uint8_t (*keep_free)(uint32_t)) {
+	prepare(scan, keep_free);
+
+	double start = now_ns();
+	for (uint32_t i = 0; i < ROUNDS; i++) {
+		void* block = scan ? scan_pool_alloc(pool) : pool_alloc(pool);
+		if (NULL == block) {
+			return -1;
+		}
+		// The block must be one of the free ones, else it is handed out twice.
+		uint32_t index = ((uint8_t*)block - pool->pool.stat) / pool->entrysize;
+		if (!keep_free(index)) {
+			return -1;
+		}
+		if (scan) {
+			scan_pool_free(pool, block);
+		} else {
+			pool_free(pool, block);
+		}
+	}
+	return (now_ns() - start) / ROUNDS;
+}
+
+static uint8_t every_second(uint32_t i) {
+	return i % 2 == 0;
+}
+
+static uint8_t last_only(uint32_t i) {
+	return i == POOL_SIZE - 1;
+}
+
+int main(void) {
+	const struct {
+		const char* name;
+		uint8_t (*keep_free)(uint32_t);
+	} scenarios[] = {
+		{"half allocated", every_second},
+		{"last entry free", last_only},
+	};
+
+	printf("alloc+free of a %u entry pool, ns\n", POOL_SIZE);
+	printf("%-16s %10s %10s\n", "", "scan", "free list");
+	for (uint32_t i = 0; i < sizeof(scenarios)/sizeof(scenarios[0]); i++) {
+		double scan = measure(1, scenarios[i].keep_free);
+		double free_list = measure(0, scenarios[i].keep_free);
+		if (scan < 0 || free_list < 0) {
+			fprintf(stderr, "%s: a block was handed out twice\n", scenarios[i].name);
+			return 1;
+		}
+		printf("%-16s %10.1f %10.1f\n", scenarios[i].name, scan, free_list);
+	}
+	return 0;
+}
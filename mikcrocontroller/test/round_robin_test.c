@@ -0,0 +1,132 @@
+/*
+ * round_robin_test.c
+ *
+ * Host test of the deficit round robin, that shares a connection between the data, FFT and debug
+ * messages (see round_robin.c and tx_next in send_data.c). Checks, that bytes not enough for a message
+ * are carried over to the next turn, that a class without messages loses its bytes, and that a class
+ * with messages larger than its quantum is not starved and gets its share by weight.
+ *
+ * Build and run from the mikcrocontroller folder:
+ *   gcc -std=gnu11 -O2 -Wall -IInc test/round_robin_test.c Src/network/round_robin.c -o round_robin_test
+ *   ./round_robin_test
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: finn
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "round_robin.h"
+
+#define QUANTUM		536 // TCP_MSS
+
+static uint32_t errors;
+
+#define CHECK(condition) do {\
+	if (!(condition)) {\
+		fprintf(stderr, "%s:%d: %s failed\n", __FILE__, __LINE__, #condition);\
+		errors++;\
+	}\
+} while (0)
+
+/**
+ * One class with messages larger than its quantum. The rest of every turn is carried over.
+ */
+static void test_carry_over() {
+	round_robin_t rr;
+	round_robin_reset(&rr);
+	uint8_t weights[2] = {1, 1};
+	uint32_t lengths[2] = {800, 0};
+
+	// 0 + 536 + 536 bytes, after the turn of class 1 came back to class 0.
+	CHECK(round_robin_next(&rr, lengths, weights, 2, QUANTUM) == 0);
+	CHECK(rr.deficit[0] == 2*QUANTUM - 800);
+	// 272 + 536 bytes.
+	CHECK(round_robin_next(&rr, lengths, weights, 2, QUANTUM) == 0);
+	CHECK(rr.deficit[0] == 3*QUANTUM - 2*800);
+
+	// A small message is written with the rest of the turn.
+	lengths[0] = 8;
+	CHECK(round_robin_next(&rr, lengths, weights, 2, QUANTUM) == 0);
+	CHECK(rr.deficit[0] == 3*QUANTUM - 2*800 - 8);
+}
+
+/**
+ * A class without messages loses its bytes on its turn, so it cannot save them up.
+ */
+static void test_empty_class_resets() {
+	round_robin_t rr;
+	round_robin_reset(&rr);
+	uint8_t weights[2] = {4, 1};
+	uint32_t lengths[2] = {100, 100};
+
+	CHECK(round_robin_next(&rr, lengths, weights, 2, QUANTUM) == 1);
+	CHECK(round_robin_next(&rr, lengths, weights, 2, QUANTUM) == 1);
+	CHECK(round_robin_next(&rr, lengths, weights, 2, QUANTUM) == 1);
+	CHECK(round_robin_next(&rr, lengths, weights, 2, QUANTUM) == 1);
+	CHECK(round_robin_next(&rr, lengths, weights, 2, QUANTUM) == 1);
+	// 36 bytes are left for class 1. Class 0 gets its turn with 4 quantums.
+	CHECK(round_robin_next(&rr, lengths, weights, 2, QUANTUM) == 0);
+	CHECK(rr.deficit[0] == 4*QUANTUM - 100);
+
+	// Class 0 runs empty. Its bytes are gone on its next turn.
+	lengths[0] = 0;
+	CHECK(round_robin_next(&rr, lengths, weights, 2, QUANTUM) == 1);
+	CHECK(rr.deficit[0] == 0);
+	CHECK(rr.deficit[1] == 2*QUANTUM - 6*100);
+
+	// Nothing to write: No class is picked and the deficits stay.
+	lengths[1] = 0;
+	CHECK(round_robin_next(&rr, lengths, weights, 2, QUANTUM) == 2);
+	CHECK(rr.deficit[1] == 2*QUANTUM - 6*100);
+}
+
+/**
+ * Three always busy classes like data, FFT and debug. Every class is served and the written bytes
+ * follow the weights, even if the messages of a class are larger than its quantum.
+ */
+static void test_no_starvation() {
+	round_robin_t rr;
+	round_robin_reset(&rr);
+	uint8_t weights[3] = {4, 1, 1};
+	uint32_t lengths[3] = {1024, 4*QUANTUM + 100, 20};
+	uint32_t bytes[3] = {0};
+	uint32_t last_turn[3] = {0};
+	uint32_t max_gap[3] = {0};
+
+	for (uint32_t i = 1; i <= 100000; i++) {
+		uint8_t next = round_robin_next(&rr, lengths, weights, 3, QUANTUM);
+		CHECK(next < 3);
+		if (next >= 3) {
+			return;
+		}
+		bytes[next] += lengths[next];
+		if (i - last_turn[next] > max_gap[next]) {
+			max_gap[next] = i - last_turn[next];
+		}
+		last_turn[next] = i;
+	}
+
+	uint32_t total = bytes[0] + bytes[1] + bytes[2];
+	for (uint8_t i = 0; i < 3; i++) {
+		CHECK(bytes[i] > 0);
+		// The share differs from the weight by less than one message per round.
+		double share = (double) bytes[i] / total;
+		double expected = weights[i] / 6.0;
+		CHECK(share > expected * 0.9 && share < expected * 1.1);
+	}
+	// The large FFT message is written at least every 5 rounds. A round has at most 3 data, 1 FFT and
+	// 28 debug messages (with the carried over bytes).
+	CHECK(max_gap[1] <= 5*(3 + 1 + 28));
+	printf("bytes data %u, fft %u, debug %u, max messages between two fft %u\n", bytes[0], bytes[1],
+			bytes[2], max_gap[1]);
+}
+
+int main(void) {
+	test_carry_over();
+	test_empty_class_resets();
+	test_no_starvation();
+	printf("%u errors\n", errors);
+	return errors == 0 ? 0 : 1;
+}
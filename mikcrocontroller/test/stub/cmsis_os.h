@@ -0,0 +1,29 @@
+/*
+ * cmsis_os.h
+ *
+ * Host replacement of the CMSIS-RTOS header for the tests in this folder. The tests run the pool in
+ * one thread, so the critical sections do nothing. The heap is the one of the C library.
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: finn
+ */
+
+#ifndef CMSIS_OS_H_
+#define CMSIS_OS_H_
+
+#include "stdlib.h"
+
+typedef unsigned long UBaseType_t;
+
+#define taskENTER_CRITICAL_FROM_ISR()		0
+#define taskEXIT_CRITICAL_FROM_ISR(mask)	((void)(mask))
+#define pvPortMalloc(size)					malloc(size)
+
+#ifndef __aligned
+#define __aligned(x)	__attribute__((__aligned__(x)))
+#endif
+#ifndef __section
+#define __section(x)	__attribute__((__section__(x)))
+#endif
+
+#endif /* CMSIS_OS_H_ */
@@ -61,6 +61,8 @@ export class State {
     public internalReference: boolean;
     public slowConnection: boolean;
     public ADCReset: boolean;
+    public overload: number; // 0: none, 1: FFTs paused, 2: decimated, 3: dropping packets
+    public recording: boolean; // The data is recorded to the SD card
 
     public samplerate: number;
     public get verboseSamplerate(): string {
@@ -45,6 +45,12 @@ export class PSDService {
      */
     private lastFrameNumber: number;
 
+    /**
+     * The sequence number of the last FFT recieved. Gaps are FFTs skipped by the ADC or
+     * dropped on the way. Undefined, if no FFT was recieved yet.
+     */
+    private lastSequence: number;
+
     /**
      * Accumulates the data, if the FFT message is fragmented.
      */
@@ -66,12 +72,12 @@ export class PSDService {
      * @param buffer The fft message
      */
     private rawInput(buffer: ArrayBuffer): void {
-        const metadatasize = 21;
+        const metadatasize = 25;
         if (buffer.byteLength < metadatasize) {
             return;
         }
 
-        const metainfos = this.structService.fromBuffer('BBBHQffA', buffer);
+        const metainfos = this.structService.fromBuffer('BBBHQffIA', buffer);
 
         const id = metainfos[0] as number;
         if (!this.id) {
@@ -86,6 +92,11 @@ export class PSDService {
         // timestamp not needed..
         const resolution = metainfos[5] as number;
         const wss = metainfos[6] as number;
+        const sequence = metainfos[7] as number;
+
+        if (frameNumber === 0) {
+            this.checkSequence(sequence);
+        }
 
         //console.log('got frame ' + (frameNumber + 1) + '/' + frameCount);
 
@@ -100,7 +111,7 @@ export class PSDService {
         }
         this.lastFrameNumber = frameNumber;
 
-        this.dataBuffer = appendBuffers(this.dataBuffer, metainfos[7] as ArrayBuffer);
+        this.dataBuffer = appendBuffers(this.dataBuffer, metainfos[8] as ArrayBuffer);
         if (frameNumber + 1 === frameCount) {
             // OK. finished. Process data.
             this.processPacketData(this.dataBuffer, N, wss, resolution);
@@ -108,6 +119,21 @@ export class PSDService {
         }
     }
 
+    /**
+     * Logs lost FFTs. A sequence of 0 means, that the measurement was restarted.
+     *
+     * @param sequence The sequence number of the new FFT
+     */
+    private checkSequence(sequence: number): void {
+        if (this.lastSequence !== undefined && sequence !== 0) {
+            const lost = (sequence - this.lastSequence - 1) >>> 0;
+            if (lost > 0 && lost < 0x80000000) {
+                console.log('Lost ' + lost + ' FFT(s) before FFT ' + sequence);
+            }
+        }
+        this.lastSequence = sequence;
+    }
+
     /**
      * Resets the aquiring of the current package.
      */
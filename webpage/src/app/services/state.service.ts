@@ -7,6 +7,21 @@ import { StructService } from './struct.service';
 import { State, MeasurementState } from '../models/state';
 import { WebsocketService } from './websocket.service';
 
+/**
+ * The kinds of state messages. A full message has the raw state, a delta message only the
+ * changes since the message before. See send_state_to_clients in state.c.
+ */
+enum StateMessageKind {
+    Full = 0,
+    Delta = 1
+}
+
+const stateMessageHeaderSize = 5; // kind (u8), version (u32)
+const adcStateSize = 21;
+const measurementStateSize = 9;
+// Offset and size of the fields of the ADC state in the order of the bits of the delta mask.
+const adcStateFields: [number, number][] = [[0, 1], [1, 1], [2, 1], [3, 8], [11, 1], [12, 4], [16, 4], [20, 1]];
+
 /**
  * Takes care about recieving state updates. Parses them and publish them via
  * `getStateObservable`. Query the current state via `getCurrentState`.
@@ -17,6 +32,14 @@ import { WebsocketService } from './websocket.service';
 export class StateService {
     private readonly statusSubject: BehaviorSubject<State> = new BehaviorSubject<State>(null);
 
+    /**
+     * The raw state of the last state message. Deltas are applied to it. If a message is
+     * missing, the version is null and deltas are ignored until the next full message.
+     */
+    private version: number | null = null;
+    private adcBytes: Uint8Array = new Uint8Array(adcStateSize);
+    private measurementBytes: { [id: number]: Uint8Array } = {};
+
     public constructor(
         private ADCPRepService: ADCPRepresentationService,
         private structService: StructService,
@@ -24,15 +47,19 @@ export class StateService {
     ) {
         this.ADCPRepService.getPacketObservable(PacketType.Status).subscribe((msg: ArrayBuffer) => {
             try {
-                console.log("got statusupdate");
-                const state = this.constructState(msg);
-                this.updateState(state);
+                const state = this.handleStateMessage(msg);
+                if (state) {
+                    this.updateState(state);
+                } else {
+                    console.log("a state message is missing, waiting for the next full state.");
+                }
             } catch (e) {
                 console.log("could not parse state.");
             }
         });
 
         this.websocketService.getCloseEventObservable().subscribe(() => {
+            this.version = null;
             this.updateState(null);
         });
     }
@@ -46,13 +73,72 @@ export class StateService {
         this.statusSubject.next(state);
     }
 
+    /**
+     * Applies a full or delta state message. Returns the new state or null, if the delta
+     * does not follow the last message.
+     *
+     * @param message The state message.
+     */
+    private handleStateMessage(message: ArrayBuffer): State | null {
+        if (message.byteLength < stateMessageHeaderSize) {
+            throw new Error("The server didn't send enough data");
+        }
+        const header = this.structService.fromBuffer('BI', message.slice(0, stateMessageHeaderSize));
+        const kind = header[0] as number;
+        const version = header[1] as number;
+        const body = new Uint8Array(message, stateMessageHeaderSize);
+
+        if (kind === StateMessageKind.Full) {
+            const state = this.constructState(body.slice().buffer as ArrayBuffer);
+            this.adcBytes = body.slice(0, adcStateSize);
+            this.measurementBytes = {};
+            for (let i = adcStateSize; i + measurementStateSize <= body.length; i += measurementStateSize) {
+                this.measurementBytes[body[i]] = body.slice(i, i + measurementStateSize);
+            }
+            this.version = version;
+            return state;
+        } else if (kind !== StateMessageKind.Delta) {
+            throw new Error('Unknown state message');
+        }
+
+        if (this.version === null || version !== (this.version + 1) % 0x100000000) {
+            this.version = null;
+            return null;
+        }
+
+        const mask = body[0];
+        let pos = 1;
+        adcStateFields.forEach(([offset, size], i) => {
+            if (mask & (1 << i)) {
+                this.adcBytes.set(body.subarray(pos, pos + size), offset);
+                pos += size;
+            }
+        });
+        const changed = body[pos++];
+        for (let i = 0; i < changed; i++) {
+            this.measurementBytes[body[pos]] = body.slice(pos, pos + measurementStateSize);
+            pos += measurementStateSize;
+        }
+        const deleted = body[pos++];
+        for (let i = 0; i < deleted; i++) {
+            delete this.measurementBytes[body[pos++]];
+        }
+        this.version = version;
+
+        // Build the raw state and parse it like a full state.
+        const ids = Object.keys(this.measurementBytes).map(id => +id).sort((a, b) => a - b);
+        const raw = new Uint8Array(adcStateSize + ids.length * measurementStateSize);
+        raw.set(this.adcBytes, 0);
+        ids.forEach((id, i) => raw.set(this.measurementBytes[id], adcStateSize + i * measurementStateSize));
+        return this.constructState(raw.buffer as ArrayBuffer);
+    }
+
     /**
      * Build the state from the given bytes.
      *
      * @param bytes The bytes.
      */
     public constructState(bytes: ArrayBuffer): State {
-        const adcStateSize = 21;
         if (bytes.byteLength < adcStateSize) {
             throw new Error("The server didn't send enough data");
         }
@@ -66,6 +152,8 @@ export class StateService {
         state.internalReference = !!(status & 0x04);
         state.slowConnection = !!(status & 0x08);
         state.ADCReset = !!(status & 0x10);
+        state.overload = (status & 0x60) >> 5;
+        state.recording = !!(status & 0x80);
 
         const srFilter = result[1] as number;
         state.samplerate = srFilter & 0x0f;
@@ -82,7 +170,6 @@ export class StateService {
         const measurementCount = result[7] as number;
 
         // check for length of all measurements
-        const measurementStateSize = 9;
         const expectedLength = adcStateSize + measurementCount * measurementStateSize;
         if (bytes.byteLength < expectedLength) {
             throw new Error("The server didn't send enough data");